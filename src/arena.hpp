@@ -0,0 +1,45 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+#include "cpu/state.hpp"
+#include "memory/bus.hpp"
+#include "memory/dma.hpp"
+#include "cartridge/mbc.hpp"
+#include "ppu/ppu.hpp"
+
+/**
+ * Everything that changes while an instance runs, in one contiguous, trivially copyable block.
+ * Components only hold pointers into it, so that a snapshot is a memcpy of the arena and many
+ * instances can be packed next to each other. Layout, on 64-bit hosts:
+ *
+ *     offset  size   field
+ *          0     48  cpu   registers, lazy flags, cycle and instruction counters
+ *         48     20  dma   DMA registers and transfer progress
+ *         72     32  mbc   bank controller registers, MBC3 clock
+ *        104     16  ppu   line timing, frame counter
+ *        128    256  high  I/O registers, HRAM and IE (FF00-FFFF)
+ *        384  24832  ram   VRAM, external RAM, WRAM and OAM, see Memory::Bus::ram
+ *
+ * 25216 bytes in all, cache line aligned. RAM comes last: a cloned instance shares it with
+ * its parent (see Emu::Clone) and allocates only the arena_state_size bytes before it, and
+ * restoring an instance copies everything before ram and loads RAM
+ * through the bus. Caches, page tables and handlers are derived from the arena and rebuilt
+ * on restore. The cartridge ROM is shared between instances, and cartridge RAM, which may be
+ * a save file of up to 128 KiB, stays with the bank controller: see Emu::Snapshot.
+ */
+struct alignas(64) Arena {
+    Cpu::State cpu;
+    Memory::DmaState dma;
+    Cartridge::MbcState mbc;
+    Ppu::State ppu;
+    alignas(64) uint8_t high[Memory::page_size];
+    alignas(64) uint8_t ram[Memory::Bus::ram_size];
+};
+
+static_assert(std::is_trivially_copyable_v<Arena>, "an arena is saved and restored with memcpy");
+static_assert(offsetof(Arena, high) == 128 && offsetof(Arena, ram) == 384, "update the layout above");
+static_assert(sizeof(Arena) == 25216, "update the layout above");
+
+/// Bytes of an arena before ram, the whole arena of a clone: it reads RAM from its parent's.
+constexpr size_t arena_state_size = offsetof(Arena, ram);
@@ -0,0 +1,106 @@
+#include <cstring>
+#include <new>
+
+#include "arena_pool.hpp"
+
+#if GBEMU_HUGE_PAGES
+#include <sys/mman.h>
+#endif
+
+size_t ArenaPool::Usage::ArenaBytesPerInstance() const {
+    return this->instances != 0 ? this->reserved / this->instances : 0;
+}
+
+ArenaPool::ArenaPool() {
+    this->instances = 0;
+    this->huge_tlb_failed = false;
+}
+
+ArenaPool::~ArenaPool() {
+    for (const Page& page : this->pages) {
+#if GBEMU_HUGE_PAGES
+        munmap(page.memory, huge_page_size);
+#else
+        ::operator delete(page.memory, std::align_val_t(huge_page_size));
+#endif
+    }
+}
+
+ArenaPool::Page ArenaPool::MapPage() {
+#if GBEMU_HUGE_PAGES
+    if (!this->huge_tlb_failed) {
+        void* const memory = mmap(nullptr, huge_page_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (memory != MAP_FAILED)
+            return { (uint8_t*) memory, Backing::HugeTlb };
+        this->huge_tlb_failed = true;
+    }
+
+    // a transparent huge page needs a 2 MiB aligned range: map twice as much and trim it
+    void* const mapped = mmap(nullptr, 2 * huge_page_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mapped == MAP_FAILED)
+        throw std::bad_alloc();
+    uint8_t* const start = (uint8_t*) mapped;
+    uint8_t* const memory = (uint8_t*) (((uintptr_t) start + huge_page_size - 1) & ~(uintptr_t) (huge_page_size - 1));
+    if (memory != start)
+        munmap(start, memory - start);
+    munmap(memory + huge_page_size, start + huge_page_size - memory);
+
+    const bool transparent = madvise(memory, huge_page_size, MADV_HUGEPAGE) == 0;
+    return { memory, transparent ? Backing::Transparent : Backing::Regular };
+#else
+    uint8_t* const memory = (uint8_t*) ::operator new(huge_page_size, std::align_val_t(huge_page_size));
+    std::memset(memory, 0, huge_page_size);
+    return { memory, Backing::Regular };
+#endif
+}
+
+void ArenaPool::Grow(const bool with_ram) {
+    const Page page = this->MapPage();
+    this->pages.push_back(page);
+    std::vector<Arena*>& free = with_ram ? this->free : this->free_states;
+    const size_t count = with_ram ? arenas_per_page : states_per_page;
+    const size_t size = with_ram ? sizeof(Arena) : arena_state_size;
+    // in reverse, so that arenas are handed out in address order
+    for (size_t i = count; i-- > 0;)
+        free.push_back(reinterpret_cast<Arena*>(page.memory + i * size));
+}
+
+std::shared_ptr<Arena> ArenaPool::Allocate(const bool with_ram) {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    std::vector<Arena*>& free = with_ram ? this->free : this->free_states;
+    if (free.empty())
+        this->Grow(with_ram);
+    Arena* const arena = free.back();
+    free.pop_back();
+    this->instances++;
+    // fresh pages are zeroed by the system, released arenas by Release; an arena without ram is
+    // too short to construct, which a trivial type does not need
+    Arena* const constructed = with_ram ? new (arena) Arena : arena;
+    return std::shared_ptr<Arena>(constructed, [this, with_ram](Arena* const arena) { this->Release(arena, with_ram); });
+}
+
+void ArenaPool::Release(Arena* const arena, const bool with_ram) {
+    std::memset((void*) arena, 0, with_ram ? sizeof(Arena) : arena_state_size);
+    std::lock_guard<std::mutex> lock(this->mutex);
+    (with_ram ? this->free : this->free_states).push_back(arena);
+    this->instances--;
+}
+
+ArenaPool::Usage ArenaPool::Measure() {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    Usage usage = {};
+    usage.instances = this->instances;
+    usage.pages = this->pages.size();
+    for (const Page& page : this->pages) {
+        usage.huge_tlb_pages += page.backing == Backing::HugeTlb;
+        usage.transparent_pages += page.backing == Backing::Transparent;
+    }
+    usage.reserved = usage.pages * huge_page_size;
+    return usage;
+}
+
+void ArenaPool::Report(std::FILE* const file) {
+    const Usage usage = this->Measure();
+    std::fprintf(file, "arena pool: %zu instances in %zu pages of 2 MiB (%zu hugetlb, %zu transparent), %zu arena bytes per instance, %zu in the arena\n",
+        usage.instances, usage.pages, usage.huge_tlb_pages, usage.transparent_pages, usage.ArenaBytesPerInstance(), sizeof(Arena));
+}
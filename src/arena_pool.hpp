@@ -0,0 +1,89 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "arena.hpp"
+
+// huge pages are requested with mmap and madvise
+#if defined(__linux__)
+#define GBEMU_HUGE_PAGES 1
+#else
+#define GBEMU_HUGE_PAGES 0
+#endif
+
+/**
+ * Allocates the arenas of many instances next to each other, out of 2 MiB huge pages, so that
+ * the arenas of thousands of them take one TLB entry per 83 instances rather than 7 per instance.
+ * Only arenas are pooled: the rest of an instance, its page tables, PPU buffers, caches and
+ * compiled code (see Emu::Measure), stays on regular pages, and takes tens more TLB entries.
+ * Reserved huge pages (MAP_HUGETLB) are used when the system has some, transparent huge pages
+ * (madvise MADV_HUGEPAGE) otherwise, and regular pages if neither is available: the pool works
+ * the same, only the TLB misses differ. Memory is never returned to the system before the pool
+ * is destroyed, which must happen after every arena it allocated was released.
+ */
+class ArenaPool {
+public:
+    static constexpr size_t huge_page_size = 2 << 20;
+    static constexpr size_t arenas_per_page = huge_page_size / sizeof(Arena);
+    static constexpr size_t states_per_page = huge_page_size / arena_state_size;
+
+    enum class Backing : uint8_t {
+        HugeTlb,      // reserved huge pages
+        Transparent,  // transparent huge pages, if the kernel finds a free 2 MiB page
+        Regular
+    };
+
+    /// Memory taken by the pool, for reporting.
+    struct Usage {
+        size_t instances;   // arenas allocated and not released yet
+        size_t pages;       // 2 MiB pages reserved
+        size_t huge_tlb_pages;
+        size_t transparent_pages;
+        size_t reserved;    // bytes
+        /**
+         * Arena bytes reserved per instance, huge page slack included, between arena_state_size
+         * and sizeof(Arena) at best, depending on how many instances are clones.
+         * Only the pooled arena: the PPU, page tables, decode and block caches and compiled
+         * code of each instance are allocated apart, see Emu::Measure.
+         */
+        size_t ArenaBytesPerInstance() const;
+    };
+private:
+    struct Page {
+        uint8_t* memory;
+        Backing backing;
+    };
+
+    std::mutex mutex;
+    std::vector<Page> pages;
+    /// Released arenas, zeroed, and arenas of the last page never allocated.
+    std::vector<Arena*> free;
+    /// The same for arenas without ram, of arena_state_size bytes, carved from pages of their own.
+    std::vector<Arena*> free_states;
+    size_t instances;
+    /// Set once MAP_HUGETLB failed: the system has no huge pages reserved, or none left.
+    bool huge_tlb_failed;
+
+    /// Reserves another page and adds its arenas to free, or to free_states without ram.
+    void Grow(const bool with_ram);
+    /// Maps a 2 MiB page, backed by a huge page if possible.
+    Page MapPage();
+    void Release(Arena* const arena, const bool with_ram);
+public:
+    ArenaPool();
+    ~ArenaPool();
+    ArenaPool(const ArenaPool&) = delete;
+    ArenaPool& operator=(const ArenaPool&) = delete;
+
+    /**
+     * Returns a zeroed arena, given back to the pool when the last pointer to it is released. Thread-safe.
+     * Without ram, only the arena_state_size bytes before Arena::ram are allocated, for clones.
+     */
+    std::shared_ptr<Arena> Allocate(const bool with_ram = true);
+    Usage Measure();
+    /// Prints Measure() to file, on one line: arena memory only, see Usage::ArenaBytesPerInstance and Emu::Report.
+    void Report(std::FILE* const file);
+};
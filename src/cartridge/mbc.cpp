@@ -0,0 +1,335 @@
+#include <cstdio>
+#include <cstring>
+#include <utility>
+
+#include "mbc.hpp"
+#include "../cpu/cpu.hpp"
+
+namespace Cartridge {
+    constexpr uint32_t rom_window_pages = rom_bank_size / Memory::page_size;
+    constexpr uint32_t ram_window_pages = ram_bank_size / Memory::page_size;
+    constexpr uint8_t ram_window_page = 0xA0;
+
+    Mbc::Mbc(Cpu::Cpu* const cpu, Memory::Bus* const bus, MbcState* const state, std::shared_ptr<const Rom> rom, const uint32_t ram_size)
+        : cpu(cpu), bus(bus), state(state), rom(std::move(rom)) {
+        this->rom_banks = this->rom->Size() / rom_bank_size;
+        // 2 KiB RAM still takes a whole bank, mirrored by hardware
+        this->ram_banks = (ram_size + ram_bank_size - 1) / ram_bank_size;
+        this->volatile_ram.reset(new uint8_t[this->ram_banks * ram_bank_size]());
+        this->ram = this->volatile_ram.get();
+        *this->state = {};
+        this->mapped_rom_banks[0] = no_bank;
+        this->mapped_rom_banks[1] = no_bank;
+        this->mapped_ram_bank = no_bank;
+
+        // ROM pages are read as memory, writes to them reach the controller
+        this->bus->MapHandler(0x00, 2 * rom_window_pages, this);
+        this->bus->MapHandler(ram_window_page, ram_window_pages, this);
+        this->MapRomBank(0, 0);
+        this->MapRomBank(1, 1);
+    }
+
+    Mbc::Mbc(const Mbc& parent, Cpu::Cpu* const cpu, Memory::Bus* const bus, MbcState* const state)
+        : mapped_ram_bank(parent.mapped_ram_bank), volatile_ram(parent.volatile_ram), save(nullptr),
+          cpu(cpu), bus(bus), state(state), rom(parent.rom), rom_banks(parent.rom_banks), ram(parent.ram),
+          ram_banks(parent.ram_banks) {
+        this->mapped_rom_banks[0] = parent.mapped_rom_banks[0];
+        this->mapped_rom_banks[1] = parent.mapped_rom_banks[1];
+        this->bus->ReplaceHandler(&parent, this);
+        if (parent.save == nullptr)
+            return;
+
+        // the parent keeps its save file, and the bus its pages: map a copy
+        this->volatile_ram.reset(new uint8_t[this->RamSize()]);
+        std::memcpy(this->volatile_ram.get(), parent.ram, this->RamSize());
+        this->ram = this->volatile_ram.get();
+        const uint32_t bank = this->mapped_ram_bank;
+        this->mapped_ram_bank = no_bank;
+        if (bank != no_bank)
+            this->MapRamBank(bank);
+    }
+
+    void Mbc::MapRomBank(const uint8_t window, const uint32_t bank) {
+        const uint32_t mapped = bank % this->rom_banks;
+        if (this->mapped_rom_banks[window] == mapped)
+            return;
+
+        this->mapped_rom_banks[window] = mapped;
+        const uint8_t first_page = window * rom_window_pages;
+        // read-only, so the image is never written through the cast
+        uint8_t* const memory = const_cast<uint8_t*>(this->rom->Data()) + mapped * rom_bank_size;
+        this->bus->MapMemory(first_page, rom_window_pages, memory, false);
+        this->cpu->InvalidateCode(first_page << Memory::page_bits, (first_page << Memory::page_bits) + rom_bank_size);
+    }
+
+    void Mbc::MapRamBank(const uint32_t bank) {
+        if (!this->state->ram_enabled || this->ram_banks == 0) {
+            this->UnmapRam();
+            return;
+        }
+
+        const uint32_t mapped = bank % this->ram_banks;
+        if (this->mapped_ram_bank == mapped)
+            return;
+
+        this->mapped_ram_bank = mapped;
+        // writes to mapped RAM bypass the controller
+        if (this->save != nullptr)
+            this->save->MarkDirty();
+        this->bus->MapMemory(ram_window_page, ram_window_pages, this->ram + mapped * ram_bank_size, true);
+        this->cpu->InvalidateCode(ram_window_page << Memory::page_bits, (ram_window_page << Memory::page_bits) + ram_bank_size);
+    }
+
+    void Mbc::UnmapRam() {
+        if (this->mapped_ram_bank == no_bank)
+            return;
+
+        this->mapped_ram_bank = no_bank;
+        this->bus->MapHandler(ram_window_page, ram_window_pages, this);
+        this->cpu->InvalidateCode(ram_window_page << Memory::page_bits, (ram_window_page << Memory::page_bits) + ram_bank_size);
+    }
+
+    uint8_t Mbc::Read(const uint16_t) {
+        return 0xFF;
+    }
+
+    void Mbc::Flush() {
+        if (this->save == nullptr)
+            return;
+        if (this->mapped_ram_bank != no_bank)
+            this->save->MarkDirty();
+        this->save->Flush();
+    }
+
+    void Mbc::Restore() {
+        // whatever is mapped now, map the restored banks
+        this->mapped_rom_banks[0] = no_bank;
+        this->mapped_rom_banks[1] = no_bank;
+        this->mapped_ram_bank = 0;
+        this->UnmapRam();
+        this->Remap();
+    }
+
+    uint32_t Mbc::RamSize() const {
+        return this->ram_banks * ram_bank_size;
+    }
+
+    void Mbc::StoreRam(uint8_t* const destination) const {
+        this->bus->StoreMemory(this->ram, this->RamSize(), destination);
+    }
+
+    void Mbc::LoadRam(const uint8_t* const source) {
+        if (this->save != nullptr)
+            this->save->MarkDirty();
+        this->bus->LoadMemory(this->ram, this->RamSize(), source);
+    }
+
+    std::unique_ptr<Mbc> Mbc::Create(Cpu::Cpu* const cpu, Memory::Bus* const bus, MbcState* const state, std::shared_ptr<const Rom> rom, const char* const save_path) {
+        if (rom->Size() < 0x150)
+            return nullptr;
+
+        const uint8_t type = rom->Data()[0x147];
+        if (type == 0x00)
+            return nullptr;
+        if (rom->Size() < 2 * rom_bank_size) {
+            std::fprintf(stderr, "cartridge type %02X: ROM too small for a bank controller\n", type);
+            return nullptr;
+        }
+
+        constexpr uint32_t ram_sizes[] = { 0, 0x800, 0x2000, 0x8000, 0x20000, 0x10000 };
+        const uint8_t ram_code = rom->Data()[0x149];
+        const bool has_ram = type == 0x02 || type == 0x03 || type == 0x10 || type == 0x12 || type == 0x13
+            || type == 0x1A || type == 0x1B || type == 0x1D || type == 0x1E;
+        const uint32_t ram_size = has_ram && ram_code < sizeof(ram_sizes) / sizeof(ram_sizes[0]) ? ram_sizes[ram_code] : 0;
+        const bool battery = type == 0x03 || type == 0x0F || type == 0x10 || type == 0x13 || type == 0x1B || type == 0x1E;
+
+        std::unique_ptr<Mbc> mbc;
+        if (type >= 0x01 && type <= 0x03)
+            mbc = std::make_unique<Mbc1>(cpu, bus, state, std::move(rom), ram_size);
+        else if (type >= 0x0F && type <= 0x13)
+            mbc = std::make_unique<Mbc3>(cpu, bus, state, std::move(rom), ram_size, type == 0x0F || type == 0x10);
+        else if (type >= 0x19 && type <= 0x1E)
+            mbc = std::make_unique<Mbc5>(cpu, bus, state, std::move(rom), ram_size);
+        else {
+            std::fprintf(stderr, "cartridge type %02X: unsupported bank controller\n", type);
+            return nullptr;
+        }
+
+        // RAM is not mapped yet, so it can still be moved to the save file
+        if (battery && mbc->ram_banks != 0 && save_path != nullptr) {
+            mbc->save = SaveFile::Open(save_path, mbc->ram_banks * ram_bank_size);
+            if (mbc->save != nullptr) {
+                mbc->ram = mbc->save->Data();
+                mbc->volatile_ram = nullptr;
+                bus->KeepPrivate(mbc->ram, mbc->RamSize());
+            }
+        }
+        return mbc;
+    }
+
+    Mbc1::Mbc1(Cpu::Cpu* const cpu, Memory::Bus* const bus, MbcState* const state, std::shared_ptr<const Rom> rom, const uint32_t ram_size)
+        : Mbc(cpu, bus, state, std::move(rom), ram_size) {
+        this->state->bank_low = 1;
+    }
+
+    void Mbc1::Remap() {
+        const uint8_t low = this->state->bank_low == 0 ? 1 : this->state->bank_low;
+        // in advanced banking mode, the 2-bit register also applies to 0000-3FFF and to RAM
+        this->MapRomBank(0, this->state->advanced_banking ? this->state->bank_high << 5 : 0);
+        this->MapRomBank(1, this->state->bank_high << 5 | low);
+        this->MapRamBank(this->state->advanced_banking ? this->state->bank_high : 0);
+    }
+
+    void Mbc1::Write(const uint16_t address, const uint8_t value) {
+        if (address < 0x2000)
+            this->state->ram_enabled = (value & 0x0F) == 0x0A;
+        else if (address < 0x4000)
+            this->state->bank_low = value & 0x1F;
+        else if (address < 0x6000)
+            this->state->bank_high = value & 0x03;
+        else if (address < 0x8000)
+            this->state->advanced_banking = value & 0x01;
+        else
+            return;  // external RAM while disabled
+        this->Remap();
+    }
+
+    Mbc1::Mbc1(const Mbc1& parent, Cpu::Cpu* const cpu, Memory::Bus* const bus, MbcState* const state) : Mbc(parent, cpu, bus, state) {}
+
+    std::unique_ptr<Mbc> Mbc1::Clone(Cpu::Cpu* const cpu, Memory::Bus* const bus, MbcState* const state) const {
+        return std::unique_ptr<Mbc>(new Mbc1(*this, cpu, bus, state));
+    }
+
+    Mbc3::Mbc3(Cpu::Cpu* const cpu, Memory::Bus* const bus, MbcState* const state, std::shared_ptr<const Rom> rom, const uint32_t ram_size, const bool clock)
+        : Mbc(cpu, bus, state, std::move(rom), ram_size) {
+        this->clock = clock;
+        this->state->rom_bank = 1;
+        this->state->latch = 0xFF;
+        this->state->base_cycle = cpu->state->cycles;
+    }
+
+    void Mbc3::Remap() {
+        this->MapRomBank(0, 0);
+        this->MapRomBank(1, this->state->rom_bank);
+        this->Select();
+    }
+
+    uint64_t Mbc3::Now() {
+        if (this->state->clock_flags & halt)
+            return this->state->base_seconds;
+
+        constexpr uint64_t wrap = 512 * 86400;
+        const uint64_t seconds = this->state->base_seconds + (this->cpu->state->cycles - this->state->base_cycle) / cycles_per_second;
+        if (seconds >= wrap) {
+            // the day counter overflowed: carry is set until written back to 0
+            this->state->clock_flags |= day_carry;
+            this->SetNow(seconds % wrap);
+            return this->state->base_seconds;
+        }
+        return seconds;
+    }
+
+    void Mbc3::SetNow(const uint64_t seconds) {
+        this->state->base_seconds = seconds;
+        this->state->base_cycle = this->cpu->state->cycles;
+    }
+
+    void Mbc3::Select() {
+        if (this->state->ram_bank >= 0x08)
+            this->UnmapRam();
+        else
+            this->MapRamBank(this->state->ram_bank & 0x03);
+    }
+
+    uint8_t Mbc3::Read(const uint16_t) {
+        if (this->state->ram_enabled && this->clock && this->state->ram_bank >= 0x08 && this->state->ram_bank <= 0x0C)
+            return this->state->latched[this->state->ram_bank - 0x08];
+        return 0xFF;
+    }
+
+    void Mbc3::Write(const uint16_t address, const uint8_t value) {
+        if (address < 0x2000) {
+            this->state->ram_enabled = (value & 0x0F) == 0x0A;
+            this->Select();
+        } else if (address < 0x4000) {
+            const uint8_t bank = value & 0x7F;
+            this->state->rom_bank = bank == 0 ? 1 : bank;
+            this->MapRomBank(1, this->state->rom_bank);
+        } else if (address < 0x6000) {
+            this->state->ram_bank = value;
+            this->Select();
+        } else if (address < 0x8000) {
+            // writing 0 then 1 copies the clock to the readable registers
+            if (this->state->latch == 0x00 && value == 0x01) {
+                const uint64_t now = this->Now();
+                const uint64_t days = now / 86400;
+                this->state->latched[0] = now % 60;
+                this->state->latched[1] = now / 60 % 60;
+                this->state->latched[2] = now / 3600 % 24;
+                this->state->latched[3] = days & 0xFF;
+                this->state->latched[4] = (days >> 8 & 0x01) | this->state->clock_flags;
+            }
+            this->state->latch = value;
+        } else if (this->state->ram_enabled && this->clock && this->state->ram_bank >= 0x08 && this->state->ram_bank <= 0x0C) {
+            const uint64_t now = this->Now();
+            uint64_t seconds = now % 60;
+            uint64_t minutes = now / 60 % 60;
+            uint64_t hours = now / 3600 % 24;
+            uint64_t days = now / 86400;
+            constexpr uint8_t masks[5] = { 0x3F, 0x3F, 0x1F, 0xFF, 0xC1 };
+            const uint8_t masked = value & masks[this->state->ram_bank - 0x08];
+            switch (this->state->ram_bank) {
+                case 0x08: seconds = masked; break;
+                case 0x09: minutes = masked; break;
+                case 0x0A: hours = masked; break;
+                case 0x0B: days = (days & 0x100) | masked; break;
+                case 0x0C:
+                    days = (days & 0xFF) | (masked & 0x01) << 8;
+                    this->state->clock_flags = masked & (halt | day_carry);
+                    break;
+            }
+            this->state->latched[this->state->ram_bank - 0x08] = masked;
+            this->SetNow(((days * 24 + hours) * 60 + minutes) * 60 + seconds);
+        }
+    }
+
+    Mbc3::Mbc3(const Mbc3& parent, Cpu::Cpu* const cpu, Memory::Bus* const bus, MbcState* const state)
+        : Mbc(parent, cpu, bus, state), clock(parent.clock) {}
+
+    std::unique_ptr<Mbc> Mbc3::Clone(Cpu::Cpu* const cpu, Memory::Bus* const bus, MbcState* const state) const {
+        return std::unique_ptr<Mbc>(new Mbc3(*this, cpu, bus, state));
+    }
+
+    Mbc5::Mbc5(Cpu::Cpu* const cpu, Memory::Bus* const bus, MbcState* const state, std::shared_ptr<const Rom> rom, const uint32_t ram_size)
+        : Mbc(cpu, bus, state, std::move(rom), ram_size) {
+        this->state->rom_bank = 1;
+    }
+
+    void Mbc5::Remap() {
+        this->MapRomBank(0, 0);
+        this->MapRomBank(1, this->state->rom_bank);
+        this->MapRamBank(this->state->ram_bank);
+    }
+
+    void Mbc5::Write(const uint16_t address, const uint8_t value) {
+        if (address < 0x2000) {
+            this->state->ram_enabled = (value & 0x0F) == 0x0A;
+            this->MapRamBank(this->state->ram_bank);
+        } else if (address < 0x3000) {
+            this->state->rom_bank = (this->state->rom_bank & 0x100) | value;
+            this->MapRomBank(1, this->state->rom_bank);
+        } else if (address < 0x4000) {
+            this->state->rom_bank = (this->state->rom_bank & 0xFF) | (value & 0x01) << 8;
+            this->MapRomBank(1, this->state->rom_bank);
+        } else if (address < 0x6000) {
+            this->state->ram_bank = value & 0x0F;
+            this->MapRamBank(this->state->ram_bank);
+        }
+    }
+
+    Mbc5::Mbc5(const Mbc5& parent, Cpu::Cpu* const cpu, Memory::Bus* const bus, MbcState* const state) : Mbc(parent, cpu, bus, state) {}
+
+    std::unique_ptr<Mbc> Mbc5::Clone(Cpu::Cpu* const cpu, Memory::Bus* const bus, MbcState* const state) const {
+        return std::unique_ptr<Mbc>(new Mbc5(*this, cpu, bus, state));
+    }
+}
@@ -0,0 +1,154 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include "rom.hpp"
+#include "save.hpp"
+#include "../memory/bus.hpp"
+
+namespace Cpu {
+    class Cpu;
+}
+
+namespace Cartridge {
+    constexpr uint32_t rom_bank_size = 0x4000;
+    constexpr uint32_t ram_bank_size = 0x2000;
+
+    /**
+     * Registers of a bank controller, trivially copyable so that they live in the arena of an
+     * instance. Each controller uses the fields it has registers for.
+     */
+    struct MbcState {
+        bool ram_enabled;
+        bool advanced_banking;  // MBC1
+        uint16_t rom_bank;      // MBC3, MBC5
+        uint8_t ram_bank;       // MBC3: 0-3 RAM banks, 8-C clock registers; MBC5
+        uint8_t bank_low;       // MBC1: 5 bits, 0 selects 1
+        uint8_t bank_high;      // MBC1: 2 bits
+        uint8_t latch;          // MBC3: last value written to 6000-7FFF
+        uint8_t clock_flags;    // MBC3: halt and day carry
+        uint8_t latched[5];     // MBC3: S, M, H, DL, DH
+        // MBC3: the clock counted base_seconds at base_cycle
+        uint64_t base_seconds;
+        uint64_t base_cycle;
+    };
+
+    /**
+     * A memory bank controller, handling writes to the ROM window and accesses to external RAM
+     * that are not plain memory. Switching a bank only points the pages of its window at
+     * another part of the ROM image or of the RAM: bank data is never copied, and only code
+     * decoded from that window is invalidated.
+     */
+    class Mbc : public Memory::Handler {
+    private:
+        static constexpr uint32_t no_bank = ~0u;
+        // bank currently mapped at 0000-3FFF and 4000-7FFF, or no_bank
+        uint32_t mapped_rom_banks[2];
+        // bank currently mapped at A000-BFFF, or no_bank if the window goes through Read and Write
+        uint32_t mapped_ram_bank;
+        // RAM of cartridges without a battery, or whose save file could not be opened, shared with clones
+        std::shared_ptr<uint8_t[]> volatile_ram;
+        std::shared_ptr<SaveFile> save;
+    protected:
+        Cpu::Cpu* const cpu;
+        Memory::Bus* const bus;
+        MbcState* const state;
+        std::shared_ptr<const Rom> rom;
+        uint32_t rom_banks;
+        uint8_t* ram;
+        uint32_t ram_banks;  // 0 if the cartridge has no RAM
+
+        /// Resets state.
+        Mbc(Cpu::Cpu* const cpu, Memory::Bus* const bus, MbcState* const state, std::shared_ptr<const Rom> rom, const uint32_t ram_size);
+        /// The clone of parent, for the clones of its CPU and bus, sharing its RAM but a save file's, state already holding a copy of parent's.
+        /// See Memory::Bus::Clone.
+        Mbc(const Mbc& parent, Cpu::Cpu* const cpu, Memory::Bus* const bus, MbcState* const state);
+        /// Maps ROM bank (modulo the number of banks) at 0000-3FFF if window is 0, 4000-7FFF if 1.
+        void MapRomBank(const uint8_t window, const uint32_t bank);
+        /// Maps RAM bank (modulo the number of banks) at A000-BFFF, if RAM is enabled.
+        /// Otherwise, or without RAM, the window is unmapped.
+        void MapRamBank(const uint32_t bank);
+        /// Hands the external RAM window over to Read and Write.
+        void UnmapRam();
+        /// Maps the banks the registers select.
+        virtual void Remap() = 0;
+    public:
+        /**
+         * Returns the controller of the header of rom, nullptr for ROM-only cartridges.
+         * Battery-backed RAM is kept in the file at save_path, if not nullptr.
+         */
+        static std::unique_ptr<Mbc> Create(Cpu::Cpu* const cpu, Memory::Bus* const bus, MbcState* const state, std::shared_ptr<const Rom> rom, const char* const save_path);
+        /// Lets the save file be written back, if RAM may have changed. Does not block.
+        void Flush();
+        /// Maps the banks selected by state again, after it was overwritten, e.g. by restoring a snapshot.
+        void Restore();
+        /// Bytes of cartridge RAM, a whole number of banks, 0 without RAM.
+        uint32_t RamSize() const;
+        /// Copies cartridge RAM, as the bus shows it, copies on write included, to RamSize() bytes at destination.
+        void StoreRam(uint8_t* const destination) const;
+        /// Overwrites cartridge RAM with RamSize() bytes from source, through the bus, which must not be blocked or watched.
+        void LoadRam(const uint8_t* const source);
+        /**
+         * Returns a controller in the same state, for the clones of the CPU and the bus.
+         * RAM stays shared, the clone of the bus copying what it writes, but for battery-backed
+         * RAM: this controller keeps writing its save file in place, and the clone gets a copy.
+         */
+        virtual std::unique_ptr<Mbc> Clone(Cpu::Cpu* const cpu, Memory::Bus* const bus, MbcState* const state) const = 0;
+        /// External RAM while it is not mapped: disabled or missing RAM reads as 0xFF.
+        virtual uint8_t Read(const uint16_t address);
+        virtual void Write(const uint16_t address, const uint8_t value) = 0;
+    };
+
+    /// MBC1: up to 2 MiB of ROM and 32 KiB of RAM, the 2-bit register selecting either.
+    class Mbc1 : public Mbc {
+    private:
+        Mbc1(const Mbc1& parent, Cpu::Cpu* const cpu, Memory::Bus* const bus, MbcState* const state);
+    protected:
+        virtual void Remap();
+    public:
+        Mbc1(Cpu::Cpu* const cpu, Memory::Bus* const bus, MbcState* const state, std::shared_ptr<const Rom> rom, const uint32_t ram_size);
+        virtual void Write(const uint16_t address, const uint8_t value);
+        virtual std::unique_ptr<Mbc> Clone(Cpu::Cpu* const cpu, Memory::Bus* const bus, MbcState* const state) const;
+    };
+
+    /**
+     * MBC3: up to 2 MiB of ROM, 32 KiB of RAM and a real-time clock.
+     * The clock does not tick: its time is derived from the CPU cycle counter when it is
+     * latched or written, relative to the last time it was set.
+     */
+    class Mbc3 : public Mbc {
+    private:
+        static constexpr uint64_t cycles_per_second = 1 << 20;  // M-cycles
+        static constexpr uint8_t halt = 0x40;  // DH bits
+        static constexpr uint8_t day_carry = 0x80;
+
+        bool clock;
+
+        /// Seconds counted by the clock at the current cycle, the day counter wrapped at 512.
+        uint64_t Now();
+        /// Restarts the clock from seconds at the current cycle.
+        void SetNow(const uint64_t seconds);
+        /// Maps the selected RAM bank, or hands the window over to the clock registers.
+        void Select();
+
+        Mbc3(const Mbc3& parent, Cpu::Cpu* const cpu, Memory::Bus* const bus, MbcState* const state);
+    protected:
+        virtual void Remap();
+    public:
+        Mbc3(Cpu::Cpu* const cpu, Memory::Bus* const bus, MbcState* const state, std::shared_ptr<const Rom> rom, const uint32_t ram_size, const bool clock);
+        virtual uint8_t Read(const uint16_t address);
+        virtual void Write(const uint16_t address, const uint8_t value);
+        virtual std::unique_ptr<Mbc> Clone(Cpu::Cpu* const cpu, Memory::Bus* const bus, MbcState* const state) const;
+    };
+
+    /// MBC5: up to 8 MiB of ROM in 9-bit banks, bank 0 included, and 128 KiB of RAM.
+    class Mbc5 : public Mbc {
+    private:
+        Mbc5(const Mbc5& parent, Cpu::Cpu* const cpu, Memory::Bus* const bus, MbcState* const state);
+    protected:
+        virtual void Remap();
+    public:
+        Mbc5(Cpu::Cpu* const cpu, Memory::Bus* const bus, MbcState* const state, std::shared_ptr<const Rom> rom, const uint32_t ram_size);
+        virtual void Write(const uint16_t address, const uint8_t value);
+        virtual std::unique_ptr<Mbc> Clone(Cpu::Cpu* const cpu, Memory::Bus* const bus, MbcState* const state) const;
+    };
+}
@@ -0,0 +1,110 @@
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <utility>
+
+#include "rom.hpp"
+
+#if GBEMU_ROM_MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace Cartridge {
+    Rom::Rom(const uint8_t* const data, const size_t size, const bool mapped)
+        : data(data), size(size), mapped(mapped) {}
+
+    Rom::~Rom() {
+#if GBEMU_ROM_MMAP
+        if (this->mapped) {
+            munmap((void*) this->data, this->size);
+            return;
+        }
+#endif
+        delete[] this->data;
+    }
+
+#if GBEMU_ROM_MMAP
+    // images currently open, by file identity, so that opening a file again shares its mapping
+    std::mutex open_roms_mutex;
+    std::map<std::pair<dev_t, ino_t>, std::weak_ptr<const Rom>> open_roms;
+
+    std::shared_ptr<const Rom> Rom::Open(const char* const path) {
+        int file = open(path, O_RDONLY);
+        if (file < 0) {
+            std::perror(path);
+            return nullptr;
+        }
+
+        struct stat status;
+        if (fstat(file, &status) != 0 || status.st_size == 0) {
+            std::fprintf(stderr, "%s: not a ROM image\n", path);
+            close(file);
+            return nullptr;
+        }
+
+        std::lock_guard<std::mutex> lock(open_roms_mutex);
+        std::weak_ptr<const Rom>& open_rom = open_roms[{ status.st_dev, status.st_ino }];
+        if (std::shared_ptr<const Rom> rom = open_rom.lock()) {
+            close(file);
+            return rom;
+        }
+
+        // the mapping stays valid once the file is closed
+        void* data = mmap(nullptr, status.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+        close(file);
+        if (data == MAP_FAILED) {
+            std::perror(path);
+            return nullptr;
+        }
+
+        std::shared_ptr<const Rom> rom(new Rom((const uint8_t*) data, status.st_size, true));
+        open_rom = rom;
+        return rom;
+    }
+#else
+    std::shared_ptr<const Rom> Rom::Open(const char* const path) {
+        std::FILE* file = std::fopen(path, "rb");
+        if (file == nullptr) {
+            std::perror(path);
+            return nullptr;
+        }
+
+        std::fseek(file, 0, SEEK_END);
+        long size = std::ftell(file);
+        std::fseek(file, 0, SEEK_SET);
+        if (size <= 0) {
+            std::fprintf(stderr, "%s: not a ROM image\n", path);
+            std::fclose(file);
+            return nullptr;
+        }
+
+        uint8_t* data = new uint8_t[size];
+        size_t read = std::fread(data, 1, size, file);
+        std::fclose(file);
+        if (read != (size_t) size) {
+            std::fprintf(stderr, "%s: could not be read\n", path);
+            delete[] data;
+            return nullptr;
+        }
+        return std::shared_ptr<const Rom>(new Rom(data, size, false));
+    }
+#endif
+
+    std::shared_ptr<const Rom> Rom::FromBytes(const uint8_t* const bytes, const size_t size) {
+        uint8_t* data = new uint8_t[size];
+        std::memcpy(data, bytes, size);
+        return std::shared_ptr<const Rom>(new Rom(data, size, false));
+    }
+
+    const uint8_t* Rom::Data() const {
+        return this->data;
+    }
+
+    size_t Rom::Size() const {
+        return this->size;
+    }
+}
@@ -0,0 +1,43 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+// ROM images are mapped read-only rather than read, when the platform allows it
+#if defined(__unix__) || defined(__APPLE__)
+#define GBEMU_ROM_MMAP 1
+#else
+#define GBEMU_ROM_MMAP 0
+#endif
+
+namespace Cartridge {
+
+    /**
+     * An immutable ROM image.
+     * Opening a file maps it read-only, without reading or copying it: pages are only
+     * loaded on first access, by the OS. Every instance opening the same file while
+     * it is open shares one mapping, so that running many emulators of the same game
+     * costs the ROM once.
+     */
+    class Rom {
+    private:
+        const uint8_t* data;
+        size_t size;
+        bool mapped;  // data is a file mapping rather than heap memory
+
+        Rom(const uint8_t* const data, const size_t size, const bool mapped);
+    public:
+        ~Rom();
+        Rom(const Rom&) = delete;
+        Rom& operator=(const Rom&) = delete;
+
+        /// Returns the image of the file at path, shared with its other users. nullptr on error.
+        static std::shared_ptr<const Rom> Open(const char* const path);
+        /// Returns an image holding a copy of size bytes, e.g. for test programs.
+        static std::shared_ptr<const Rom> FromBytes(const uint8_t* const bytes, const size_t size);
+
+        const uint8_t* Data() const;
+        size_t Size() const;
+    };
+
+}
@@ -0,0 +1,108 @@
+#include <cstdio>
+#include <cstring>
+
+#include "save.hpp"
+
+#if GBEMU_ROM_MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace Cartridge {
+    SaveFile::SaveFile(uint8_t* const data, const size_t size)
+        : data(data), size(size), dirty(false), last_flush(std::chrono::steady_clock::now()) {}
+
+#if GBEMU_ROM_MMAP
+    SaveFile::~SaveFile() {
+        if (this->dirty)
+            msync(this->data, this->size, MS_ASYNC);
+        // written pages stay in the page cache and reach the file anyway
+        munmap(this->data, this->size);
+    }
+
+    std::unique_ptr<SaveFile> SaveFile::Open(const char* const path, const size_t size) {
+        int file = open(path, O_RDWR | O_CREAT, 0644);
+        if (file < 0) {
+            std::perror(path);
+            return nullptr;
+        }
+
+        // a new or shorter file is extended with zeros, a longer one keeps its extra bytes
+        struct stat status;
+        if (fstat(file, &status) != 0 || ((size_t) status.st_size < size && ftruncate(file, size) != 0)) {
+            std::perror(path);
+            close(file);
+            return nullptr;
+        }
+
+        void* data = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, file, 0);
+        close(file);
+        if (data == MAP_FAILED) {
+            std::perror(path);
+            return nullptr;
+        }
+        return std::unique_ptr<SaveFile>(new SaveFile((uint8_t*) data, size));
+    }
+
+    void SaveFile::Flush() {
+        if (!this->dirty)
+            return;
+
+        const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        if (now - this->last_flush < flush_interval)
+            return;
+
+        // schedules the write back without waiting for it
+        msync(this->data, this->size, MS_ASYNC);
+        this->dirty = false;
+        this->last_flush = now;
+    }
+#else
+    SaveFile::~SaveFile() {
+        this->last_flush = {};
+        this->Flush();
+        delete[] this->data;
+    }
+
+    std::unique_ptr<SaveFile> SaveFile::Open(const char* const path, const size_t size) {
+        uint8_t* data = new uint8_t[size]();
+        if (std::FILE* file = std::fopen(path, "rb")) {
+            std::fread(data, 1, size, file);
+            std::fclose(file);
+        }
+
+        std::unique_ptr<SaveFile> save(new SaveFile(data, size));
+        save->path = path;
+        return save;
+    }
+
+    void SaveFile::Flush() {
+        if (!this->dirty)
+            return;
+
+        const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        if (now - this->last_flush < flush_interval)
+            return;
+
+        // without file mappings, the whole RAM is written
+        if (std::FILE* file = std::fopen(this->path.c_str(), "wb")) {
+            std::fwrite(this->data, 1, this->size, file);
+            std::fclose(file);
+        } else {
+            std::perror(this->path.c_str());
+        }
+        this->dirty = false;
+        this->last_flush = now;
+    }
+#endif
+
+    uint8_t* SaveFile::Data() const {
+        return this->data;
+    }
+
+    void SaveFile::MarkDirty() {
+        this->dirty = true;
+    }
+}
@@ -0,0 +1,46 @@
+#pragma once
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include "rom.hpp"
+
+namespace Cartridge {
+
+    /**
+     * Battery-backed cartridge RAM, kept in a save file.
+     * The file is mapped shared and read-write, so the game writes its save straight into
+     * the page cache: nothing is loaded or stored explicitly, and a crash of the emulator
+     * loses nothing. Writing pages back to disk is only requested, without waiting, and at
+     * most once per flush_interval.
+     */
+    class SaveFile {
+    private:
+        uint8_t* data;
+        size_t size;
+        bool dirty;
+        std::chrono::steady_clock::time_point last_flush;
+#if !GBEMU_ROM_MMAP
+        std::string path;  // where Flush writes the whole RAM back
+#endif
+
+        SaveFile(uint8_t* const data, const size_t size);
+    public:
+        static constexpr std::chrono::milliseconds flush_interval{ 1000 };
+
+        ~SaveFile();
+        SaveFile(const SaveFile&) = delete;
+        SaveFile& operator=(const SaveFile&) = delete;
+
+        /// Returns size bytes of RAM backed by the file at path, created or extended with zeros as needed. nullptr on error.
+        static std::unique_ptr<SaveFile> Open(const char* const path, const size_t size);
+
+        uint8_t* Data() const;
+        /// Notes that RAM may have been written since the last flush.
+        void MarkDirty();
+        /// Requests written RAM to be written back, if flush_interval has elapsed since the last request. Does not block.
+        void Flush();
+    };
+
+}
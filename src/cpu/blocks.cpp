@@ -0,0 +1,154 @@
+#include <algorithm>
+
+#include "blocks.hpp"
+#include "cpu.hpp"
+
+namespace Cpu {
+    size_t BlockCache::ResidentBytes() const {
+        return ZeroedBytes(this->lookup, 0x10000) + ZeroedBytes(this->blocks, max_blocks) + ZeroedBytes(this->entries, max_entries)
+            + ZeroedBytes(this->page_blocks, 0x100) + ZeroedBytes(this->page_generations, 0x100);
+    }
+
+    BlockCache::BlockCache()
+        : lookup(AllocateZeroed<Block*>(0x10000)), blocks(AllocateZeroed<Block>(max_blocks)),
+          entries(AllocateZeroed<BlockEntry>(max_entries)), page_blocks(AllocateZeroed<uint16_t>(0x100)),
+          page_generations(AllocateZeroed<uint32_t>(0x100)) {
+        this->blocks_used = 0;
+        this->entries_used = 0;
+        this->translations = 0;
+        this->executions = 0;
+        this->chained = 0;
+        this->invalidations = 0;
+        this->flushes = 0;
+        this->link_epoch = 0;
+    }
+
+    Block* BlockCache::Find(const uint16_t address) {
+        Block* const block = this->lookup[address];
+        if (block != nullptr && !this->Valid(*block)) {
+            this->Remove(*block);
+            return nullptr;
+        }
+        return block;
+    }
+
+    Block* BlockCache::Translate(Cpu* const cpu, const uint16_t address) {
+        if (this->blocks_used == max_blocks || this->entries_used + max_block_length > max_entries)
+            this->Flush();
+
+        Block& block = this->blocks[this->blocks_used++];
+        block.start = address;
+        block.first_entry = this->entries_used;
+        block.cycles = 0;
+        block.size = 0;
+        block.valid = true;
+        block.successors[0] = nullptr;
+        block.successors[1] = nullptr;
+        block.runs = 0;
+        block.native = nullptr;
+        block.native_body = nullptr;
+        block.links[0] = nullptr;
+        block.links[1] = nullptr;
+        block.link_epoch = this->link_epoch;
+        block.generation = this->page_generations[address >> 8];
+
+        uint16_t pc = address;
+        do {
+            const DecodedInstruction& decoded = cpu->Decode(pc);
+            BlockEntry& entry = this->entries[this->entries_used++];
+            entry.handler = decoded.info->handler;
+            entry.execute = decoded.execute;
+            entry.info = decoded.info;
+            entry.opcode = decoded.opcode;
+            entry.args[0] = decoded.args[0];
+            entry.args[1] = decoded.args[1];
+            entry.length = decoded.length;
+
+            block.cycles += decoded.info->cycles;
+            block.size++;
+            pc += decoded.length;
+
+            if (decoded.info->flags & (Decoding::ControlFlow | Decoding::IoWrite))
+                break;
+        } while (block.size < max_block_length && DecodeCache::Cacheable(pc) && pc > block.start);
+        block.end = pc;
+
+        // a block running past 0xFFFF is accounted up to the last page
+        uint16_t last_page = pc > block.start ? (uint16_t) (pc - 1) >> 8 : 0xFF;
+        for (uint16_t page = block.start >> 8; page <= last_page; page++)
+            this->page_blocks[page]++;
+
+        this->lookup[address] = &block;
+        this->translations++;
+        return &block;
+    }
+
+    void BlockCache::Link(Block& block, const bool branched, const Block& successor) {
+        if (block.link_epoch != this->link_epoch) {
+            block.links[0] = nullptr;
+            block.links[1] = nullptr;
+            block.link_epoch = this->link_epoch;
+        }
+        block.links[branched] = successor.native_body;
+    }
+
+    const BlockEntry* BlockCache::Entries(const Block& block) const {
+        return &this->entries[block.first_entry];
+    }
+
+    void BlockCache::Remove(Block& block) {
+        uint16_t last_page = block.end > block.start ? (uint16_t) (block.end - 1) >> 8 : 0xFF;
+        for (uint16_t page = block.start >> 8; page <= last_page; page++)
+            this->page_blocks[page]--;
+
+        // the slot is only reused after a flush, so blocks chained to this one
+        // can still check whether it is valid
+        block.valid = false;
+        this->lookup[block.start] = nullptr;
+        this->invalidations++;
+        this->link_epoch++;
+    }
+
+    bool BlockCache::Invalidate(const uint16_t address) {
+        // writes to pages without code are the common case
+        if (this->page_blocks[address >> 8] == 0)
+            return false;
+
+        bool found = false;
+        for (uint16_t distance = 0; distance < max_block_span; distance++) {
+            Block* block = this->lookup[(uint16_t) (address - distance)];
+            if (block != nullptr && (uint16_t) (block->end - block->start) > distance) {
+                this->Remove(*block);
+                found = true;
+            }
+        }
+        return found;
+    }
+
+    void BlockCache::InvalidateRange(const uint16_t begin, const uint32_t end) {
+        if (end <= begin)
+            return;
+        uint32_t first = begin < max_block_span ? 0 : begin - max_block_span;
+        for (uint32_t address = first; address < begin; address++) {
+            Block* block = this->lookup[address];
+            if (block != nullptr && address + (uint16_t) (block->end - block->start) > begin)
+                this->Remove(*block);
+        }
+        // stale blocks stay in lookup and page_blocks until Find or Invalidate removes them
+        const uint32_t last_page = (std::min<uint32_t>(end, 0x10000) - 1) >> 8;
+        for (uint32_t page = begin >> 8; page <= last_page; page++)
+            this->page_generations[page]++;
+        this->link_epoch++;
+    }
+
+    void BlockCache::Flush() {
+        for (uint32_t i = 0; i < this->blocks_used; i++)
+            this->lookup[this->blocks[i].start] = nullptr;
+        for (uint16_t page = 0; page < 0x100; page++)
+            this->page_blocks[page] = 0;
+        this->blocks_used = 0;
+        this->entries_used = 0;
+        this->flushes++;
+        this->link_epoch++;
+    }
+}
@@ -0,0 +1,100 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include "decoding.hpp"
+#include "handlers.hpp"
+#include "zeroed.hpp"
+
+namespace Cpu {
+    class Cpu;
+
+    /// An instruction of a block, bound to its handler when the block is translated.
+    struct BlockEntry {
+        Decoding::Handler handler;
+        Handlers::Executor execute;
+        const Decoding::OpcodeInfo* info;
+        uint8_t opcode;
+        uint8_t args[2];
+        uint8_t length;
+    };
+
+    /**
+     * A straight-line run of instructions. A block ends after a control flow
+     * instruction or an I/O write, or when it reaches max_block_length.
+     * Blocks are chained to the blocks executed after them, so that following
+     * a hot path does not require looking them up again.
+     */
+    struct Block {
+        uint16_t start;
+        uint16_t end;            // address following the last instruction
+        uint32_t first_entry;    // index of the first instruction in the entries pool
+        uint32_t cycles;         // base M-cycles of all instructions, branches not taken
+        uint8_t size;
+        bool valid;
+        Block* successors[2];    // next block when the last instruction did not branch / branched
+        uint32_t runs;
+        uint32_t generation;     // of its first page when translated, see BlockCache::InvalidateRange
+        void* native;            // Jit::NativeBlock, once compiled
+        void* native_body;       // compiled code past the registers being loaded, jumped to by linked blocks
+        void* links[2];          // native_body of the compiled successors, see BlockCache::Link
+        uint32_t link_epoch;     // of the cache when linked: links are void once it changes
+    };
+
+    class BlockCache {
+    private:
+        ZeroedArray<Block*> lookup;
+        ZeroedArray<Block> blocks;
+        ZeroedArray<BlockEntry> entries;
+        // number of valid blocks overlapping each 256-byte page
+        ZeroedArray<uint16_t> page_blocks;
+        // bumped for each page when it is remapped: blocks starting there translated before then are stale
+        ZeroedArray<uint32_t> page_generations;
+        uint32_t blocks_used;
+        uint32_t entries_used;
+
+        void Remove(Block& block);
+    public:
+        static constexpr uint8_t max_block_length = 32;
+        static constexpr uint32_t max_blocks = 8192;
+        static constexpr uint32_t max_entries = 65536;
+        // the longest distance between the start of a block and one of its bytes
+        static constexpr uint16_t max_block_span = max_block_length * 3;
+
+        uint64_t translations;
+        uint64_t executions;
+        uint64_t chained;
+        uint64_t invalidations;  // blocks removed, stale blocks of remapped pages once they are looked up
+        uint64_t flushes;
+        /// Bumped whenever a block is removed or becomes stale, voiding every link made before.
+        uint32_t link_epoch;
+
+        BlockCache();
+        /// Returns the valid block starting at address, or nullptr. A stale block found there is removed.
+        Block* Find(const uint16_t address);
+        /// Whether block was neither removed nor translated before its first page was remapped, e.g. when chained to.
+        bool Valid(const Block& block) const {
+            return block.valid && block.generation == this->page_generations[block.start >> 8];
+        }
+        /**
+         * Has the compiled code of block jump straight to the compiled code of successor when
+         * its last instruction branched or not, as told by branched, until a block is removed.
+         * Both blocks must be valid and compiled, successor starting where block left PC.
+         */
+        void Link(Block& block, const bool branched, const Block& successor);
+        /// Translates the code at address into a new block. May flush the cache.
+        Block* Translate(Cpu* const cpu, const uint16_t address);
+        const BlockEntry* Entries(const Block& block) const;
+        /// Invalidates every block containing the byte at address. Returns whether any was found.
+        bool Invalidate(const uint16_t address);
+        /**
+         * Invalidates every block overlapping [begin, end), in O(pages): blocks starting before
+         * the range are removed, those starting in its pages become stale with a new generation.
+         * Other blocks starting in the first and last page do as well.
+         */
+        void InvalidateRange(const uint16_t begin, const uint32_t end);
+        /// Drops all blocks.
+        void Flush();
+        /// Bytes of the cache in memory: pages of blocks and entries never used take none.
+        size_t ResidentBytes() const;
+    };
+}
@@ -0,0 +1,46 @@
+#pragma once
+#include <cstdint>
+
+// 1 makes Accuracy::MCycle the default policy, stepping instructions one M-cycle at a time;
+// 0, the default, keeps Accuracy::InstructionGranular, running whole instructions and blocks
+#ifndef GBEMU_ACCURACY_MCYCLE
+#define GBEMU_ACCURACY_MCYCLE 0
+#endif
+
+namespace Cpu {
+
+    /// Hardware clocked along with the CPU, such as the timer or the PPU.
+    class Peripheral {
+    public:
+        virtual ~Peripheral() = default;
+        /// Advances the peripheral by m_cycles M-cycles.
+        virtual void Tick(const uint32_t m_cycles) = 0;
+    };
+
+    /**
+     * Execution policies, passed as template parameter to Cpu::Cycle and Cpu::RunBlocks.
+     * Both run executors instantiated from the same Handlers templates and account the
+     * same M-cycles, they differ in when peripherals get to see them.
+     */
+    namespace Accuracy {
+        /// Instructions are stepped through one M-cycle at a time: peripherals are ticked up to
+        /// each M-cycle an instruction reads or writes memory on before the access, e.g. the read
+        /// of LD A,(HL) sees them one M-cycle after the instruction starts.
+        struct MCycle {
+            static constexpr bool stepped = true;
+        };
+
+        /// Whole instructions, or whole blocks, run at once: memory is accessed at the M-cycle
+        /// the instruction starts, and peripherals are caught up afterwards. Nothing is done per M-cycle.
+        struct InstructionGranular {
+            static constexpr bool stepped = false;
+        };
+
+#if GBEMU_ACCURACY_MCYCLE
+        using Default = MCycle;
+#else
+        using Default = InstructionGranular;
+#endif
+    }
+
+}
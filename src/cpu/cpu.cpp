@@ -1,44 +1,377 @@
 #include "cpu.hpp"
 
 namespace Cpu {
-    Cpu::Cpu(uint8_t** const memory) : memory(memory) {
-        this->A = 0;
-        this->F = 0;
-        this->B = 0;
-        this->C = 0;
-        this->D = 0;
-        this->E = 0;
-        this->H = 0;
-        this->L = 0;
-        this->S = 0;
-        this->P = 0;
-        this->PC = 0;
+    Cpu::Cpu(Memory::Bus* const bus, State* const state) : state(state), bus(bus) {
+        this->state->AF = 0;
+        this->state->BC = 0;
+        this->state->DE = 0;
+        this->state->HL = 0;
+        this->state->SP = 0;
+        this->state->PC = 0;
+        this->state->block_exit = false;
+        this->state->lazy_flags = { FlagOperation::None, 0, 0, 0, 0, FlagOperation::None };
+        this->state->cycles = 0;
+        this->state->instructions = 0;
+        this->state->peripherals_cycles = 0;
+        this->uncached = {};
+        this->jit_enabled = this->jit.Available();
+        this->peripherals = {};
+        this->peripherals_count = 0;
+        this->catching_up = false;
+        this->steps = 0;
 
         this->parser = std::make_unique<Parser>(this);
+
+        // accessing an observed I/O register brings peripherals up to the current cycle first
+        this->bus->high.catch_up = [](void* const cpu) { static_cast<Cpu*>(cpu)->CatchUp(); };
+        this->bus->high.catch_up_context = this;
     }
 
     bool Cpu::GetFlag(const Flag flag) {
-        return (this->F & (uint8_t) flag) != 0;
+        if (this->state->lazy_flags.operation == FlagOperation::None)
+            return (this->state->F & (uint8_t) flag) != 0;
+        // every recorded operation sets z from its result
+        if (flag == Flag::z)
+            return this->state->lazy_flags.result == 0x00;
+        return (this->ComputeFlags() & (uint8_t) flag) != 0;
     }
 
     void Cpu::SetFlag(const Flag flag, const bool flag_value) {
+        this->MaterializeFlags();
         if (flag_value)
-            this->F |= (uint8_t) flag;
+            this->state->F |= (uint8_t) flag;
         else
-            this->F &= ((uint8_t) flag ^ 0xFF);
+            this->state->F &= ((uint8_t) flag ^ 0xFF);
+    }
+
+    void Cpu::RecordFlags(const FlagOperation operation, const uint8_t operand, const uint8_t source, const uint8_t carry, const uint8_t result) {
+        this->state->lazy_flags.operation = operation;
+        this->state->lazy_flags.operand = operand;
+        this->state->lazy_flags.source = source;
+        this->state->lazy_flags.carry = carry;
+        this->state->lazy_flags.result = result;
+#if !GBEMU_LAZY_FLAGS
+        this->MaterializeFlags();
+#endif
+    }
+
+    void Cpu::RecordIncrement(const FlagOperation operation, const uint8_t result) {
+        LazyFlags& lazy = this->state->lazy_flags;
+        // a run of INC / DEC keeps the carry of the operation before it
+        if (lazy.operation != FlagOperation::Increase && lazy.operation != FlagOperation::Decrease)
+            lazy.carry_operation = lazy.operation;
+        lazy.operation = operation;
+        lazy.result = result;
+#if !GBEMU_LAZY_FLAGS
+        this->MaterializeFlags();
+#endif
+    }
+
+    /// The c flag left by operation, from the operand, source and carry recorded with it, or from F if None.
+    uint8_t Carry(const FlagOperation operation, const LazyFlags& lazy, const uint8_t f) {
+        switch (operation) {
+            case FlagOperation::None:
+                return f & (uint8_t) Flag::c;
+            case FlagOperation::Add:
+                return lazy.operand + lazy.source + lazy.carry > 0xFF ? (uint8_t) Flag::c : 0;
+            case FlagOperation::Subtract:
+                return lazy.operand < lazy.source + lazy.carry ? (uint8_t) Flag::c : 0;
+            default:
+                // AND and OR reset it, INC and DEC are never recorded as carry_operation
+                return 0;
+        }
+    }
+
+    uint8_t Cpu::ComputeFlags() const {
+        const LazyFlags& lazy = this->state->lazy_flags;
+        uint8_t flags = lazy.result == 0x00 ? (uint8_t) Flag::z : 0;
+
+        switch (lazy.operation) {
+            case FlagOperation::None:
+                return this->state->F;
+            case FlagOperation::Add: {
+                uint16_t sum = lazy.operand + lazy.source + lazy.carry;
+                if ((lazy.operand < 0x10) && (sum >= 0x10))
+                    flags |= (uint8_t) Flag::h;
+                flags |= Carry(lazy.operation, lazy, this->state->F);
+                break;
+            }
+            case FlagOperation::Subtract: {
+                int16_t difference = lazy.operand - (lazy.source + lazy.carry);
+                flags |= (uint8_t) Flag::n;
+                if ((lazy.operand > 0x0F) && (difference <= 0x0F))
+                    flags |= (uint8_t) Flag::h;
+                flags |= Carry(lazy.operation, lazy, this->state->F);
+                break;
+            }
+            case FlagOperation::And:
+                flags |= (uint8_t) Flag::h;
+                break;
+            case FlagOperation::Or:
+                break;
+            case FlagOperation::Increase:
+                // half carry is set if 00001111 -> 00010000
+                if (lazy.result == 0x10)
+                    flags |= (uint8_t) Flag::h;
+                flags |= Carry(lazy.carry_operation, lazy, this->state->F);
+                break;
+            case FlagOperation::Decrease:
+                // half carry is set if 00010000 -> 00001111
+                flags |= (uint8_t) Flag::n;
+                if (lazy.result == 0x0F)
+                    flags |= (uint8_t) Flag::h;
+                flags |= Carry(lazy.carry_operation, lazy, this->state->F);
+                break;
+        }
+
+        return (this->state->F & 0x0F) | flags;
+    }
+
+    void Cpu::MaterializeFlags() {
+        if (this->state->lazy_flags.operation == FlagOperation::None)
+            return;
+        this->state->F = this->ComputeFlags();
+        this->state->lazy_flags.operation = FlagOperation::None;
     }
 
-    std::shared_ptr<Operations::Instruction> Cpu::Cycle() {
-        uint8_t opcode = (*this->memory)[this->PC++];
-        uint8_t args_n = Helpers::GetArgsNumber(opcode);
+    void Cpu::Write(const uint16_t address, const uint8_t value) {
+        this->bus->Write(address, value);
+        // ROM is never written: bank controllers invalidate the windows they remap themselves
+        if (address < 0x8000)
+            return;
+        this->decode_cache.Invalidate(address);
+        bool invalidated = this->blocks.Invalidate(address);
+        // code may also have been decoded through the other view of echo RAM
+        if (address >= 0xC000 && address < 0xFE00 && (address < 0xDE00 || address >= 0xE000)) {
+            const uint16_t alias = address < 0xE000 ? address + 0x2000 : address - 0x2000;
+            this->decode_cache.Invalidate(alias);
+            invalidated |= this->blocks.Invalidate(alias);
+        }
+        // I/O registers and IE may raise interrupts or remap memory; HRAM, where the stack usually is, does not
+        if (invalidated || (address >= 0xFF00 && (address < 0xFF80 || address == 0xFFFF)))
+            this->state->block_exit = true;
+    }
+
+    void Cpu::WriteBack(const uint8_t* const byte) {
+        if (byte == &this->instruction.memory_operand)
+            this->Write(this->instruction.memory_address, *byte);
+    }
+
+    void Cpu::InvalidateCode(const uint16_t begin, const uint32_t end) {
+        this->decode_cache.InvalidateRange(begin, end);
+        this->blocks.InvalidateRange(begin, end);
+        // the running block may have been decoded from there
+        this->state->block_exit = true;
+    }
+
+    const DecodedInstruction& Cpu::Decode(const uint16_t address) {
+        if (const DecodedInstruction* decoded = this->decode_cache.Find(address))
+            return *decoded;
+
+        // code running from I/O registers is decoded again every time
+        DecodedInstruction& decoded = DecodeCache::Cacheable(address) ? this->decode_cache.Slot(address) : this->uncached;
+        decoded.opcode = this->bus->Read(address);
+        const Decoding::OpcodeInfo& base_info = Decoding::opcodes[decoded.opcode];
+        decoded.length = base_info.length;
 
-        std::shared_ptr<uint8_t[]> args(new uint8_t[args_n]);
-        for (uint8_t i = 0; i < args_n; i++)
-            args[i] = (*this->memory)[this->PC++];
+        for (uint8_t i = 1; i < base_info.length; i++)
+            decoded.args[i - 1] = this->bus->Read(address + i);
+
+        decoded.info = base_info.prefix ? &Decoding::cb_opcodes[decoded.args[0]] : &base_info;
+        decoded.execute = Handlers::Lookup<Accuracy::InstructionGranular>(*decoded.info);
+        return decoded;
+    }
+
+    void Cpu::Attach(Peripheral* const peripheral) {
+        this->CatchUp();
+        this->peripherals[this->peripherals_count++] = peripheral;
+    }
+
+    void Cpu::Tick(const uint32_t m_cycles) {
+        this->state->cycles += m_cycles;
+        this->CatchUp();
+    }
 
-        std::shared_ptr<Operations::Instruction> instruction = this->parser->Parse(opcode, args);
-        if (instruction != nullptr)
-            instruction->Execute();
-        return instruction;
+    void Cpu::Step() {
+        this->steps++;
+        this->Tick(1);
     }
+
+    void Cpu::CatchUp() {
+        if (this->catching_up)
+            return;
+        this->catching_up = true;
+        while (this->state->peripherals_cycles != this->state->cycles) {
+            const uint32_t elapsed = this->state->cycles - this->state->peripherals_cycles;
+            this->state->peripherals_cycles += elapsed;
+            for (uint8_t i = 0; i < this->peripherals_count; i++)
+                this->peripherals[i]->Tick(elapsed);
+        }
+        this->catching_up = false;
+    }
+
+    template <typename Policy>
+    Operations::Instruction* Cpu::Cycle() {
+        const DecodedInstruction& decoded = this->Decode(this->state->PC);
+        const Decoding::OpcodeInfo& info = *decoded.info;
+        this->instruction.opcode = decoded.opcode;
+        this->instruction.args[0] = decoded.args[0];
+        this->instruction.args[1] = decoded.args[1];
+        this->instruction.info = &info;
+        this->state->PC += decoded.length;
+
+        if constexpr (Policy::stepped) {
+            // the opcode is fetched on M-cycle 0, the arguments on the next ones: the executor
+            // then steps to each M-cycle it accesses memory on, the rest is ticked after it
+            this->steps = 0;
+            for (uint8_t i = 1; i < decoded.length; i++)
+                this->Step();
+            const Handlers::Executor execute = Handlers::Lookup<Policy>(info);
+            const bool implemented = execute != nullptr;
+            const bool branched = implemented && execute(this, decoded.args);
+            const uint8_t total = branched ? info.cycles_branch : info.cycles;
+            this->Tick(total - this->steps);
+            return implemented ? &this->instruction : nullptr;
+        } else {
+#if GBEMU_REFERENCE_OPERATIONS
+            Operations::Operation* operation = this->parser->Parse(this->instruction);
+            const bool implemented = operation != nullptr;
+            if (implemented)
+                this->instruction.Execute();
+            const bool branched = implemented && operation->branch;
+#else
+            const bool implemented = decoded.execute != nullptr;
+            const bool branched = implemented && decoded.execute(this, decoded.args);
+#endif
+            this->state->cycles += branched ? info.cycles_branch : info.cycles;
+            this->CatchUp();
+            return implemented ? &this->instruction : nullptr;
+        }
+    }
+
+    template Operations::Instruction* Cpu::Cycle<Accuracy::MCycle>();
+    template Operations::Instruction* Cpu::Cycle<Accuracy::InstructionGranular>();
+
+    bool Cpu::ExecuteEntry(const BlockEntry& entry) {
+#if !GBEMU_REFERENCE_OPERATIONS
+        if (entry.execute == nullptr)
+            return false;
+        return entry.execute(this, entry.args);
+#else
+        if (entry.handler == nullptr)
+            return false;
+
+        this->instruction.opcode = entry.opcode;
+        this->instruction.args[0] = entry.args[0];
+        this->instruction.args[1] = entry.args[1];
+        this->instruction.info = entry.info;
+        Operations::Operation* operation = (this->parser.get()->*entry.handler)(this->instruction, *entry.info);
+        this->instruction.Execute();
+        return operation->branch;
+#endif
+    }
+
+    bool Cpu::ExecuteBlock(Block*& block, const uint64_t limit) {
+        const BlockEntry* entries = this->blocks.Entries(*block);
+        this->state->block_exit = false;
+        this->blocks.executions++;
+
+        if (this->jit_enabled && block->native == nullptr && ++block->runs == Jit::Compiler::threshold)
+            this->jit.Compile(this, *block);
+
+        if (this->jit_enabled && block->native != nullptr) {
+            // compiled code keeps F in a host register, and advances the cycle counter for branches too
+            this->MaterializeFlags();
+            const Jit::Exit exit = ((Jit::NativeBlock) block->native)(this->state, limit);
+            block = exit.block;
+            return exit.result >> 8;
+        }
+
+        bool branched = false;
+        for (uint8_t executed = 0; executed < block->size;) {
+            const BlockEntry& entry = entries[executed++];
+            this->state->PC += entry.length;
+            // run at the M-cycle the instruction starts, as by Cycle(): I/O registers it
+            // accesses catch peripherals up to there, not to the start of the block
+            branched = this->ExecuteEntry(entry);
+            this->state->cycles += entry.info->cycles;
+            // code was modified or an I/O register written: the block is left
+            if (this->state->block_exit)
+                break;
+        }
+
+        // only the last instruction of a block can branch
+        if (branched) {
+            const Decoding::OpcodeInfo& last = *entries[block->size - 1].info;
+            this->state->cycles += last.cycles_branch - last.cycles;
+        }
+        return branched;
+    }
+
+    uint64_t Cpu::Run(const uint64_t budget) {
+#if GBEMU_THREADED_DISPATCH
+        const uint64_t elapsed = Handlers::RunThreaded(this, budget);
+#else
+        const uint64_t start = this->state->cycles;
+        while (this->state->cycles - start < budget) {
+            this->Cycle<Accuracy::InstructionGranular>();
+            this->state->instructions++;
+        }
+        const uint64_t elapsed = this->state->cycles - start;
+#endif
+        this->CatchUp();
+        return elapsed;
+    }
+
+    template <typename Policy>
+    uint64_t Cpu::RunBlocks(const uint64_t budget) {
+        const uint64_t start = this->state->cycles;
+        Block* previous = nullptr;
+        bool branched = false;
+
+        if constexpr (Policy::stepped) {
+            // blocks run whole instructions, there is nothing in between to tick
+            while (this->state->cycles - start < budget)
+                this->Cycle<Policy>();
+            return this->state->cycles - start;
+        }
+
+        while (this->state->cycles - start < budget) {
+            if (!DecodeCache::Cacheable(this->state->PC)) {
+                // code in I/O registers is never translated
+                this->Cycle<Policy>();
+                previous = nullptr;
+                continue;
+            }
+
+            Block* block = previous != nullptr ? previous->successors[branched] : nullptr;
+            if (block != nullptr && this->blocks.Valid(*block) && block->start == this->state->PC) {
+                this->blocks.chained++;
+            } else {
+                uint64_t flushes = this->blocks.flushes;
+                block = this->blocks.Find(this->state->PC);
+                if (block == nullptr)
+                    block = this->blocks.Translate(this, this->state->PC);
+                // a flush recycles the previous block too
+                if (flushes != this->blocks.flushes)
+                    previous = nullptr;
+                if (previous != nullptr && previous->valid)
+                    previous->successors[branched] = block;
+            }
+            // from now on, compiled code follows the edge itself; not after leaving a block early
+            if (previous != nullptr && previous->native != nullptr && block->native != nullptr
+                && !this->state->block_exit && this->blocks.Valid(*previous))
+                this->blocks.Link(*previous, branched, *block);
+
+            // the last block run, when compiled code went on to others
+            branched = this->ExecuteBlock(block, start + budget);
+            previous = block;
+            this->CatchUp();
+        }
+
+        return this->state->cycles - start;
+    }
+
+    template uint64_t Cpu::RunBlocks<Accuracy::MCycle>(const uint64_t budget);
+    template uint64_t Cpu::RunBlocks<Accuracy::InstructionGranular>(const uint64_t budget);
 }
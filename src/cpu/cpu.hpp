@@ -1,33 +1,96 @@
 #pragma once
+#include <array>
 #include <cstdint>
 #include <memory>
 #include "parser.hpp"
 #include "helpers.hpp"
 #include "operations.hpp"
+#include "decoding.hpp"
+#include "decode_cache.hpp"
+#include "blocks.hpp"
+#include "clock.hpp"
+#include "state.hpp"
+#include "jit/jit.hpp"
+#include "../memory/bus.hpp"
 
 namespace Cpu {
-    enum class Flag : uint8_t {
-        z = 0x80,
-        n = 0x40,
-        h = 0x20,
-        c = 0x10
-    };
-
     class Cpu {
     public:
         // temporarily public for testing purposes
-        uint8_t A, F;
-        uint8_t B, C;
-        uint8_t D, E;
-        uint8_t H, L;
-        uint8_t S, P;
-        uint16_t PC;
-        uint8_t** const memory;
+        /// Registers and counters, in the arena of the instance.
+        State* const state;
+        Memory::Bus* const bus;
         std::unique_ptr<Parser> parser;
+        /// Preallocated storage reused by every call to Cycle().
+        Operations::Instruction instruction;
+        DecodeCache decode_cache;
+        DecodedInstruction uncached;
+        BlockCache blocks;
+        Jit::Compiler jit;
+        /// Compile hot blocks to native code, when supported.
+        bool jit_enabled;
+        static constexpr uint8_t max_peripherals = 4;
+        std::array<Peripheral*, max_peripherals> peripherals;
+        uint8_t peripherals_count;
+        /// Set while CatchUp ticks peripherals, which may call it again, e.g. through the bus.
+        bool catching_up;
+        /// M-cycles of the instruction run by Cycle<Accuracy::MCycle> elapsed so far, see Step.
+        uint8_t steps;
 
-        Cpu(uint8_t** const memory);
+        /// Powers on with the registers and counters at state, which are reset.
+        Cpu(Memory::Bus* const bus, State* const state);
         bool GetFlag(const Flag flag);
         void SetFlag(const Flag flag, const bool flag_value);
-        std::shared_ptr<Operations::Instruction> Cycle();
+        /// Records an ALU operation whose z, n, h and c flags are to be set.
+        void RecordFlags(const FlagOperation operation, const uint8_t operand, const uint8_t source, const uint8_t carry, const uint8_t result);
+        /// Records an INC or DEC, which sets z, n and h from result and keeps c, without evaluating it.
+        void RecordIncrement(const FlagOperation operation, const uint8_t result);
+        /// Flags resulting from the recorded operation, the lower nibble of F preserved.
+        uint8_t ComputeFlags() const;
+        /// Brings F up to date. Must be called before accessing F directly.
+        void MaterializeFlags();
+        /// Writes a byte to the bus, keeping decoded code coherent.
+        void Write(const uint16_t address, const uint8_t value);
+        /// Must be called after writing through an operand of the current instruction:
+        /// if it is the instruction's memory operand, it is written to the bus.
+        void WriteBack(const uint8_t* const byte);
+        /// Returns the decoded instruction at address, decoding it on a cache miss.
+        const DecodedInstruction& Decode(const uint16_t address);
+        /// Drops decoded and translated code for [begin, end), e.g. when a bank is switched. Leaves the running block.
+        void InvalidateCode(const uint16_t begin, const uint32_t end);
+        /// Executes one instruction of a block, PC already pointing past it. Returns whether it branched.
+        bool ExecuteEntry(const BlockEntry& entry);
+        /**
+         * Runs a translated block. If it is compiled, it goes on to the compiled blocks linked
+         * after it while the cycle counter is below limit, block then being the last one run.
+         * Returns whether the last instruction of block branched.
+         */
+        bool ExecuteBlock(Block*& block, const uint64_t limit);
+        /// Clocks peripheral along with the CPU, from the current M-cycle on.
+        void Attach(Peripheral* const peripheral);
+        /// Advances the cycle counter by m_cycles and ticks peripherals as much.
+        void Tick(const uint32_t m_cycles);
+        /// Ticks peripherals through the current M-cycle of the instruction being stepped, up to the next one.
+        void Step();
+        /**
+         * Ticks peripherals up to the cycle counter, including the cycles they add to it while
+         * ticked, e.g. HBlank DMA stalling the CPU. Returns at once when called from a peripheral's
+         * Tick: the outer call ticks them again until they are caught up.
+         */
+        void CatchUp();
+        /**
+         * The interpreter main loop: runs instructions until at least budget M-cycles have elapsed,
+         * through Handlers::RunThreaded when GBEMU_THREADED_DISPATCH is set, a loop around Cycle()
+         * otherwise. Peripherals are only caught up at the end. Returns the elapsed M-cycles.
+         */
+        uint64_t Run(const uint64_t budget);
+        /// Runs until at least budget M-cycles have elapsed. Returns the elapsed M-cycles.
+        /// Only the instruction-granular tier runs whole blocks, the M-cycle tier steps instructions.
+        /// Peripherals are caught up after each block, or chain of linked compiled blocks.
+        template <typename Policy = Accuracy::Default>
+        uint64_t RunBlocks(const uint64_t budget);
+        /// Fetches, decodes and executes one instruction. Does not allocate.
+        template <typename Policy = Accuracy::Default>
+        Operations::Instruction* Cycle();
     };
 }
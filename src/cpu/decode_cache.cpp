@@ -0,0 +1,73 @@
+#include <algorithm>
+
+#include "decode_cache.hpp"
+
+namespace Cpu {
+    DecodeCache::DecodeCache()
+        : entries(AllocateZeroed<DecodedInstruction>(0x10000)), page_generations(AllocateZeroed<uint32_t>(0x100)) {
+        this->hits = 0;
+        this->misses = 0;
+        this->invalidations = 0;
+        this->code_pages = {};
+    }
+
+    size_t DecodeCache::ResidentBytes() const {
+        return ZeroedBytes(this->entries, 0x10000) + ZeroedBytes(this->page_generations, 0x100);
+    }
+
+    const DecodedInstruction* DecodeCache::Find(const uint16_t address) {
+        const DecodedInstruction* entry = &this->entries[address];
+        if (entry->info != nullptr && entry->generation == this->page_generations[address >> 8]) {
+            this->hits++;
+            return entry;
+        }
+
+        this->misses++;
+        return nullptr;
+    }
+
+    DecodedInstruction& DecodeCache::Slot(const uint16_t address) {
+        DecodedInstruction& entry = this->entries[address];
+        entry.generation = this->page_generations[address >> 8];
+        // an instruction spans at most the next page, echo RAM shows C000-DDFF at E000-FDFF too
+        for (const uint16_t byte : { address, (uint16_t) (address + 2) }) {
+            this->code_pages[byte >> 8] = 1;
+            if (byte >= 0xC000 && byte < 0xFE00 && (byte < 0xDE00 || byte >= 0xE000))
+                this->code_pages[(byte < 0xE000 ? byte + 0x2000 : byte - 0x2000) >> 8] = 1;
+        }
+        return entry;
+    }
+
+    void DecodeCache::Invalidate(const uint16_t address) {
+        // instructions are at most 3 bytes long, so only entries starting
+        // at one of the two previous addresses can span the written byte
+        for (uint8_t distance = 0; distance < 3; distance++) {
+            DecodedInstruction& entry = this->entries[(uint16_t) (address - distance)];
+            if (entry.info != nullptr && entry.length > distance) {
+                entry.info = nullptr;
+                this->invalidations++;
+            }
+        }
+    }
+
+    void DecodeCache::InvalidateRange(const uint16_t begin, const uint32_t end) {
+        if (end <= begin)
+            return;
+        // entries starting right before the range may still overlap it
+        uint32_t first = begin < 2 ? 0 : begin - 2;
+        for (uint32_t address = first; address < begin; address++) {
+            DecodedInstruction& entry = this->entries[address];
+            if (entry.info != nullptr && address + entry.length > begin) {
+                entry.info = nullptr;
+                this->invalidations++;
+            }
+        }
+        const uint32_t last_page = (std::min<uint32_t>(end, 0x10000) - 1) >> 8;
+        for (uint32_t page = begin >> 8; page <= last_page; page++)
+            this->page_generations[page]++;
+    }
+
+    bool DecodeCache::Cacheable(const uint16_t address) {
+        return address < 0xFF00 || address >= 0xFF80;
+    }
+}
@@ -0,0 +1,62 @@
+#pragma once
+#include <array>
+#include <cstdint>
+#include <memory>
+#include "handlers.hpp"
+#include "zeroed.hpp"
+
+namespace Cpu {
+    namespace Decoding {
+        struct OpcodeInfo;
+    }
+
+    /// An instruction as fetched from memory, with its decoding table entry resolved.
+    struct DecodedInstruction {
+        const Decoding::OpcodeInfo* info;  // nullptr if the entry is not valid
+        Handlers::Executor execute;
+        uint8_t opcode;
+        uint8_t args[2];
+        uint8_t length;
+        uint32_t generation;  // of its page when decoded, see DecodeCache::InvalidateRange
+    };
+
+    /**
+     * Pre-decoded instructions, indexed by address.
+     * An entry stays valid until one of the bytes it was decoded from is written,
+     * or until the region it belongs to is remapped (e.g. on ROM bank switch).
+     */
+    class DecodeCache {
+    private:
+        ZeroedArray<DecodedInstruction> entries;
+        /// Bumped for each 256-byte page when it is remapped: entries decoded before then are stale.
+        ZeroedArray<uint32_t> page_generations;
+    public:
+        uint64_t hits;
+        uint64_t misses;
+        uint64_t invalidations;  // entries dropped one by one, not those of remapped pages
+        /**
+         * Nonzero for each 256-byte page code was ever decoded from, directly or through
+         * the other view of echo RAM. Never reset: compiled stores to these pages go through
+         * Cpu::Write, which keeps code coherent, see Jit::Compiler.
+         */
+        std::array<uint8_t, 0x100> code_pages;
+
+        DecodeCache();
+        /// Returns the valid entry at address, or nullptr. Updates hit/miss counters.
+        const DecodedInstruction* Find(const uint16_t address);
+        /// Returns the entry at address so that it can be filled after a miss.
+        DecodedInstruction& Slot(const uint16_t address);
+        /// Invalidates every entry decoded from the byte at address.
+        void Invalidate(const uint16_t address);
+        /**
+         * Invalidates every entry decoded from bytes in [begin, end), in O(pages): the pages
+         * it covers get a new generation, and only entries straddling begin are dropped.
+         * Entries elsewhere in the first and last page are dropped as well.
+         */
+        void InvalidateRange(const uint16_t begin, const uint32_t end);
+        /// Whether code at address may be cached at all (I/O registers may not).
+        static bool Cacheable(const uint16_t address);
+        /// Bytes of the cache in memory: pages of entries never decoded take none.
+        size_t ResidentBytes() const;
+    };
+}
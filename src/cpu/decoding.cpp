@@ -0,0 +1,74 @@
+#include "decoding.hpp"
+#include <cstdio>
+
+namespace Cpu::Decoding {
+    const char* operand_names[] = {
+        "B", "C", "D", "E", "H", "L", "(HL)", "A",
+        "BC", "DE", "HL", "SP", "AF",
+        "(BC)", "(DE)", "(HL+)", "(HL-)"
+    };
+
+    const char* condition_names[] = { "NZ", "Z", "NC", "C" };
+
+    std::string FormatOperand(const Operand operand, const uint8_t* const args) {
+        char buffer[16];
+        switch (operand) {
+            case Operand::Immediate8:
+                snprintf(buffer, sizeof(buffer), "$%02X", args[0]);
+                return buffer;
+            case Operand::Immediate16:
+                snprintf(buffer, sizeof(buffer), "$%02X%02X", args[1], args[0]);
+                return buffer;
+            case Operand::SignedImmediate8:
+                snprintf(buffer, sizeof(buffer), "%d", static_cast<int8_t>(args[0]));
+                return buffer;
+            case Operand::StackOffset8:
+                snprintf(buffer, sizeof(buffer), "SP%+d", static_cast<int8_t>(args[0]));
+                return buffer;
+            case Operand::Indirect16:
+                snprintf(buffer, sizeof(buffer), "($%02X%02X)", args[1], args[0]);
+                return buffer;
+            case Operand::HighIndirect8:
+                snprintf(buffer, sizeof(buffer), "($FF%02X)", args[0]);
+                return buffer;
+            case Operand::HighIndirectC:
+                return "($FF00+C)";
+            case Operand::NotZero:
+            case Operand::Zero:
+            case Operand::NotCarry:
+            case Operand::Carry:
+                return condition_names[(uint8_t) operand - (uint8_t) Operand::NotZero];
+            case Operand::None:
+                return "";
+            default:
+                return operand_names[(uint8_t) operand];
+        }
+    }
+
+    std::string Disassemble(const uint8_t opcode, const uint8_t* const args) {
+        const OpcodeInfo& info = Lookup(opcode, args);
+        std::string text = info.mnemonic;
+
+        // bit operations and restarts carry their index as the first operand
+        std::string index;
+        if (opcodes[opcode].prefix) {
+            if (args[0] >= 0x40)
+                index = std::to_string(info.index);
+        } else if (opcode >= 0xC0 && (opcode & 0x07) == 0x07) {
+            char buffer[8];
+            snprintf(buffer, sizeof(buffer), "$%02X", info.index);
+            index = buffer;
+        }
+
+        std::string operands[3] = { index, FormatOperand(info.dst, args), FormatOperand(info.src, args) };
+        bool first = true;
+        for (const std::string& operand : operands) {
+            if (operand.empty())
+                continue;
+            text += first ? " " : ",";
+            text += operand;
+            first = false;
+        }
+        return text;
+    }
+}
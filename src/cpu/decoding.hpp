@@ -0,0 +1,305 @@
+#pragma once
+#include <array>
+#include <cstdint>
+#include <string>
+#include "parser.hpp"
+
+namespace Cpu::Decoding {
+    /**
+     * Operand selectors. The first eight follow the r[] encoding used by the
+     * opcode bits (B, C, D, E, H, L, (HL), A), so they can be indexed directly.
+     */
+    enum class Operand : uint8_t {
+        B, C, D, E, H, L, IndirectHL, A,
+        BC, DE, HL, SP, AF,
+        IndirectBC, IndirectDE, IndirectHLIncrement, IndirectHLDecrement,
+        Immediate8, Immediate16, SignedImmediate8, StackOffset8,
+        Indirect16, HighIndirect8, HighIndirectC,
+        NotZero, Zero, NotCarry, Carry,
+        None
+    };
+
+    using Handler = Operations::Operation* (Parser::*)(Operations::Instruction& instruction, const OpcodeInfo& info);
+
+    /// Properties that matter to code translation, see OpcodeInfo::flags.
+    enum OpcodeFlags : uint8_t {
+        ControlFlow = 0x01,  // may change PC other than by advancing it, or affects interrupts
+        IoWrite = 0x02,      // always writes to an I/O register
+        MemoryWrite = 0x04   // may write to memory
+    };
+
+    /// Everything needed to execute or display an opcode, known at compile time.
+    struct OpcodeInfo {
+        Handler handler;        // nullptr if the opcode is not implemented
+        const char* mnemonic;
+        Operand dst;
+        Operand src;
+        uint8_t index;          // ALU operation, rotation direction, bit number or restart vector
+        uint8_t length;         // in bytes, opcode (and prefix) included
+        uint8_t cycles;         // M-cycles, when a conditional branch is not taken
+        uint8_t cycles_branch;  // M-cycles, when a conditional branch is taken
+        uint8_t extra_steps;    // steps before the operation does any work, see Operations::Instruction
+        uint8_t flags;          // OpcodeFlags
+        bool prefix;            // 0xCB: the argument selects an entry of cb_opcodes
+    };
+
+    constexpr OpcodeInfo Entry(const char* mnemonic, const uint8_t length, const uint8_t cycles,
+                               const Operand dst = Operand::None, const Operand src = Operand::None,
+                               const Handler handler = nullptr, const uint8_t extra_steps = 0) {
+        return OpcodeInfo { handler, mnemonic, dst, src, 0, length, cycles, cycles, extra_steps, 0, false };
+    }
+
+    constexpr Operand registers[8] = {
+        Operand::B, Operand::C, Operand::D, Operand::E, Operand::H, Operand::L, Operand::IndirectHL, Operand::A
+    };
+    constexpr Operand pairs[4] = { Operand::BC, Operand::DE, Operand::HL, Operand::SP };
+    constexpr Operand stack_pairs[4] = { Operand::BC, Operand::DE, Operand::HL, Operand::AF };
+    constexpr Operand dereferences[4] = {
+        Operand::IndirectBC, Operand::IndirectDE, Operand::IndirectHLIncrement, Operand::IndirectHLDecrement
+    };
+    constexpr Operand conditions[4] = { Operand::NotZero, Operand::Zero, Operand::NotCarry, Operand::Carry };
+    constexpr const char* alu_mnemonics[8] = { "ADD", "ADC", "SUB", "SBC", "AND", "XOR", "OR", "CP" };
+    constexpr const char* accumulator_mnemonics[8] = { "RLCA", "RRCA", "RLA", "RRA", "DAA", "CPL", "SCF", "CCF" };
+    constexpr const char* shift_mnemonics[8] = { "RLC", "RRC", "RL", "RR", "SLA", "SRA", "SWAP", "SRL" };
+
+    /**
+     * Decodes a base page opcode, splitting it as xxyyyzzz (yyy = ppq).
+     * Timings as listed in https://izik1.github.io/gbops/
+     */
+    constexpr OpcodeInfo Decode(const uint8_t opcode) {
+        const uint8_t x = opcode >> 6;
+        const uint8_t y = (opcode >> 3) & 0x07;
+        const uint8_t z = opcode & 0x07;
+        const uint8_t p = y >> 1;
+        const uint8_t q = y & 0x01;
+
+        if (x == 0) {
+            switch (z) {
+                case 0:
+                    switch (y) {
+                        case 0: return Entry("NOP", 1, 1);
+                        case 1: return Entry("LD", 3, 5, Operand::Indirect16, Operand::SP, &Parser::BuildStoreDoubleByte, 4);
+                        case 2: return Entry("STOP", 2, 1);
+                        case 3: return Entry("JR", 2, 3, Operand::None, Operand::SignedImmediate8, &Parser::BuildJumpRelative, 2);
+                        default: {
+                            OpcodeInfo info = Entry("JR", 2, 2, conditions[y - 4], Operand::SignedImmediate8, &Parser::BuildJumpRelativeConditional, 1);
+                            info.cycles_branch = 3;
+                            return info;
+                        }
+                    }
+                case 1:
+                    if (q == 0)
+                        return Entry("LD", 3, 3, pairs[p], Operand::Immediate16, &Parser::BuildLoadDoubleByte, 2);
+                    return Entry("ADD", 1, 2, Operand::HL, pairs[p], &Parser::BuildAddDoubleByte, 1);
+                case 2:
+                    if (q == 0)
+                        return Entry("LD", 1, 2, dereferences[p], Operand::A, &Parser::BuildLoadByte, 1);
+                    return Entry("LD", 1, 2, Operand::A, dereferences[p], &Parser::BuildLoadByte, 1);
+                case 3:
+                    if (q == 0)
+                        return Entry("INC", 1, 2, pairs[p], Operand::None, &Parser::BuildIncreaseDoubleByte, 1);
+                    return Entry("DEC", 1, 2, pairs[p], Operand::None, &Parser::BuildDecreaseDoubleByte, 1);
+                case 4:
+                    return Entry("INC", 1, y == 6 ? 3 : 1, registers[y], Operand::None, &Parser::BuildIncreaseByte, y == 6 ? 2 : 0);
+                case 5:
+                    return Entry("DEC", 1, y == 6 ? 3 : 1, registers[y], Operand::None, &Parser::BuildDecreaseByte, y == 6 ? 2 : 0);
+                case 6:
+                    return Entry("LD", 2, y == 6 ? 3 : 2, registers[y], Operand::Immediate8, &Parser::BuildLoadByte, y == 6);
+                default: {
+                    OpcodeInfo info = Entry(accumulator_mnemonics[y], 1, 1);
+                    if (y < 2) {
+                        // RLCA / RRCA
+                        info.handler = &Parser::BuildRotateAccumulator;
+                        info.dst = Operand::A;
+                        info.index = y;
+                    }
+                    return info;
+                }
+            }
+        }
+
+        if (x == 1) {
+            if (opcode == 0x76)
+                return Entry("HALT", 1, 1);
+            const bool memory = (y == 6) || (z == 6);
+            return Entry("LD", 1, memory ? 2 : 1, registers[y], registers[z], &Parser::BuildLoadByte, memory);
+        }
+
+        if (x == 2) {
+            OpcodeInfo info = Entry(alu_mnemonics[y], 1, z == 6 ? 2 : 1, Operand::A, registers[z], &Parser::BuildAlu, z == 6);
+            info.index = y;
+            return info;
+        }
+
+        switch (z) {
+            case 0:
+                switch (y) {
+                    case 4: return Entry("LDH", 2, 3, Operand::HighIndirect8, Operand::A);
+                    case 5: return Entry("ADD", 2, 4, Operand::SP, Operand::SignedImmediate8);
+                    case 6: return Entry("LDH", 2, 3, Operand::A, Operand::HighIndirect8);
+                    case 7: return Entry("LD", 2, 3, Operand::HL, Operand::StackOffset8);
+                    default: {
+                        OpcodeInfo info = Entry("RET", 1, 2, conditions[y]);
+                        info.cycles_branch = 5;
+                        return info;
+                    }
+                }
+            case 1:
+                if (q == 0)
+                    return Entry("POP", 1, 3, stack_pairs[p], Operand::None, &Parser::BuildPopDoubleByte, 2);
+                switch (p) {
+                    case 0: return Entry("RET", 1, 4);
+                    case 1: return Entry("RETI", 1, 4);
+                    case 2: return Entry("JP", 1, 1, Operand::HL);
+                    default: return Entry("LD", 1, 2, Operand::SP, Operand::HL);
+                }
+            case 2:
+                switch (y) {
+                    case 4: return Entry("LD", 1, 2, Operand::HighIndirectC, Operand::A);
+                    case 5: return Entry("LD", 3, 4, Operand::Indirect16, Operand::A);
+                    case 6: return Entry("LD", 1, 2, Operand::A, Operand::HighIndirectC);
+                    case 7: return Entry("LD", 3, 4, Operand::A, Operand::Indirect16);
+                    default: {
+                        OpcodeInfo info = Entry("JP", 3, 3, conditions[y], Operand::Immediate16);
+                        info.cycles_branch = 4;
+                        return info;
+                    }
+                }
+            case 3:
+                switch (y) {
+                    case 0: return Entry("JP", 3, 4, Operand::Immediate16);
+                    case 1: {
+                        OpcodeInfo info = Entry("PREFIX", 2, 0);
+                        info.prefix = true;
+                        return info;
+                    }
+                    case 6: return Entry("DI", 1, 1);
+                    case 7: return Entry("EI", 1, 1);
+                    default: return Entry("ILLEGAL", 1, 1);
+                }
+            case 4:
+                if (y < 4) {
+                    OpcodeInfo info = Entry("CALL", 3, 3, conditions[y], Operand::Immediate16);
+                    info.cycles_branch = 6;
+                    return info;
+                }
+                return Entry("ILLEGAL", 1, 1);
+            case 5:
+                if (q == 0)
+                    return Entry("PUSH", 1, 4, stack_pairs[p], Operand::None, &Parser::BuildPushDoubleByte, 3);
+                if (p == 0)
+                    return Entry("CALL", 3, 6, Operand::Immediate16);
+                return Entry("ILLEGAL", 1, 1);
+            case 6: {
+                OpcodeInfo info = Entry(alu_mnemonics[y], 2, 2, Operand::A, Operand::Immediate8, &Parser::BuildAlu, 1);
+                info.index = y;
+                return info;
+            }
+            default: {
+                OpcodeInfo info = Entry("RST", 1, 4);
+                info.index = y * 8;
+                return info;
+            }
+        }
+    }
+
+    /// Decodes a 0xCB-prefixed opcode. Lengths include the prefix byte.
+    constexpr OpcodeInfo DecodePrefixed(const uint8_t opcode) {
+        const uint8_t x = opcode >> 6;
+        const uint8_t y = (opcode >> 3) & 0x07;
+        const uint8_t z = opcode & 0x07;
+        const bool memory = z == 6;
+
+        OpcodeInfo info = Entry(shift_mnemonics[y], 2, memory ? 4 : 2, registers[z]);
+        switch (x) {
+            case 0:
+                break;
+            case 1:
+                info.mnemonic = "BIT";
+                info.cycles = info.cycles_branch = memory ? 3 : 2;
+                break;
+            case 2:
+                info.mnemonic = "RES";
+                break;
+            default:
+                info.mnemonic = "SET";
+                break;
+        }
+        if (x > 0)
+            info.index = y;
+        return info;
+    }
+
+    constexpr bool IsMemoryOperand(const Operand operand) {
+        return operand == Operand::IndirectHL
+            || (operand >= Operand::IndirectBC && operand <= Operand::IndirectHLDecrement)
+            || (operand >= Operand::Indirect16 && operand <= Operand::HighIndirectC);
+    }
+
+    /// Computes OpcodeInfo::flags for a base page opcode.
+    constexpr uint8_t Classify(const uint8_t opcode, const OpcodeInfo& info) {
+        const uint8_t x = opcode >> 6;
+        const uint8_t y = (opcode >> 3) & 0x07;
+        const uint8_t z = opcode & 0x07;
+        const uint8_t q = y & 0x01;
+        uint8_t flags = 0;
+
+        if ((x == 0 && z == 0 && y >= 2) || opcode == 0x76)
+            flags |= ControlFlow;
+        if (x == 3) {
+            // everything but LDH, ADD SP, LD HL/SP, POP, the 0xCB prefix, loads and ALU operations
+            bool control_flow = (z == 0 && y < 4) || (z == 1 && q == 1 && y < 6) || (z == 2 && y < 4)
+                || (z == 3 && y != 1) || z == 4 || (z == 5 && q == 1) || z == 7;
+            if (control_flow)
+                flags |= ControlFlow;
+            // PUSH, CALL and RST write to the stack
+            if ((z == 5 && q == 0) || (z == 5 && y == 1) || (z == 4 && y < 4) || z == 7)
+                flags |= MemoryWrite;
+        }
+        if (info.dst == Operand::HighIndirect8 || info.dst == Operand::HighIndirectC)
+            flags |= IoWrite;
+        if (IsMemoryOperand(info.dst))
+            flags |= MemoryWrite;
+        return flags;
+    }
+
+    constexpr std::array<OpcodeInfo, 256> GenerateOpcodes() {
+        std::array<OpcodeInfo, 256> table {};
+        for (uint16_t opcode = 0; opcode < 256; opcode++) {
+            table[opcode] = Decode(static_cast<uint8_t>(opcode));
+            table[opcode].flags = Classify(static_cast<uint8_t>(opcode), table[opcode]);
+        }
+        return table;
+    }
+
+    constexpr std::array<OpcodeInfo, 256> GeneratePrefixedOpcodes() {
+        std::array<OpcodeInfo, 256> table {};
+        for (uint16_t opcode = 0; opcode < 256; opcode++) {
+            table[opcode] = DecodePrefixed(static_cast<uint8_t>(opcode));
+            // everything but BIT writes back to its operand
+            if (table[opcode].dst == Operand::IndirectHL && (opcode >> 6) != 1)
+                table[opcode].flags = MemoryWrite;
+        }
+        return table;
+    }
+
+    /// Base page, indexed by opcode.
+    inline constexpr std::array<OpcodeInfo, 256> opcodes = GenerateOpcodes();
+    /// 0xCB-prefixed page, indexed by the byte following the prefix.
+    inline constexpr std::array<OpcodeInfo, 256> cb_opcodes = GeneratePrefixedOpcodes();
+
+    static_assert(opcodes[0x01].length == 3 && opcodes[0x36].cycles == 3 && opcodes[0xCB].prefix);
+    static_assert(opcodes[0x20].cycles == 2 && opcodes[0x20].cycles_branch == 3);
+    static_assert(cb_opcodes[0x46].cycles == 3 && cb_opcodes[0x86].cycles == 4);
+    static_assert(opcodes[0x18].flags == ControlFlow && opcodes[0xC5].flags == MemoryWrite && opcodes[0xE0].flags == (IoWrite | MemoryWrite));
+    static_assert(opcodes[0xCD].flags == (ControlFlow | MemoryWrite) && opcodes[0xCB].flags == 0 && opcodes[0x77].flags == MemoryWrite);
+
+    /// Returns the entry for an instruction, following the 0xCB prefix if needed.
+    inline const OpcodeInfo& Lookup(const uint8_t opcode, const uint8_t* const args) {
+        const OpcodeInfo& info = opcodes[opcode];
+        return info.prefix ? cb_opcodes[args[0]] : info;
+    }
+
+    /// Returns the instruction as assembly text, e.g. "LD A,(HL+)" or "JR NZ,-2".
+    std::string Disassemble(const uint8_t opcode, const uint8_t* const args);
+}
@@ -0,0 +1,387 @@
+#include "handlers.hpp"
+#include <utility>
+#include "cpu.hpp"
+#include "decoding.hpp"
+
+namespace Cpu::Handlers {
+    using Decoding::Operand;
+    using OpcodeTable = std::array<Decoding::OpcodeInfo, 256>;
+
+    constexpr bool IsMemory(const Operand operand) {
+        return operand == Operand::IndirectHL || (operand >= Operand::IndirectBC && operand <= Operand::IndirectHLDecrement);
+    }
+
+    /// The register an 8-bit register operand refers to.
+    template <Operand operand>
+    uint8_t& Byte(Cpu* const cpu) {
+        if constexpr (operand == Operand::B) return cpu->state->B;
+        else if constexpr (operand == Operand::C) return cpu->state->C;
+        else if constexpr (operand == Operand::D) return cpu->state->D;
+        else if constexpr (operand == Operand::E) return cpu->state->E;
+        else if constexpr (operand == Operand::H) return cpu->state->H;
+        else if constexpr (operand == Operand::L) return cpu->state->L;
+        else {
+            static_assert(operand == Operand::A, "not an 8-bit register operand");
+            return cpu->state->A;
+        }
+    }
+
+    /// The address a memory operand refers to. HL+ and HL- are updated here.
+    template <Operand operand>
+    uint16_t Address(Cpu* const cpu) {
+        if constexpr (operand == Operand::IndirectHL) return cpu->state->HL;
+        else if constexpr (operand == Operand::IndirectBC) return cpu->state->BC;
+        else if constexpr (operand == Operand::IndirectDE) return cpu->state->DE;
+        else if constexpr (operand == Operand::IndirectHLIncrement) return cpu->state->HL++;
+        else {
+            static_assert(operand == Operand::IndirectHLDecrement, "not a memory operand");
+            return cpu->state->HL--;
+        }
+    }
+
+    /**
+     * Moves on to the next M-cycle of the instruction, to access memory or work internally on it:
+     * Accuracy::MCycle ticks peripherals up to there, see Cpu::Step. Nothing is done otherwise.
+     */
+    template <typename Policy>
+    void Step(Cpu* const cpu) {
+        if constexpr (Policy::stepped)
+            cpu->Step();
+    }
+
+    /// Reads memory on the next M-cycle of the instruction.
+    template <typename Policy>
+    uint8_t Load(Cpu* const cpu, const uint16_t address) {
+        Step<Policy>(cpu);
+        return cpu->bus->Read(address);
+    }
+
+    /// Writes memory on the next M-cycle of the instruction.
+    template <typename Policy>
+    void Store(Cpu* const cpu, const uint16_t address, const uint8_t value) {
+        Step<Policy>(cpu);
+        cpu->Write(address, value);
+    }
+
+    template <typename Policy, Operand operand>
+    uint8_t Read(Cpu* const cpu, const uint8_t* const args) {
+        if constexpr (operand == Operand::Immediate8)
+            return args[0];
+        else if constexpr (IsMemory(operand))
+            return Load<Policy>(cpu, Address<operand>(cpu));
+        else
+            return Byte<operand>(cpu);
+    }
+
+    template <typename Policy, Operand operand>
+    void Write(Cpu* const cpu, const uint8_t value) {
+        if constexpr (IsMemory(operand))
+            Store<Policy>(cpu, Address<operand>(cpu), value);
+        else
+            Byte<operand>(cpu) = value;
+    }
+
+    template <Operand operand>
+    uint16_t& Pair(Cpu* const cpu) {
+        if constexpr (operand == Operand::BC) return cpu->state->BC;
+        else if constexpr (operand == Operand::DE) return cpu->state->DE;
+        else if constexpr (operand == Operand::HL) return cpu->state->HL;
+        else if constexpr (operand == Operand::SP) return cpu->state->SP;
+        else {
+            static_assert(operand == Operand::AF, "not a register pair");
+            return cpu->state->AF;
+        }
+    }
+
+    template <typename Policy, Operand dst, Operand src>
+    bool LoadByte(Cpu* const cpu, const uint8_t* const args) {
+        Write<Policy, dst>(cpu, Read<Policy, src>(cpu, args));
+        return false;
+    }
+
+    template <Operand dst>
+    bool LoadDoubleByte(Cpu* const cpu, const uint8_t* const args) {
+        Pair<dst>(cpu) = Helpers::JoinBytes(args[0], args[1]);
+        return false;
+    }
+
+    template <typename Policy>
+    bool StoreDoubleByte(Cpu* const cpu, const uint8_t* const args) {
+        // the upper byte goes first, at the lower address
+        const uint16_t address = Helpers::JoinBytes(args[0], args[1]);
+        Store<Policy>(cpu, address, cpu->state->SP >> 8);
+        Store<Policy>(cpu, address + 1, cpu->state->SP & 0xFF);
+        return false;
+    }
+
+    template <typename Policy, Operand dst>
+    bool IncreaseByte(Cpu* const cpu, const uint8_t* const) {
+        if constexpr (IsMemory(dst)) {
+            const uint16_t address = Address<dst>(cpu);
+            const uint8_t byte = Load<Policy>(cpu, address);
+            cpu->RecordIncrement(FlagOperation::Increase, byte + 1);
+            Store<Policy>(cpu, address, byte + 1);
+        } else {
+            uint8_t& byte = Byte<dst>(cpu);
+            cpu->RecordIncrement(FlagOperation::Increase, byte + 1);
+            byte++;
+        }
+        return false;
+    }
+
+    template <typename Policy, Operand dst>
+    bool DecreaseByte(Cpu* const cpu, const uint8_t* const) {
+        if constexpr (IsMemory(dst)) {
+            const uint16_t address = Address<dst>(cpu);
+            const uint8_t byte = Load<Policy>(cpu, address);
+            cpu->RecordIncrement(FlagOperation::Decrease, byte - 1);
+            Store<Policy>(cpu, address, byte - 1);
+        } else {
+            uint8_t& byte = Byte<dst>(cpu);
+            cpu->RecordIncrement(FlagOperation::Decrease, byte - 1);
+            byte--;
+        }
+        return false;
+    }
+
+    template <Operand dst>
+    bool IncreaseDoubleByte(Cpu* const cpu, const uint8_t* const) {
+        Pair<dst>(cpu)++;
+        return false;
+    }
+
+    template <Operand dst>
+    bool DecreaseDoubleByte(Cpu* const cpu, const uint8_t* const) {
+        Pair<dst>(cpu)--;
+        return false;
+    }
+
+    template <Operand src>
+    bool AddDoubleByte(Cpu* const cpu, const uint8_t* const) {
+        const uint16_t value = Pair<src>(cpu);
+        const uint32_t tmp = cpu->state->HL + value;
+        // h is the carry out of the lower byte, z is kept
+        cpu->SetFlag(Flag::h, (cpu->state->HL & 0xFF) + (value & 0xFF) > 0xFF);
+        cpu->SetFlag(Flag::c, tmp > 0xFFFF);
+        cpu->SetFlag(Flag::n, 0);
+        cpu->state->HL = tmp & 0xFFFF;
+        return false;
+    }
+
+    template <uint8_t direction>
+    bool RotateAccumulator(Cpu* const cpu, const uint8_t* const) {
+        uint8_t out;
+        if constexpr (direction == Operations::ShiftDirection::Left) {
+            out = cpu->state->A >> 7;
+            cpu->state->A = (cpu->state->A << 1) | out;
+        } else {
+            out = cpu->state->A & 0x01;
+            cpu->state->A = (cpu->state->A >> 1) | (out << 7);
+        }
+        // z, n and h are reset, c gets the bit rotated out
+        cpu->MaterializeFlags();
+        cpu->state->F = (cpu->state->F & 0x0F) | (out ? (uint8_t) Flag::c : 0);
+        return false;
+    }
+
+    template <typename Policy, uint8_t operation, Operand src>
+    bool Alu(Cpu* const cpu, const uint8_t* const args) {
+        const uint8_t value = Read<Policy, src>(cpu, args);
+        uint8_t& a = cpu->state->A;
+        if constexpr (operation == 0 || operation == 1) {
+            // ADD, ADC
+            const uint8_t carry = operation == 1 ? cpu->GetFlag(Flag::c) : 0;
+            const uint16_t tmp = a + value + carry;
+            cpu->RecordFlags(FlagOperation::Add, a, value, carry, tmp & 0xFF);
+            a = tmp & 0xFF;
+        } else if constexpr (operation == 2 || operation == 3) {
+            // SUB, SBC
+            const uint8_t carry = operation == 3 ? cpu->GetFlag(Flag::c) : 0;
+            const int16_t tmp = a - (value + carry);
+            cpu->RecordFlags(FlagOperation::Subtract, a, value, carry, static_cast<uint8_t>(tmp));
+            a = static_cast<uint8_t>(tmp);
+        } else if constexpr (operation == 4) {
+            a &= value;
+            cpu->RecordFlags(FlagOperation::And, a, value, 0, a);
+        } else if constexpr (operation == 5) {
+            a ^= value;
+            cpu->RecordFlags(FlagOperation::Or, a, value, 0, a);
+        } else if constexpr (operation == 6) {
+            a |= value;
+            cpu->RecordFlags(FlagOperation::Or, a, value, 0, a);
+        } else {
+            // CP
+            cpu->RecordFlags(FlagOperation::Subtract, a, value, 0, static_cast<uint8_t>(a - value));
+        }
+        return false;
+    }
+
+    template <typename Policy, Operand dst>
+    bool PopDoubleByte(Cpu* const cpu, const uint8_t* const) {
+        const uint8_t lower = Load<Policy>(cpu, cpu->state->SP);
+        const uint8_t upper = Load<Policy>(cpu, cpu->state->SP + 1);
+        cpu->state->SP += 2;
+        // F is written directly, pending lazy flags must not overwrite it later
+        if constexpr (dst == Operand::AF)
+            cpu->MaterializeFlags();
+        Pair<dst>(cpu) = Helpers::JoinBytes(upper, lower);
+        return false;
+    }
+
+    template <typename Policy, Operand src>
+    bool PushDoubleByte(Cpu* const cpu, const uint8_t* const) {
+        if constexpr (src == Operand::AF)
+            cpu->MaterializeFlags();
+        const uint16_t value = Pair<src>(cpu);
+        cpu->state->SP -= 2;
+        // SP is decremented on an M-cycle of its own, before the writes
+        Step<Policy>(cpu);
+        Store<Policy>(cpu, cpu->state->SP + 1, value >> 8);
+        Store<Policy>(cpu, cpu->state->SP, value & 0xFF);
+        return false;
+    }
+
+    bool JumpRelative(Cpu* const cpu, const uint8_t* const args) {
+        cpu->state->PC += args[0] - 128 - 2;
+        return false;
+    }
+
+    template <Operand condition>
+    bool JumpRelativeConditional(Cpu* const cpu, const uint8_t* const args) {
+        constexpr Flag flag = (condition == Operand::NotZero || condition == Operand::Zero) ? Flag::z : Flag::c;
+        constexpr bool flag_value = condition == Operand::Zero || condition == Operand::Carry;
+        if (cpu->GetFlag(flag) != flag_value)
+            return false;
+        cpu->state->PC += args[0] - 128 - 2;
+        return true;
+    }
+
+    /// Picks the executor matching the Parser handler of an opcode, nullptr if it has none.
+    template <typename Policy, const OpcodeTable& table, std::size_t opcode>
+    constexpr Executor Select() {
+        constexpr Decoding::OpcodeInfo info = table[opcode];
+        if constexpr (info.handler == &Parser::BuildLoadByte)
+            return &LoadByte<Policy, info.dst, info.src>;
+        else if constexpr (info.handler == &Parser::BuildLoadDoubleByte)
+            return &LoadDoubleByte<info.dst>;
+        else if constexpr (info.handler == &Parser::BuildStoreDoubleByte)
+            return &StoreDoubleByte<Policy>;
+        else if constexpr (info.handler == &Parser::BuildIncreaseByte)
+            return &IncreaseByte<Policy, info.dst>;
+        else if constexpr (info.handler == &Parser::BuildDecreaseByte)
+            return &DecreaseByte<Policy, info.dst>;
+        else if constexpr (info.handler == &Parser::BuildIncreaseDoubleByte)
+            return &IncreaseDoubleByte<info.dst>;
+        else if constexpr (info.handler == &Parser::BuildDecreaseDoubleByte)
+            return &DecreaseDoubleByte<info.dst>;
+        else if constexpr (info.handler == &Parser::BuildAddDoubleByte)
+            return &AddDoubleByte<info.src>;
+        else if constexpr (info.handler == &Parser::BuildRotateAccumulator)
+            return &RotateAccumulator<info.index>;
+        else if constexpr (info.handler == &Parser::BuildAlu)
+            return &Alu<Policy, info.index, info.src>;
+        else if constexpr (info.handler == &Parser::BuildPopDoubleByte)
+            return &PopDoubleByte<Policy, info.dst>;
+        else if constexpr (info.handler == &Parser::BuildPushDoubleByte)
+            return &PushDoubleByte<Policy, info.dst>;
+        else if constexpr (info.handler == &Parser::BuildJumpRelative)
+            return &JumpRelative;
+        else if constexpr (info.handler == &Parser::BuildJumpRelativeConditional)
+            return &JumpRelativeConditional<info.dst>;
+        else {
+            static_assert(info.handler == nullptr, "opcode handler without an executor");
+            return nullptr;
+        }
+    }
+
+    template <typename Policy, const OpcodeTable& table, std::size_t... opcodes>
+    constexpr std::array<Executor, 256> GenerateExecutors(std::index_sequence<opcodes...>) {
+        return { Select<Policy, table, opcodes>()... };
+    }
+
+    using Accuracy::InstructionGranular;
+    using Accuracy::MCycle;
+    const std::array<Executor, 256> executors = GenerateExecutors<InstructionGranular, Decoding::opcodes>(std::make_index_sequence<256>());
+    const std::array<Executor, 256> cb_executors = GenerateExecutors<InstructionGranular, Decoding::cb_opcodes>(std::make_index_sequence<256>());
+    const std::array<Executor, 256> stepped_executors = GenerateExecutors<MCycle, Decoding::opcodes>(std::make_index_sequence<256>());
+    const std::array<Executor, 256> stepped_cb_executors = GenerateExecutors<MCycle, Decoding::cb_opcodes>(std::make_index_sequence<256>());
+
+    template <typename Policy>
+    Executor Lookup(const Decoding::OpcodeInfo& info) {
+        const std::array<Executor, 256>& base_executors = Policy::stepped ? stepped_executors : executors;
+        const std::array<Executor, 256>& prefixed_executors = Policy::stepped ? stepped_cb_executors : cb_executors;
+        const Decoding::OpcodeInfo* const base = Decoding::opcodes.data();
+        if (&info >= base && &info < base + 256)
+            return base_executors[&info - base];
+        return prefixed_executors[&info - Decoding::cb_opcodes.data()];
+    }
+
+    template Executor Lookup<InstructionGranular>(const Decoding::OpcodeInfo& info);
+    template Executor Lookup<MCycle>(const Decoding::OpcodeInfo& info);
+
+#if GBEMU_THREADED_DISPATCH
+    /// Fetches the arguments of the base page opcode at PC and executes it.
+    template <uint8_t opcode>
+    [[gnu::always_inline]] inline void Thread(Cpu* const cpu) {
+        constexpr Decoding::OpcodeInfo info = Decoding::opcodes[opcode];
+        uint8_t args[2];
+        if constexpr (info.length > 1)
+            args[0] = cpu->bus->Read(cpu->state->PC + 1);
+        if constexpr (info.length > 2)
+            args[1] = cpu->bus->Read(cpu->state->PC + 2);
+        cpu->state->PC += info.length;
+        cpu->state->instructions++;
+
+        if constexpr (info.prefix) {
+            const Decoding::OpcodeInfo& prefixed = Decoding::cb_opcodes[args[0]];
+            const Executor execute = cb_executors[args[0]];
+            const bool branched = execute != nullptr && execute(cpu, args);
+            cpu->state->cycles += branched ? prefixed.cycles_branch : prefixed.cycles;
+        } else {
+            constexpr Executor execute = Select<Accuracy::InstructionGranular, Decoding::opcodes, opcode>();
+            if constexpr (execute != nullptr) {
+                const bool branched = execute(cpu, args);
+                cpu->state->cycles += branched ? info.cycles_branch : info.cycles;
+            } else {
+                cpu->state->cycles += info.cycles;
+            }
+        }
+    }
+
+    // invokes GBEMU_OPCODE(high, low) for every opcode, as hexadecimal digits
+#define GBEMU_OPCODE_ROW(high) \
+    GBEMU_OPCODE(high, 0) GBEMU_OPCODE(high, 1) GBEMU_OPCODE(high, 2) GBEMU_OPCODE(high, 3) \
+    GBEMU_OPCODE(high, 4) GBEMU_OPCODE(high, 5) GBEMU_OPCODE(high, 6) GBEMU_OPCODE(high, 7) \
+    GBEMU_OPCODE(high, 8) GBEMU_OPCODE(high, 9) GBEMU_OPCODE(high, A) GBEMU_OPCODE(high, B) \
+    GBEMU_OPCODE(high, C) GBEMU_OPCODE(high, D) GBEMU_OPCODE(high, E) GBEMU_OPCODE(high, F)
+#define GBEMU_OPCODES \
+    GBEMU_OPCODE_ROW(0) GBEMU_OPCODE_ROW(1) GBEMU_OPCODE_ROW(2) GBEMU_OPCODE_ROW(3) \
+    GBEMU_OPCODE_ROW(4) GBEMU_OPCODE_ROW(5) GBEMU_OPCODE_ROW(6) GBEMU_OPCODE_ROW(7) \
+    GBEMU_OPCODE_ROW(8) GBEMU_OPCODE_ROW(9) GBEMU_OPCODE_ROW(A) GBEMU_OPCODE_ROW(B) \
+    GBEMU_OPCODE_ROW(C) GBEMU_OPCODE_ROW(D) GBEMU_OPCODE_ROW(E) GBEMU_OPCODE_ROW(F)
+
+    uint64_t RunThreaded(Cpu* const cpu, const uint64_t budget) {
+#define GBEMU_OPCODE(high, low) &&opcode_##high##low,
+        static const void* const labels[256] = { GBEMU_OPCODES };
+#undef GBEMU_OPCODE
+
+        const uint64_t start = cpu->state->cycles;
+        const uint64_t end = start + budget;
+        if (budget == 0)
+            return 0;
+        goto *labels[cpu->bus->Read(cpu->state->PC)];
+
+#define GBEMU_OPCODE(high, low) \
+    opcode_##high##low: \
+        Thread<0x##high##low>(cpu); \
+        if (cpu->state->cycles >= end) \
+            return cpu->state->cycles - start; \
+        goto *labels[cpu->bus->Read(cpu->state->PC)];
+        GBEMU_OPCODES
+#undef GBEMU_OPCODE
+    }
+
+#undef GBEMU_OPCODES
+#undef GBEMU_OPCODE_ROW
+#endif
+}
@@ -0,0 +1,65 @@
+#pragma once
+#include <array>
+#include <cstdint>
+
+// use the class-based Operations instead of the per-opcode handlers, e.g. to debug them
+#ifndef GBEMU_REFERENCE_OPERATIONS
+#define GBEMU_REFERENCE_OPERATIONS 0
+#endif
+
+// run Cpu::Run through labels as values, each opcode handler jumping to the next one
+#ifndef GBEMU_THREADED_DISPATCH
+#if defined(__GNUC__)
+#define GBEMU_THREADED_DISPATCH 1
+#else
+#define GBEMU_THREADED_DISPATCH 0
+#endif
+#endif
+
+namespace Cpu {
+    class Cpu;
+
+    namespace Decoding {
+        struct OpcodeInfo;
+    }
+}
+
+namespace Cpu::Handlers {
+
+    /**
+     * Executes a whole instruction, PC already pointing past it. Returns whether it branched.
+     * Each implemented opcode gets its own executor, instantiated from templates on the
+     * operands and operation of its decoding table entry: operands are resolved at compile
+     * time, so there are no references to follow, no virtual calls and no step switches.
+     * They behave as the Operations built by the Parser, see Debug::CompareHandlers.
+     */
+    using Executor = bool (*)(Cpu* const cpu, const uint8_t* const args);
+
+    /// Executors of the base page, nullptr where the opcode is not implemented.
+    extern const std::array<Executor, 256> executors;
+    /// Executors of the CB page, nullptr where the opcode is not implemented.
+    extern const std::array<Executor, 256> cb_executors;
+    /**
+     * The same executors for Accuracy::MCycle, instantiated from the same templates: they call
+     * Cpu::Step before each M-cycle spent accessing memory or working internally, so that every
+     * read and write happens on its own M-cycle. Write-only memory operands are not read.
+     */
+    extern const std::array<Executor, 256> stepped_executors;
+    extern const std::array<Executor, 256> stepped_cb_executors;
+
+    /// Returns the executor of an entry of Decoding::opcodes or Decoding::cb_opcodes, for an Accuracy policy.
+    template <typename Policy>
+    Executor Lookup(const Decoding::OpcodeInfo& info);
+
+#if GBEMU_THREADED_DISPATCH
+    /**
+     * Runs instructions until at least budget M-cycles have elapsed. Returns the elapsed M-cycles.
+     * Every opcode has its own copy of the fetch, execute and dispatch sequence with its executor
+     * inlined, ending in its own indirect jump to the next opcode: the host predicts each of these
+     * jumps separately. Instructions are fetched from memory, not from the decode cache.
+     * Peripherals are not caught up in between, see Cpu::Run.
+     */
+    uint64_t RunThreaded(Cpu* const cpu, const uint64_t budget);
+#endif
+
+}
@@ -16,14 +16,14 @@ namespace Cpu::Helpers {
     /// Concatenates two bytes to form a 16-bit unsigned integer.
     uint16_t JoinBytes(const uint8_t upper_byte, const uint8_t lower_byte);
 
-    void ExecuteDoubleByteOperation(Cpu* const cpu, uint8_t& upper_byte, uint8_t& lower_byte, const DoubleByteOperation op);
+    void ExecuteDoubleByteOperation(uint16_t& double_byte, const DoubleByteOperation op);
 
-    uint8_t* DereferenceDoubleByte(Cpu* const cpu, uint8_t& upper_byte, uint8_t& lower_byte, const DoubleByteOperation post_op);
-    uint8_t* DereferenceBC(Cpu* const cpu);
-    uint8_t* DereferenceDE(Cpu* const cpu);
-    /// Returns a pointer to the byte stored in memory at address HL.
-    uint8_t* DereferenceHL(Cpu* const cpu, const DoubleByteOperation post_op);
-    uint8_t* DereferenceSP(Cpu* const cpu, const DoubleByteOperation sp_op);
+    /// Returns the address held by a register pair, then applies post_op to it.
+    uint16_t IndirectAddress(uint16_t& double_byte, const DoubleByteOperation post_op);
+    uint16_t AddressBC(Cpu* const cpu);
+    uint16_t AddressDE(Cpu* const cpu);
+    /// Returns the address HL points to, then applies post_op to HL.
+    uint16_t AddressHL(Cpu* const cpu, const DoubleByteOperation post_op);
 
     uint8_t GetArgsNumber(uint8_t opcode);
 }
@@ -0,0 +1,683 @@
+#include <cstddef>
+
+#include "jit.hpp"
+#include "../cpu.hpp"
+
+#if GBEMU_JIT_SUPPORTED
+#include <sys/mman.h>
+#include <unistd.h>
+#include "x64_emitter.hpp"
+#endif
+
+namespace Cpu::Jit {
+#if GBEMU_JIT_SUPPORTED
+    // host registers holding B, C, D, E, H, L, (HL), A; (HL) has none, see EmitMemory
+    constexpr Register host_registers[8] = { R10, R11, R12, R13, R14, R15, RAX, R8 };
+    constexpr Register host_f = R9;
+    // holds the limit passed to the block
+    constexpr Register host_limit = RBP;
+    constexpr size_t max_block_code = 8192;
+
+    struct Offsets {
+        int32_t registers[8];
+        int32_t F;
+        int32_t S;
+        int32_t P;
+        int32_t PC;
+        int32_t block_exit;
+        int32_t cycles;
+    };
+
+    int32_t Offset(const State* const state, const void* const field) {
+        return (int32_t) ((const uint8_t*) field - (const uint8_t*) state);
+    }
+
+    void LoadRegisters(Emitter& emitter, const Offsets& offsets) {
+        for (uint8_t i = 0; i < 8; i++)
+            if (i != 6)
+                emitter.LoadByte(host_registers[i], offsets.registers[i]);
+        emitter.LoadByte(host_f, offsets.F);
+    }
+
+    void StoreRegisters(Emitter& emitter, const Offsets& offsets) {
+        for (uint8_t i = 0; i < 8; i++)
+            if (i != 6)
+                emitter.StoreByte(offsets.registers[i], host_registers[i]);
+        emitter.StoreByte(offsets.F, host_f);
+    }
+
+    /// F = (F & 0x0F) | al, leaving the low nibble as the interpreter does.
+    void MergeFlags(Emitter& emitter) {
+        emitter.AluImmediate8(And, host_f, 0x0F);
+        emitter.AluRegister8(Or, host_f, RAX);
+    }
+
+    /**
+     * ecx = A, edx = the source operand of an ALU entry, A,r or A,u8, plus c for ADC and SBC.
+     * For A,(HL), edx already holds the byte read by EmitMemory.
+     */
+    void LoadAluOperands(Emitter& emitter, const BlockEntry& entry, const bool with_carry) {
+        emitter.MovZeroExtend8(RCX, R8);
+        if (entry.opcode >> 6 == 3)
+            emitter.MovImmediate32(RDX, entry.args[0]);
+        else if ((entry.opcode & 0x07) != 6)
+            emitter.MovZeroExtend8(RDX, host_registers[entry.opcode & 0x07]);
+        if (with_carry) {
+            emitter.MovZeroExtend8(RSI, host_f);
+            emitter.ShiftRight32(RSI, 4);
+            emitter.AluImmediate32(And, RSI, 1);
+            emitter.AluRegister32(Add, RDX, RSI);
+        }
+    }
+
+    /// Native code reads F straight from the State once the call returns, so flags can't stay lazy.
+    uint32_t CallEntry(Cpu* const cpu, const BlockEntry* const entry) {
+        uint32_t result = cpu->ExecuteEntry(*entry);
+        cpu->MaterializeFlags();
+        return result;
+    }
+
+
+    /**
+     * Emits an ALU operation between A and a register, u8, or (HL) read into edx by EmitMemory,
+     * with flags as Cpu::ComputeFlags derives them.
+     */
+    void EmitAlu(Emitter& emitter, const BlockEntry& entry) {
+        const uint8_t y = (entry.opcode >> 3) & 0x07;
+        const uint8_t z = entry.opcode & 0x07;
+        // ADD / ADC: from A, the sum and its carry
+        if (y == 0 || y == 1) {
+            LoadAluOperands(emitter, entry, y == 1);
+            emitter.AluRegister32(Add, RDX, RCX);
+            emitter.MovRegister8(R8, RDX);
+            emitter.Test8(RDX, RDX);
+            emitter.Set(Zero, RAX);
+            emitter.ShiftLeft8(RAX, 7);
+            // h: A below 0x10 and the sum at least 0x10
+            emitter.AluImmediate32(Cmp, RCX, 0x10);
+            emitter.Set(Carry, RCX);
+            emitter.AluImmediate32(Cmp, RDX, 0x10);
+            emitter.Set(NotCarry, RSI);
+            emitter.AluRegister8(And, RCX, RSI);
+            emitter.ShiftLeft8(RCX, 5);
+            emitter.AluRegister8(Or, RAX, RCX);
+            // c: bit 8 of the sum
+            emitter.ShiftRight32(RDX, 8);
+            emitter.ShiftLeft8(RDX, 4);
+            emitter.AluRegister8(Or, RAX, RDX);
+            MergeFlags(emitter);
+            return;
+        }
+        // SUB / SBC / CP: the same for a signed difference, CP leaving A as is
+        if (y == 2 || y == 3 || y == 7) {
+            LoadAluOperands(emitter, entry, y == 3);
+            emitter.MovRegister64(RSI, RCX);
+            emitter.AluRegister32(Sub, RSI, RDX);
+            emitter.Test8(RSI, RSI);
+            emitter.Set(Zero, RAX);
+            emitter.ShiftLeft8(RAX, 7);
+            emitter.AluImmediate8(Or, RAX, 0x40);
+            // h: A above 0x0F and the difference at most 0x0F
+            emitter.AluImmediate32(Cmp, RCX, 0x0F);
+            emitter.Set(Above, RCX);
+            emitter.AluImmediate32(Cmp, RSI, 0x0F);
+            emitter.Set(LessEqual, RDX);
+            emitter.AluRegister8(And, RCX, RDX);
+            emitter.ShiftLeft8(RCX, 5);
+            emitter.AluRegister8(Or, RAX, RCX);
+            // c: a negative difference
+            emitter.AluImmediate32(Cmp, RSI, 0);
+            emitter.Set(Less, RDX);
+            emitter.ShiftLeft8(RDX, 4);
+            emitter.AluRegister8(Or, RAX, RDX);
+            if (y != 7)
+                emitter.MovRegister8(R8, RSI);
+            MergeFlags(emitter);
+            return;
+        }
+        // AND / XOR / OR: z from the result, h set by AND only, n and c reset
+        AluOperation operation = y == 4 ? And : (y == 5 ? Xor : Or);
+        if (entry.opcode >> 6 == 3)
+            emitter.AluImmediate8(operation, R8, entry.args[0]);
+        else
+            emitter.AluRegister8(operation, R8, z == 6 ? RDX : host_registers[z]);
+        emitter.Test8(R8, R8);
+        emitter.Set(Zero, RAX);
+        emitter.ShiftLeft8(RAX, 7);
+        if (y == 4)
+            emitter.AluImmediate8(Or, RAX, 0x20);
+        MergeFlags(emitter);
+    }
+
+    /// Emits native code for entry if there is a translation, returns whether there was.
+    bool EmitNative(Emitter& emitter, const Offsets& offsets, const BlockEntry& entry) {
+        const Decoding::OpcodeInfo& info = *entry.info;
+        const uint8_t opcode = entry.opcode;
+        const uint8_t x = opcode >> 6;
+        const uint8_t y = (opcode >> 3) & 0x07;
+        const uint8_t z = opcode & 0x07;
+
+        if (info.handler == nullptr)
+            return true;
+        if (info.prefix || &info < Decoding::opcodes.data() || &info >= Decoding::opcodes.data() + 256)
+            return false;
+
+        // LD r,r
+        if (x == 1 && y != 6 && z != 6) {
+            if (y != z)
+                emitter.MovRegister8(host_registers[y], host_registers[z]);
+            return true;
+        }
+        // LD r,u8
+        if (x == 0 && z == 6 && y != 6) {
+            emitter.MovImmediate8(host_registers[y], entry.args[0]);
+            return true;
+        }
+        // LD rr,u16, the first argument going to the upper register as in Operations::LoadDoubleByte
+        if (x == 0 && z == 1 && (y & 0x01) == 0) {
+            uint8_t pair = y >> 1;
+            if (pair == 3) {
+                emitter.StoreImmediate8(offsets.S, entry.args[0]);
+                emitter.StoreImmediate8(offsets.P, entry.args[1]);
+            } else {
+                emitter.MovImmediate8(host_registers[2 * pair], entry.args[0]);
+                emitter.MovImmediate8(host_registers[2 * pair + 1], entry.args[1]);
+            }
+            return true;
+        }
+        // INC rr / DEC rr, carrying into the upper register; no SM83 flags are affected
+        if (x == 0 && z == 3) {
+            uint8_t pair = y >> 1;
+            AluOperation low = (y & 0x01) ? Sub : Add;
+            AluOperation high = (y & 0x01) ? Sbb : Adc;
+            if (pair == 3) {
+                emitter.AluMemoryImmediate8(low, offsets.P, 1);
+                emitter.AluMemoryImmediate8(high, offsets.S, 0);
+            } else {
+                emitter.AluImmediate8(low, host_registers[2 * pair + 1], 1);
+                emitter.AluImmediate8(high, host_registers[2 * pair], 0);
+            }
+            return true;
+        }
+        // RLCA / RRCA: z, n and h are reset, c gets the bit rotated out
+        if (opcode == 0x07 || opcode == 0x0F) {
+            if (opcode == 0x07)
+                emitter.RotateLeft8(R8);
+            else
+                emitter.RotateRight8(R8);
+            emitter.Set(Carry, RAX);
+            emitter.ShiftLeft8(RAX, 4);
+            MergeFlags(emitter);
+            return true;
+        }
+        // INC r / DEC r: z, n and h from the result, c kept
+        if (x == 0 && (z == 4 || z == 5) && y != 6) {
+            const Register reg = host_registers[y];
+            emitter.AluImmediate8(z == 4 ? Add : Sub, reg, 1);
+            emitter.Set(Zero, RAX);
+            emitter.ShiftLeft8(RAX, 7);
+            if (z == 5)
+                emitter.AluImmediate8(Or, RAX, 0x40);
+            // half carry is set if 00001111 -> 00010000, or 00010000 -> 00001111
+            emitter.AluImmediate8(Cmp, reg, z == 4 ? 0x10 : 0x0F);
+            emitter.Set(Zero, RCX);
+            emitter.ShiftLeft8(RCX, 5);
+            emitter.AluRegister8(Or, RAX, RCX);
+            emitter.AluImmediate8(And, host_f, 0x1F);
+            emitter.AluRegister8(Or, host_f, RAX);
+            return true;
+        }
+        // ADD / ADC / SUB / SBC / AND / XOR / OR / CP A,r and A,u8
+        if ((x == 2 && z != 6) || (x == 3 && z == 6)) {
+            EmitAlu(emitter, entry);
+            return true;
+        }
+
+        return false;
+    }
+
+    /// A load or store of a byte through BC, DE or HL, see EmitMemory.
+    struct MemoryAccess {
+        Register page;    // host register holding the upper byte of the address
+        Register offset;  // and the lower one
+        bool store;
+        int8_t step;      // added to HL afterwards, by (HL+) and (HL-)
+    };
+
+    /// Whether entry is a load or store EmitMemory has a fast path for, described by access if so.
+    bool FastMemory(const BlockEntry& entry, MemoryAccess& access) {
+        const Decoding::OpcodeInfo& info = *entry.info;
+        if (info.handler == nullptr || info.prefix || &info < Decoding::opcodes.data() || &info >= Decoding::opcodes.data() + 256)
+            return false;
+        const uint8_t opcode = entry.opcode;
+        const uint8_t x = opcode >> 6;
+        const uint8_t y = (opcode >> 3) & 0x07;
+        const uint8_t z = opcode & 0x07;
+
+        uint8_t pair = 2;
+        access.step = 0;
+        if (x == 1 && opcode != 0x76 && (y == 6 || z == 6)) {
+            // LD (HL),r / LD r,(HL)
+            access.store = y == 6;
+        } else if (opcode == 0x36) {
+            // LD (HL),u8
+            access.store = true;
+        } else if (x == 2 && z == 6) {
+            // ALU A,(HL)
+            access.store = false;
+        } else if (x == 0 && z == 2) {
+            // LD (rr),A / LD A,(rr), through BC, DE, HL+ and HL-
+            access.store = (y & 0x01) == 0;
+            if (y >> 1 < 2)
+                pair = y >> 1;
+            else
+                access.step = y >> 1 == 2 ? 1 : -1;
+        } else {
+            return false;
+        }
+        access.page = host_registers[2 * pair];
+        access.offset = host_registers[2 * pair + 1];
+        return true;
+    }
+
+    /**
+     * Emits the fast path of a memory access, as Bus::Read and Bus::Write do for plain memory:
+     * straight to the host memory of the page, setting its dirty bit for stores. The jumps to
+     * the slow path, taken when the page goes through a handler or, for stores, when code was
+     * decoded from it, are stored to slow. Returns their number.
+     */
+    uint8_t EmitMemory(Emitter& emitter, Cpu* const cpu, const BlockEntry& entry, const MemoryAccess& access, size_t* const slow) {
+        const uint8_t x = entry.opcode >> 6;
+        const uint8_t y = (entry.opcode >> 3) & 0x07;
+        const uint8_t z = entry.opcode & 0x07;
+        uint8_t slow_n = 0;
+
+        emitter.MovZeroExtend8(RCX, access.page);
+        emitter.MovZeroExtend8(RAX, access.offset);
+        if (access.store) {
+            // Cpu::Write would invalidate decoded and translated code
+            emitter.MovImmediate64(RDX, (uint64_t) cpu->decode_cache.code_pages.data());
+            emitter.LoadIndexedByte(RSI, RDX, RCX);
+            emitter.Test8(RSI, RSI);
+            slow[slow_n++] = emitter.JumpIf(NotZero);
+            emitter.MovImmediate64(RDX, (uint64_t) cpu->bus->write_pages.data());
+        } else {
+            emitter.MovImmediate64(RDX, (uint64_t) cpu->bus->read_pages.data());
+        }
+        emitter.LoadIndexed64(RDX, RDX, RCX);
+        emitter.Test64(RDX, RDX);
+        slow[slow_n++] = emitter.JumpIf(Zero);
+
+        if (access.store) {
+            Register value = x == 1 ? host_registers[z] : R8;
+            if (entry.opcode == 0x36) {
+                emitter.MovImmediate32(RSI, entry.args[0]);
+                value = RSI;
+            }
+            emitter.StoreIndexedByte(RDX, RAX, value);
+            emitter.MovImmediate64(RDX, (uint64_t) cpu->bus->dirty.data());
+            emitter.BitSet(RDX, RCX);
+        } else if (x == 2) {
+            emitter.LoadIndexedByte(RDX, RDX, RAX);
+            EmitAlu(emitter, entry);
+        } else {
+            emitter.LoadIndexedByte(x == 1 ? host_registers[y] : R8, RDX, RAX);
+        }
+
+        if (access.step != 0) {
+            emitter.AluImmediate8(access.step > 0 ? Add : Sub, host_registers[5], 1);
+            emitter.AluImmediate8(access.step > 0 ? Adc : Sbb, host_registers[4], 0);
+        }
+        return slow_n;
+    }
+
+    /// Runs entry through the interpreter, PC pointing past it at pc. al is then whether it branched.
+    void EmitCallback(Emitter& emitter, const Offsets& offsets, Cpu* const cpu, const BlockEntry& entry, const uint16_t pc) {
+        // the interpreter expects PC to point past the instruction, as after a fetch
+        emitter.StoreImmediate16(offsets.PC, pc);
+        StoreRegisters(emitter, offsets);
+        emitter.MovImmediate64(RDI, (uint64_t) cpu);
+        emitter.MovImmediate64(RSI, (uint64_t) &entry);
+        emitter.MovImmediate64(RAX, (uint64_t) &CallEntry);
+        emitter.CallRegister(RAX);
+        LoadRegisters(emitter, offsets);
+    }
+
+    /// The block being compiled, as its exits see it.
+    struct Chain {
+        const Block* block;
+        const BlockCache* cache;
+        /// Whether callbacks may have left State::block_exit set, in which case the block returns.
+        bool check_exit;
+        /// Jumps to the epilogue, patched once it is emitted.
+        size_t exits[8 * BlockCache::max_block_length];
+        uint16_t exits_n;
+    };
+
+    /**
+     * Leaves the block for the successor it took, edx and PC already set: jumps to the
+     * successor's code if it is linked and the cycle limit is not reached, to the epilogue
+     * otherwise.
+     */
+    void EmitExit(Emitter& emitter, const Offsets& offsets, Chain& chain, const bool branched) {
+        emitter.CompareMemory64(host_limit, offsets.cycles);
+        chain.exits[chain.exits_n++] = emitter.JumpIf(BelowEqual);
+        if (chain.check_exit) {
+            emitter.AluMemoryImmediate8(Cmp, offsets.block_exit, 0);
+            chain.exits[chain.exits_n++] = emitter.JumpIf(NotZero);
+        }
+        emitter.MovImmediate64(RAX, (uint64_t) chain.block);
+        emitter.MovImmediate64(RSI, (uint64_t) &chain.cache->link_epoch);
+        emitter.LoadDword(RCX, RSI, 0);
+        emitter.CompareDword(RCX, RAX, (int32_t) offsetof(Block, link_epoch));
+        chain.exits[chain.exits_n++] = emitter.JumpIf(NotZero);
+        emitter.LoadQword(RAX, RAX, (int32_t) (offsetof(Block, links) + branched * sizeof(void*)));
+        emitter.Test64(RAX, RAX);
+        chain.exits[chain.exits_n++] = emitter.JumpIf(Zero);
+        // counted as Cpu::RunBlocks counts blocks it follows a chain to
+        const uint8_t* const executions = (const uint8_t*) &chain.cache->executions;
+        emitter.MovImmediate64(RSI, (uint64_t) executions);
+        emitter.AddMemoryImmediate64(RSI, 0, 1);
+        emitter.AddMemoryImmediate64(RSI, (int32_t) ((const uint8_t*) &chain.cache->chained - executions), 1);
+        emitter.JumpRegister(RAX);
+    }
+
+    /// Whether entry is a JR or JR cc, see EmitBranch.
+    bool Branch(const BlockEntry& entry) {
+        return entry.opcode == 0x18 || (entry.opcode & 0xE7) == 0x20;
+    }
+
+    /**
+     * Emits the JR or JR cc ending a block, at pc. Each way out advances the cycle counter
+     * by pending and the M-cycles it takes, then sets PC and edx as a block exit does,
+     * branched << 8 | size.
+     */
+    void EmitBranch(Emitter& emitter, const Offsets& offsets, Chain& chain, const BlockEntry& entry, const uint16_t pc, const uint32_t pending) {
+        const Decoding::OpcodeInfo& info = *entry.info;
+        const uint8_t size = chain.block->size;
+        // as Handlers::JumpRelative computes it
+        const uint16_t target = pc + entry.args[0] - 128 - 2;
+        if (entry.opcode == 0x18) {
+            // not counted as branched: its base cycles are those of the jump
+            emitter.AddMemoryImmediate64(offsets.cycles, pending + info.cycles);
+            emitter.StoreImmediate16(offsets.PC, target);
+            emitter.MovImmediate32(RDX, size);
+            EmitExit(emitter, offsets, chain, false);
+            return;
+        }
+        const uint8_t y = (entry.opcode >> 3) & 0x07;
+        emitter.TestImmediate8(host_f, y < 6 ? (uint8_t) Flag::z : (uint8_t) Flag::c);
+        // NZ and NC branch when the flag is reset
+        const size_t taken = emitter.JumpIf((y & 0x01) ? NotZero : Zero);
+        emitter.AddMemoryImmediate64(offsets.cycles, pending + info.cycles);
+        emitter.StoreImmediate16(offsets.PC, pc);
+        emitter.MovImmediate32(RDX, size);
+        EmitExit(emitter, offsets, chain, false);
+        emitter.Patch(taken, emitter.size);
+        emitter.AddMemoryImmediate64(offsets.cycles, pending + info.cycles_branch);
+        emitter.StoreImmediate16(offsets.PC, target);
+        emitter.MovImmediate32(RDX, 0x100 | size);
+        EmitExit(emitter, offsets, chain, true);
+    }
+#endif
+
+    CodePool::CodePool() {
+        this->memory = nullptr;
+        this->chunks_used = 0;
+#if GBEMU_JIT_SUPPORTED
+        void* memory = mmap(nullptr, reserved_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (memory != MAP_FAILED)
+            this->memory = (uint8_t*) memory;
+#endif
+    }
+
+    CodePool& CodePool::Instance() {
+        static CodePool* const pool = new CodePool();
+        return *pool;
+    }
+
+    bool CodePool::Available() const {
+        return this->memory != nullptr;
+    }
+
+    uint8_t* CodePool::Acquire() {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        if (!this->free_chunks.empty()) {
+            uint8_t* const chunk = this->free_chunks.back();
+            this->free_chunks.pop_back();
+            return chunk;
+        }
+        if (this->memory == nullptr || this->chunks_used == reserved_size / chunk_size)
+            return nullptr;
+        return this->memory + chunk_size * this->chunks_used++;
+    }
+
+    void CodePool::Release(uint8_t* const chunk) {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        this->free_chunks.push_back(chunk);
+    }
+
+    Compiler::Compiler() {
+        this->used = 0;
+        this->flushes = 0;
+        this->compiled = 0;
+        this->rejected = 0;
+    }
+
+    Compiler::~Compiler() {
+        this->ReleaseChunks();
+    }
+
+    void Compiler::ReleaseChunks() {
+        for (uint8_t* const chunk : this->chunks)
+            CodePool::Instance().Release(chunk);
+        this->chunks.clear();
+        this->used = 0;
+    }
+
+    bool Compiler::Available() const {
+        return CodePool::Instance().Available();
+    }
+
+    size_t Compiler::CodeBytes() const {
+        // the last chunk is filled up to used
+        return this->chunks.empty() ? 0 : (this->chunks.size() - 1) * CodePool::chunk_size + this->used;
+    }
+
+    bool Compiler::Worthwhile(const Block& block, const BlockEntry* entries) {
+#if GBEMU_JIT_SUPPORTED
+        // count the instructions that would need to call back into the interpreter
+        uint8_t callbacks = 0;
+        uint8_t scratch[256];
+        Offsets offsets {};
+        for (uint8_t i = 0; i < block.size; i++) {
+            if (entries[i].info->flags & Decoding::IoWrite)
+                return false;
+            Emitter probe(scratch, sizeof(scratch));
+            MemoryAccess access;
+            const bool last = i + 1 == block.size;
+            if (!EmitNative(probe, offsets, entries[i]) && !FastMemory(entries[i], access) && !(last && Branch(entries[i])))
+                callbacks++;
+        }
+        return 2 * callbacks <= block.size;
+#else
+        (void) block;
+        (void) entries;
+        return false;
+#endif
+    }
+
+    bool Compiler::Compile(Cpu* const cpu, Block& block) {
+#if GBEMU_JIT_SUPPORTED
+        if (!this->Available())
+            return false;
+
+        const BlockEntry* entries = cpu->blocks.Entries(block);
+        if (!this->Worthwhile(block, entries)) {
+            this->rejected++;
+            return false;
+        }
+
+        // all compiled code belongs to blocks dropped by the last flush
+        if (this->flushes != cpu->blocks.flushes) {
+            this->flushes = cpu->blocks.flushes;
+            this->ReleaseChunks();
+        }
+        if (this->chunks.empty() || CodePool::chunk_size - this->used < max_block_code) {
+            uint8_t* const chunk = CodePool::Instance().Acquire();
+            if (chunk == nullptr)
+                return false;
+            this->chunks.push_back(chunk);
+            this->used = 0;
+        }
+
+        Offsets offsets;
+        offsets.registers[0] = Offset(cpu->state, &cpu->state->B);
+        offsets.registers[1] = Offset(cpu->state, &cpu->state->C);
+        offsets.registers[2] = Offset(cpu->state, &cpu->state->D);
+        offsets.registers[3] = Offset(cpu->state, &cpu->state->E);
+        offsets.registers[4] = Offset(cpu->state, &cpu->state->H);
+        offsets.registers[5] = Offset(cpu->state, &cpu->state->L);
+        offsets.registers[6] = 0;
+        offsets.registers[7] = Offset(cpu->state, &cpu->state->A);
+        offsets.F = Offset(cpu->state, &cpu->state->F);
+        offsets.S = Offset(cpu->state, &cpu->state->S);
+        offsets.P = Offset(cpu->state, &cpu->state->P);
+        offsets.PC = Offset(cpu->state, &cpu->state->PC);
+        offsets.block_exit = Offset(cpu->state, &cpu->state->block_exit);
+        offsets.cycles = Offset(cpu->state, &cpu->state->cycles);
+
+        // make the pages being written to writable again
+        long page_size = sysconf(_SC_PAGESIZE);
+        uint8_t* start = this->chunks.back() + this->used;
+        uint8_t* first_page = (uint8_t*) ((uintptr_t) start & ~(uintptr_t) (page_size - 1));
+        size_t span = (size_t) (start + max_block_code - first_page);
+        mprotect(first_page, span, PROT_READ | PROT_WRITE);
+
+        Emitter emitter(start, max_block_code);
+        emitter.Push(RBX);
+        emitter.Push(RBP);
+        emitter.Push(R12);
+        emitter.Push(R13);
+        emitter.Push(R14);
+        emitter.Push(R15);
+        // keeps the stack aligned for callbacks
+        emitter.Push(RAX);
+        emitter.MovRegister64(RBX, RDI);
+        emitter.MovRegister64(host_limit, RSI);
+        LoadRegisters(emitter, offsets);
+        // linked blocks jump here, the registers being loaded already
+        const size_t body = emitter.size;
+
+        Chain chain;
+        chain.block = &block;
+        chain.cache = &cpu->blocks;
+        chain.check_exit = false;
+        chain.exits_n = 0;
+        for (uint8_t i = 0; i < block.size; i++)
+            if ((entries[i].info->flags & Decoding::MemoryWrite) && entries[i].info->handler != nullptr)
+                chain.check_exit = true;
+
+        uint16_t pc = block.start;
+        // PC, edx and the way out already emitted by the last instruction
+        bool ended = false;
+        // M-cycles of the instructions compiled natively since the cycle counter was last
+        // advanced: they access no I/O, only the callbacks need it current
+        uint32_t pending = 0;
+
+        for (uint8_t i = 0; i < block.size; i++) {
+            const BlockEntry& entry = entries[i];
+            const Decoding::OpcodeInfo& info = *entry.info;
+            const bool last = i + 1 == block.size;
+            pc += entry.length;
+
+            if (EmitNative(emitter, offsets, entry)) {
+                pending += info.cycles;
+                continue;
+            }
+            if (last && Branch(entry)) {
+                EmitBranch(emitter, offsets, chain, entry, pc, pending);
+                ended = true;
+                continue;
+            }
+
+            if (pending != 0)
+                emitter.AddMemoryImmediate64(offsets.cycles, pending);
+            MemoryAccess access;
+            const bool fast = FastMemory(entry, access);
+            size_t done = 0;
+            if (fast) {
+                size_t slow[2];
+                const uint8_t slow_n = EmitMemory(emitter, cpu, entry, access, slow);
+                done = emitter.Jump();
+                for (uint8_t j = 0; j < slow_n; j++)
+                    emitter.Patch(slow[j], emitter.size);
+            }
+            EmitCallback(emitter, offsets, cpu, entry, pc);
+
+            if (last && (info.flags & Decoding::ControlFlow)) {
+                // edx = branched << 8 | size; PC was left as the instruction set it
+                emitter.AddMemoryImmediate64(offsets.cycles, info.cycles);
+                emitter.MovZeroExtend8(RDX, RAX);
+                emitter.Test8(RDX, RDX);
+                const size_t not_taken = emitter.JumpIf(Zero);
+                emitter.AddMemoryImmediate64(offsets.cycles, info.cycles_branch - info.cycles);
+                emitter.Patch(not_taken, emitter.size);
+                emitter.ShiftLeft32(RDX, 8);
+                emitter.OrImmediate32(RDX, block.size);
+                chain.exits[chain.exits_n++] = emitter.Jump();
+                ended = true;
+                continue;
+            }
+            if (!last && (info.flags & Decoding::MemoryWrite)) {
+                // leave early if the write modified code or hit an I/O register
+                emitter.AluMemoryImmediate8(Cmp, offsets.block_exit, 0);
+                const size_t skip = emitter.JumpIf(Zero);
+                emitter.AddMemoryImmediate64(offsets.cycles, info.cycles);
+                emitter.MovImmediate32(RDX, i + 1);
+                chain.exits[chain.exits_n++] = emitter.Jump();
+                emitter.Patch(skip, emitter.size);
+            }
+            if (fast)
+                emitter.Patch(done, emitter.size);
+            pending = info.cycles;
+        }
+
+        if (!ended) {
+            if (pending != 0)
+                emitter.AddMemoryImmediate64(offsets.cycles, pending);
+            emitter.StoreImmediate16(offsets.PC, pc);
+            emitter.MovImmediate32(RDX, block.size);
+            EmitExit(emitter, offsets, chain, false);
+        }
+
+        for (uint16_t i = 0; i < chain.exits_n; i++)
+            emitter.Patch(chain.exits[i], emitter.size);
+        StoreRegisters(emitter, offsets);
+        // the block returning, which need not be this one's caller
+        emitter.MovImmediate64(RAX, (uint64_t) &block);
+        emitter.Pop(RCX);
+        emitter.Pop(R15);
+        emitter.Pop(R14);
+        emitter.Pop(R13);
+        emitter.Pop(R12);
+        emitter.Pop(RBP);
+        emitter.Pop(RBX);
+        emitter.Ret();
+
+        mprotect(first_page, span, PROT_READ | PROT_EXEC);
+        if (emitter.overflow)
+            return false;
+
+        this->used += (emitter.size + 15) & ~(size_t) 15;
+        block.native = (void*) start;
+        block.native_body = (void*) (start + body);
+        this->compiled++;
+        return true;
+#else
+        (void) cpu;
+        (void) block;
+        return false;
+#endif
+    }
+}
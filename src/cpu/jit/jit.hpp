@@ -0,0 +1,102 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+#if defined(__x86_64__) && defined(__linux__)
+#define GBEMU_JIT_SUPPORTED 1
+#else
+#define GBEMU_JIT_SUPPORTED 0
+#endif
+
+namespace Cpu {
+    class Cpu;
+    struct State;
+    struct Block;
+    struct BlockEntry;
+}
+
+namespace Cpu::Jit {
+    /// Where compiled code returned: the last block it ran, and what that block executed.
+    struct Exit {
+        Block* block;
+        /// The number of instructions executed, with bit 8 set if the last one branched.
+        uint32_t result;
+    };
+
+    /**
+     * A compiled block. Fewer instructions than the block holds are executed when
+     * it had to be left early (see State::block_exit). Advances State::cycles by the
+     * M-cycles instructions take, branches included, as far as needed before each
+     * instruction that calls back into the interpreter.
+     * Once done, jumps to the block linked as its successor (see BlockCache::Link)
+     * while State::cycles is below limit, so that a hot loop runs without returning.
+     * Called with the state of the CPU it was compiled for.
+     */
+    using NativeBlock = Exit (*)(State* state, uint64_t limit);
+
+    /**
+     * Executable memory for every Compiler of the process, reserved once and handed out in
+     * chunks: instances don't map their own, and chunks of dropped code are reused.
+     * Never destroyed, as compiled code may outlive any one Cpu.
+     */
+    class CodePool {
+    private:
+        uint8_t* memory;
+        std::vector<uint8_t*> free_chunks;
+        uint32_t chunks_used;
+        std::mutex mutex;
+
+        CodePool();
+    public:
+        static constexpr size_t chunk_size = 256 << 10;
+        /// Address space reserved, backed by pages only once code is written to them.
+        static constexpr size_t reserved_size = 256 << 20;
+
+        static CodePool& Instance();
+        bool Available() const;
+        /// Returns a writable chunk of chunk_size bytes, nullptr once all are in use.
+        uint8_t* Acquire();
+        void Release(uint8_t* const chunk);
+    };
+
+    /**
+     * Compiles hot blocks to x86-64 code. The SM83 registers A, F, B, C, D, E, H
+     * and L live in r8b-r15b for the duration of a chain of blocks, rbx holds the
+     * State of the Cpu and rbp the cycle limit. Loads and stores through BC, DE and HL
+     * go straight to Bus::read_pages and Bus::write_pages, and set Bus::dirty, when the
+     * page maps to memory and, for stores, holds no decoded code. Other instructions
+     * without a native translation, and accesses the fast path can't take, call back into
+     * the interpreter, spilling the registers around the call, the Cpu being an
+     * immediate of the call: it need not lie near its State. Blocks that write
+     * I/O registers or would mostly call back are left to the interpreter.
+     */
+    class Compiler {
+    private:
+        /// Chunks of CodePool holding the code of this Cpu's blocks, the last one being filled.
+        std::vector<uint8_t*> chunks;
+        size_t used;
+        uint64_t flushes;
+
+        bool Worthwhile(const Block& block, const BlockEntry* entries);
+        void ReleaseChunks();
+    public:
+        /// Blocks are compiled after running this many times.
+        static constexpr uint32_t threshold = 32;
+
+        uint64_t compiled;
+        uint64_t rejected;
+
+        Compiler();
+        ~Compiler();
+        Compiler(const Compiler&) = delete;
+        Compiler& operator=(const Compiler&) = delete;
+        /// Whether executable memory could be reserved.
+        bool Available() const;
+        /// Compiles block, storing the code in block.native. Returns whether it succeeded.
+        bool Compile(Cpu* const cpu, Block& block);
+        /// Bytes of compiled code this Cpu holds, in CodePool chunks.
+        size_t CodeBytes() const;
+    };
+}
@@ -0,0 +1,340 @@
+#include "x64_emitter.hpp"
+#include <cstring>
+
+namespace Cpu::Jit {
+    Emitter::Emitter(uint8_t* const code, const size_t capacity) : code(code), capacity(capacity) {
+        this->size = 0;
+        this->overflow = false;
+    }
+
+    void Emitter::Byte(const uint8_t byte) {
+        if (this->size < this->capacity)
+            this->code[this->size++] = byte;
+        else
+            this->overflow = true;
+    }
+
+    void Emitter::Dword(const uint32_t dword) {
+        for (uint8_t i = 0; i < 4; i++)
+            this->Byte((uint8_t) (dword >> (8 * i)));
+    }
+
+    void Emitter::Qword(const uint64_t qword) {
+        for (uint8_t i = 0; i < 8; i++)
+            this->Byte((uint8_t) (qword >> (8 * i)));
+    }
+
+    void Emitter::Rex(const bool w, const uint8_t reg, const uint8_t rm) {
+        this->Byte(0x40 | (w << 3) | ((reg >> 3) << 2) | (rm >> 3));
+    }
+
+    void Emitter::ModRmRegister(const uint8_t reg, const uint8_t rm) {
+        this->Byte(0xC0 | ((reg & 0x07) << 3) | (rm & 0x07));
+    }
+
+    void Emitter::ModRmMemory(const uint8_t reg, const int32_t disp) {
+        // mod = 10 (disp32), rm = 011 (rbx)
+        this->Byte(0x80 | ((reg & 0x07) << 3) | RBX);
+        this->Dword((uint32_t) disp);
+    }
+
+    void Emitter::ModRmBase(const uint8_t reg, const uint8_t base, const int32_t disp) {
+        // mod = 10 (disp32)
+        this->Byte(0x80 | ((reg & 0x07) << 3) | (base & 0x07));
+        this->Dword((uint32_t) disp);
+    }
+
+    void Emitter::RexIndexed(const bool w, const uint8_t reg, const uint8_t index, const uint8_t base) {
+        this->Byte(0x40 | (w << 3) | ((reg >> 3) << 2) | ((index >> 3) << 1) | (base >> 3));
+    }
+
+    void Emitter::ModRmIndexed(const uint8_t reg, const uint8_t base, const uint8_t index, const uint8_t scale) {
+        // mod = 00, rm = 100: a SIB byte follows
+        this->Byte(((reg & 0x07) << 3) | 0x04);
+        this->Byte((scale << 6) | ((index & 0x07) << 3) | (base & 0x07));
+    }
+
+    void Emitter::Push(const Register reg) {
+        if (reg >= R8)
+            this->Byte(0x41);
+        this->Byte(0x50 | (reg & 0x07));
+    }
+
+    void Emitter::Pop(const Register reg) {
+        if (reg >= R8)
+            this->Byte(0x41);
+        this->Byte(0x58 | (reg & 0x07));
+    }
+
+    void Emitter::Ret() {
+        this->Byte(0xC3);
+    }
+
+    void Emitter::CallRegister(const Register reg) {
+        if (reg >= R8)
+            this->Byte(0x41);
+        this->Byte(0xFF);
+        this->ModRmRegister(2, reg);
+    }
+
+    void Emitter::JumpRegister(const Register reg) {
+        if (reg >= R8)
+            this->Byte(0x41);
+        this->Byte(0xFF);
+        this->ModRmRegister(4, reg);
+    }
+
+    void Emitter::MovRegister64(const Register dst, const Register src) {
+        this->Rex(true, src, dst);
+        this->Byte(0x89);
+        this->ModRmRegister(src, dst);
+    }
+
+    void Emitter::MovImmediate32(const Register dst, const uint32_t immediate) {
+        if (dst >= R8)
+            this->Byte(0x41);
+        this->Byte(0xB8 | (dst & 0x07));
+        this->Dword(immediate);
+    }
+
+    void Emitter::MovImmediate64(const Register dst, const uint64_t immediate) {
+        this->Rex(true, 0, dst);
+        this->Byte(0xB8 | (dst & 0x07));
+        this->Qword(immediate);
+    }
+
+    void Emitter::LoadByte(const Register dst, const int32_t disp) {
+        this->Rex(false, dst, 0);
+        this->Byte(0x0F);
+        this->Byte(0xB6);
+        this->ModRmMemory(dst, disp);
+    }
+
+    void Emitter::StoreByte(const int32_t disp, const Register src) {
+        this->Rex(false, src, 0);
+        this->Byte(0x88);
+        this->ModRmMemory(src, disp);
+    }
+
+    void Emitter::StoreImmediate8(const int32_t disp, const uint8_t immediate) {
+        this->Byte(0xC6);
+        this->ModRmMemory(0, disp);
+        this->Byte(immediate);
+    }
+
+    void Emitter::StoreImmediate16(const int32_t disp, const uint16_t immediate) {
+        this->Byte(0x66);
+        this->Byte(0xC7);
+        this->ModRmMemory(0, disp);
+        this->Byte((uint8_t) immediate);
+        this->Byte((uint8_t) (immediate >> 8));
+    }
+
+    void Emitter::MovRegister8(const Register dst, const Register src) {
+        this->Rex(false, src, dst);
+        this->Byte(0x88);
+        this->ModRmRegister(src, dst);
+    }
+
+    void Emitter::MovImmediate8(const Register dst, const uint8_t immediate) {
+        this->Rex(false, 0, dst);
+        this->Byte(0xC6);
+        this->ModRmRegister(0, dst);
+        this->Byte(immediate);
+    }
+
+    void Emitter::AluRegister8(const AluOperation operation, const Register dst, const Register src) {
+        this->Rex(false, src, dst);
+        this->Byte(operation << 3);
+        this->ModRmRegister(src, dst);
+    }
+
+    void Emitter::AluImmediate8(const AluOperation operation, const Register dst, const uint8_t immediate) {
+        this->Rex(false, 0, dst);
+        this->Byte(0x80);
+        this->ModRmRegister(operation, dst);
+        this->Byte(immediate);
+    }
+
+    void Emitter::AluMemoryImmediate8(const AluOperation operation, const int32_t disp, const uint8_t immediate) {
+        this->Byte(0x80);
+        this->ModRmMemory(operation, disp);
+        this->Byte(immediate);
+    }
+
+    void Emitter::AddMemoryImmediate64(const int32_t disp, const uint32_t immediate) {
+        this->Rex(true, 0, 0);
+        this->Byte(0x81);
+        this->ModRmMemory(Add, disp);
+        this->Dword(immediate);
+    }
+
+    void Emitter::AddMemoryImmediate64(const Register base, const int32_t disp, const uint32_t immediate) {
+        this->Rex(true, 0, base);
+        this->Byte(0x81);
+        this->ModRmBase(Add, base, disp);
+        this->Dword(immediate);
+    }
+
+    void Emitter::CompareMemory64(const Register a, const int32_t disp) {
+        this->Rex(true, a, 0);
+        this->Byte(0x3B);
+        this->ModRmMemory(a, disp);
+    }
+
+    void Emitter::LoadQword(const Register dst, const Register base, const int32_t disp) {
+        this->Rex(true, dst, base);
+        this->Byte(0x8B);
+        this->ModRmBase(dst, base, disp);
+    }
+
+    void Emitter::LoadDword(const Register dst, const Register base, const int32_t disp) {
+        this->Rex(false, dst, base);
+        this->Byte(0x8B);
+        this->ModRmBase(dst, base, disp);
+    }
+
+    void Emitter::CompareDword(const Register a, const Register base, const int32_t disp) {
+        this->Rex(false, a, base);
+        this->Byte(0x3B);
+        this->ModRmBase(a, base, disp);
+    }
+
+    void Emitter::LoadIndexed64(const Register dst, const Register base, const Register index) {
+        this->RexIndexed(true, dst, index, base);
+        this->Byte(0x8B);
+        this->ModRmIndexed(dst, base, index, 3);
+    }
+
+    void Emitter::LoadIndexedByte(const Register dst, const Register base, const Register index) {
+        this->RexIndexed(false, dst, index, base);
+        this->Byte(0x0F);
+        this->Byte(0xB6);
+        this->ModRmIndexed(dst, base, index, 0);
+    }
+
+    void Emitter::StoreIndexedByte(const Register base, const Register index, const Register src) {
+        this->RexIndexed(false, src, index, base);
+        this->Byte(0x88);
+        this->ModRmIndexed(src, base, index, 0);
+    }
+
+    void Emitter::BitSet(const Register base, const Register bit) {
+        this->Rex(true, bit, base);
+        this->Byte(0x0F);
+        this->Byte(0xAB);
+        // mod = 00, no displacement
+        this->Byte(((bit & 0x07) << 3) | (base & 0x07));
+    }
+
+    void Emitter::Test64(const Register a, const Register b) {
+        this->Rex(true, b, a);
+        this->Byte(0x85);
+        this->ModRmRegister(b, a);
+    }
+
+    void Emitter::Test8(const Register a, const Register b) {
+        this->Rex(false, b, a);
+        this->Byte(0x84);
+        this->ModRmRegister(b, a);
+    }
+
+    void Emitter::TestImmediate8(const Register a, const uint8_t immediate) {
+        this->Rex(false, 0, a);
+        this->Byte(0xF6);
+        this->ModRmRegister(0, a);
+        this->Byte(immediate);
+    }
+
+    void Emitter::AluRegister32(const AluOperation operation, const Register dst, const Register src) {
+        this->Rex(false, src, dst);
+        this->Byte((operation << 3) | 0x01);
+        this->ModRmRegister(src, dst);
+    }
+
+    void Emitter::AluImmediate32(const AluOperation operation, const Register dst, const uint32_t immediate) {
+        this->Rex(false, 0, dst);
+        this->Byte(0x81);
+        this->ModRmRegister(operation, dst);
+        this->Dword(immediate);
+    }
+
+    void Emitter::Set(const Condition condition, const Register dst) {
+        this->Rex(false, 0, dst);
+        this->Byte(0x0F);
+        this->Byte(0x90 | condition);
+        this->ModRmRegister(0, dst);
+    }
+
+    void Emitter::ShiftLeft8(const Register dst, const uint8_t count) {
+        this->Rex(false, 0, dst);
+        this->Byte(0xC0);
+        this->ModRmRegister(4, dst);
+        this->Byte(count);
+    }
+
+    void Emitter::RotateLeft8(const Register dst) {
+        this->Rex(false, 0, dst);
+        this->Byte(0xD0);
+        this->ModRmRegister(0, dst);
+    }
+
+    void Emitter::RotateRight8(const Register dst) {
+        this->Rex(false, 0, dst);
+        this->Byte(0xD0);
+        this->ModRmRegister(1, dst);
+    }
+
+    void Emitter::MovZeroExtend8(const Register dst, const Register src) {
+        this->Rex(false, dst, src);
+        this->Byte(0x0F);
+        this->Byte(0xB6);
+        this->ModRmRegister(dst, src);
+    }
+
+    void Emitter::ShiftLeft32(const Register dst, const uint8_t count) {
+        if (dst >= R8)
+            this->Byte(0x41);
+        this->Byte(0xC1);
+        this->ModRmRegister(4, dst);
+        this->Byte(count);
+    }
+
+    void Emitter::ShiftRight32(const Register dst, const uint8_t count) {
+        if (dst >= R8)
+            this->Byte(0x41);
+        this->Byte(0xC1);
+        this->ModRmRegister(5, dst);
+        this->Byte(count);
+    }
+
+    void Emitter::OrImmediate32(const Register dst, const uint32_t immediate) {
+        if (dst >= R8)
+            this->Byte(0x41);
+        this->Byte(0x81);
+        this->ModRmRegister(1, dst);
+        this->Dword(immediate);
+    }
+
+    size_t Emitter::Jump() {
+        this->Byte(0xE9);
+        size_t position = this->size;
+        this->Dword(0);
+        return position;
+    }
+
+    size_t Emitter::JumpIf(const Condition condition) {
+        this->Byte(0x0F);
+        this->Byte(0x80 | condition);
+        size_t position = this->size;
+        this->Dword(0);
+        return position;
+    }
+
+    void Emitter::Patch(const size_t position, const size_t target) {
+        if (this->overflow)
+            return;
+        int32_t displacement = (int32_t) (target - (position + 4));
+        std::memcpy(&this->code[position], &displacement, sizeof(displacement));
+    }
+}
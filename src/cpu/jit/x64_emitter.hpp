@@ -0,0 +1,117 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+namespace Cpu::Jit {
+    enum Register : uint8_t {
+        RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI,
+        R8, R9, R10, R11, R12, R13, R14, R15
+    };
+
+    /// Condition codes, as encoded in Jcc / SETcc.
+    enum Condition : uint8_t {
+        Carry = 0x2,      // unsigned below
+        NotCarry = 0x3,   // unsigned above or equal
+        Zero = 0x4,
+        NotZero = 0x5,
+        BelowEqual = 0x6,  // unsigned
+        Above = 0x7,
+        Less = 0xC,
+        LessEqual = 0xE
+    };
+
+    /// Group 1 operations, as encoded in the reg field of 0x80 /n and in the 0x00-0x38 opcodes.
+    enum AluOperation : uint8_t {
+        Add, Or, Adc, Sbb, And, Sub, Xor, Cmp
+    };
+
+    /**
+     * Writes x86-64 machine code to a caller-provided buffer.
+     * Memory operands are addressed as [rbx + disp32] unless a base is given: rbx holds the
+     * State pointer in generated code. Other bases, and indexes, are never rsp, rbp, r12 or r13,
+     * which would need other encodings. 8-bit register operands always get a REX prefix, so
+     * that encodings 4-7 select spl, bpl, sil and dil rather than ah, ch, dh and bh.
+     */
+    class Emitter {
+    private:
+        uint8_t* const code;
+        const size_t capacity;
+
+        void Rex(const bool w, const uint8_t reg, const uint8_t rm);
+        void ModRmRegister(const uint8_t reg, const uint8_t rm);
+        void ModRmMemory(const uint8_t reg, const int32_t disp);
+        void ModRmBase(const uint8_t reg, const uint8_t base, const int32_t disp);
+        void RexIndexed(const bool w, const uint8_t reg, const uint8_t index, const uint8_t base);
+        /// [base + index << scale]
+        void ModRmIndexed(const uint8_t reg, const uint8_t base, const uint8_t index, const uint8_t scale);
+    public:
+        size_t size;
+        bool overflow;
+
+        Emitter(uint8_t* const code, const size_t capacity);
+        void Byte(const uint8_t byte);
+        void Dword(const uint32_t dword);
+        void Qword(const uint64_t qword);
+
+        void Push(const Register reg);
+        void Pop(const Register reg);
+        void Ret();
+        void CallRegister(const Register reg);
+        void JumpRegister(const Register reg);
+        void MovRegister64(const Register dst, const Register src);
+        void MovImmediate32(const Register dst, const uint32_t immediate);
+        void MovImmediate64(const Register dst, const uint64_t immediate);
+
+        /// movzx r32, byte [rbx + disp]
+        void LoadByte(const Register dst, const int32_t disp);
+        /// mov byte [rbx + disp], r8
+        void StoreByte(const int32_t disp, const Register src);
+        void StoreImmediate8(const int32_t disp, const uint8_t immediate);
+        void StoreImmediate16(const int32_t disp, const uint16_t immediate);
+
+        void MovRegister8(const Register dst, const Register src);
+        void MovImmediate8(const Register dst, const uint8_t immediate);
+        void AluRegister8(const AluOperation operation, const Register dst, const Register src);
+        void AluImmediate8(const AluOperation operation, const Register dst, const uint8_t immediate);
+        void AluMemoryImmediate8(const AluOperation operation, const int32_t disp, const uint8_t immediate);
+        /// add qword [rbx + disp], imm32
+        void AddMemoryImmediate64(const int32_t disp, const uint32_t immediate);
+        /// add qword [base + disp], imm32
+        void AddMemoryImmediate64(const Register base, const int32_t disp, const uint32_t immediate);
+        /// cmp r64, qword [rbx + disp]
+        void CompareMemory64(const Register a, const int32_t disp);
+        /// mov r64, qword [base + disp]
+        void LoadQword(const Register dst, const Register base, const int32_t disp);
+        /// mov r32, dword [base + disp]
+        void LoadDword(const Register dst, const Register base, const int32_t disp);
+        /// cmp r32, dword [base + disp]
+        void CompareDword(const Register a, const Register base, const int32_t disp);
+        /// mov r64, qword [base + index * 8]
+        void LoadIndexed64(const Register dst, const Register base, const Register index);
+        /// movzx r32, byte [base + index]
+        void LoadIndexedByte(const Register dst, const Register base, const Register index);
+        /// mov byte [base + index], r8
+        void StoreIndexedByte(const Register base, const Register index, const Register src);
+        /// bts qword [base], r64: sets the bit numbered bit of the bit string at base
+        void BitSet(const Register base, const Register bit);
+        void Test64(const Register a, const Register b);
+        void Test8(const Register a, const Register b);
+        void TestImmediate8(const Register a, const uint8_t immediate);
+        void AluRegister32(const AluOperation operation, const Register dst, const Register src);
+        void AluImmediate32(const AluOperation operation, const Register dst, const uint32_t immediate);
+        void Set(const Condition condition, const Register dst);
+        void ShiftLeft8(const Register dst, const uint8_t count);
+        void RotateLeft8(const Register dst);
+        void RotateRight8(const Register dst);
+        void MovZeroExtend8(const Register dst, const Register src);
+        void ShiftLeft32(const Register dst, const uint8_t count);
+        void ShiftRight32(const Register dst, const uint8_t count);
+        void OrImmediate32(const Register dst, const uint32_t immediate);
+
+        /// Emits a jump with a 32-bit displacement to be patched, returns its position.
+        size_t Jump();
+        size_t JumpIf(const Condition condition);
+        /// Makes the jump emitted at position land at target.
+        void Patch(const size_t position, const size_t target);
+    };
+}
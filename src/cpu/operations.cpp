@@ -2,8 +2,18 @@
 #include "cpu.hpp"
 
 namespace Cpu::Operations {
-    Instruction::Instruction(const std::shared_ptr<Operation> operation, const uint8_t opcode, const std::shared_ptr<uint8_t[]> args, const uint8_t extra_steps)
-        : operation(operation), opcode(opcode), args(args), extra_steps(extra_steps) { this->extra_step_i = 0; }
+    Instruction::Instruction()
+        : operation(nullptr), info(nullptr), opcode(0), args{0, 0}, extra_steps(0), memory_operand(0), memory_address(0) { this->extra_step_i = 0; }
+
+    Instruction::~Instruction() {
+        this->Clear();
+    }
+
+    void Instruction::Clear() {
+        if (this->operation != nullptr)
+            this->operation->~Operation();
+        this->operation = nullptr;
+    }
 
     bool Instruction::Step() {
         if (this->extra_step_i++ < this->extra_steps)
@@ -18,27 +28,19 @@ namespace Cpu::Operations {
     }
 
     Operation::Operation(Cpu* const cpu)
-        : cpu(cpu) { this->step_i = 0; }
+        : cpu(cpu) { this->step_i = 0; this->branch = false; }
 
     IncreaseByte::IncreaseByte(Cpu* const cpu, uint8_t& byte)
         : Operation(cpu), byte(byte) {}
 
-    // set the z, n, h flags
-    void IncreaseByte::SetFlags() {
-        // zero flag is only set if 11111111 -> 00000000
-        this->cpu->SetFlag(Flag::z, this->byte == 0x00);
-        // negative flag is always reset
-        this->cpu->SetFlag(Flag::n, 0);
-        // when increasing, half carry is set if 00001111 -> 00010000
-        this->cpu->SetFlag(Flag::h, this->byte == 0x10);
-    }
-
     bool IncreaseByte::Step() {
         switch (this->step_i++) {
             // only one step: the referenced byte is increased and flags are set
             case 0:
+                // zero flag is only set if 11111111 -> 00000000, negative flag is always reset
+                this->cpu->RecordIncrement(FlagOperation::Increase, this->byte + 1);
                 this->byte++;
-                this->SetFlags();
+                this->cpu->WriteBack(&this->byte);
                 return true;
             default:
                 return true;
@@ -48,22 +50,14 @@ namespace Cpu::Operations {
     DecreaseByte::DecreaseByte(Cpu* const cpu, uint8_t& byte)
         : Operation(cpu), byte(byte) {}
 
-    // set the z, n, h flags
-    void DecreaseByte::SetFlags() {
-        // zero flag is only set if 00000001 -> 00000000
-        this->cpu->SetFlag(Flag::z, this->byte == 0x00);
-        // negative flag is always set
-        this->cpu->SetFlag(Flag::n, 1);
-        // when increasing, half carry is set if 00010000 -> 00001111
-        this->cpu->SetFlag(Flag::h, this->byte == 0x0F);
-    }
-
     bool DecreaseByte::Step() {
         switch (this->step_i++) {
             // only one step: the referenced byte is decreased and flags are set
             case 0:
+                // zero flag is only set if 00000001 -> 00000000, negative flag is always set
+                this->cpu->RecordIncrement(FlagOperation::Decrease, this->byte - 1);
                 this->byte--;
-                this->SetFlags();
+                this->cpu->WriteBack(&this->byte);
                 return true;
             default:
                 return true;
@@ -112,6 +106,7 @@ namespace Cpu::Operations {
         switch (this->step_i++) {
             case 0:
                 this->dst = this->src;
+                this->cpu->WriteBack(&this->dst);
                 return true;
             default:
                 return true;
@@ -121,19 +116,12 @@ namespace Cpu::Operations {
     AddByte::AddByte(Cpu* const cpu, uint8_t& dst, const uint8_t src)
         : Operation(cpu), dst(dst), src(src) {}
 
-    void AddByte::SetFlags() {
-        this->cpu->SetFlag(Flag::z, this->dst == 0x00);
-        this->cpu->SetFlag(Flag::n, 0);
-    }
-
     bool AddByte::Step() {
         switch (this->step_i++) {
             case 0: {
                 uint16_t tmp = this->dst + this->src;
-                this->cpu->SetFlag(Flag::h, (this->dst < 0x10) && (tmp >= 0x10));
-                this->cpu->SetFlag(Flag::c, tmp > 0xFF);
+                this->cpu->RecordFlags(FlagOperation::Add, this->dst, this->src, 0, tmp & 0xFF);
                 this->dst = tmp & 0xFF;
-                this->SetFlags();
                 return true;
             }
             default:
@@ -144,19 +132,13 @@ namespace Cpu::Operations {
     AdcByte::AdcByte(Cpu* const cpu, uint8_t& dst, const uint8_t src)
         : Operation(cpu), dst(dst), src(src) {}
 
-    void AdcByte::SetFlags() {
-        this->cpu->SetFlag(Flag::z, this->dst == 0x00);
-        this->cpu->SetFlag(Flag::n, 0);
-    }
-
     bool AdcByte::Step() {
         switch (this->step_i++) {
             case 0: {
-                uint16_t tmp = this->dst + this->src + this->cpu->GetFlag(Flag::c);
-                this->cpu->SetFlag(Flag::h, (this->dst < 0x10) && (tmp >= 0x10));
-                this->cpu->SetFlag(Flag::c, tmp > 0xFF);
+                uint8_t carry = this->cpu->GetFlag(Flag::c);
+                uint16_t tmp = this->dst + this->src + carry;
+                this->cpu->RecordFlags(FlagOperation::Add, this->dst, this->src, carry, tmp & 0xFF);
                 this->dst = tmp & 0xFF;
-                this->SetFlags();
                 return true;
             }
             default:
@@ -167,19 +149,12 @@ namespace Cpu::Operations {
     SubByte::SubByte(Cpu* const cpu, uint8_t& dst, const uint8_t src)
         : Operation(cpu), dst(dst), src(src) {}
 
-    void SubByte::SetFlags() {
-        this->cpu->SetFlag(Flag::z, this->dst == 0x00);
-        this->cpu->SetFlag(Flag::n, 1);
-    }
-
     bool SubByte::Step() {
         switch (this->step_i++) {
             case 0: {
                 int16_t tmp = this->dst - this->src;
-                this->cpu->SetFlag(Flag::h, (this->dst > 0x0F) && (tmp <= 0x0F));
-                this->cpu->SetFlag(Flag::c, tmp < 0);
+                this->cpu->RecordFlags(FlagOperation::Subtract, this->dst, this->src, 0, static_cast<uint8_t>(tmp));
                 this->dst = static_cast<uint8_t>(tmp);
-                this->SetFlags();
                 return true;
             }
             default:
@@ -190,19 +165,13 @@ namespace Cpu::Operations {
     SbcByte::SbcByte(Cpu* const cpu, uint8_t& dst, const uint8_t src)
         : Operation(cpu), dst(dst), src(src) {}
 
-    void SbcByte::SetFlags() {
-        this->cpu->SetFlag(Flag::z, this->dst == 0x00);
-        this->cpu->SetFlag(Flag::n, 1);
-    }
-
     bool SbcByte::Step() {
         switch (this->step_i++) {
             case 0: {
-                int16_t tmp = this->dst - (this->src + this->cpu->GetFlag(Flag::c));
-                this->cpu->SetFlag(Flag::h, (this->dst > 0x0F) && (tmp <= 0x0F));
-                this->cpu->SetFlag(Flag::c, tmp < 0);
+                uint8_t carry = this->cpu->GetFlag(Flag::c);
+                int16_t tmp = this->dst - (this->src + carry);
+                this->cpu->RecordFlags(FlagOperation::Subtract, this->dst, this->src, carry, static_cast<uint8_t>(tmp));
                 this->dst = static_cast<uint8_t>(tmp);
-                this->SetFlags();
                 return true;
             }
             default:
@@ -213,18 +182,11 @@ namespace Cpu::Operations {
     AndByte::AndByte(Cpu* const cpu, uint8_t& dst, const uint8_t src)
         : Operation(cpu), dst(dst), src(src) {}
 
-    void AndByte::SetFlags() {
-        this->cpu->SetFlag(Flag::z, this->dst == 0x00);
-        this->cpu->SetFlag(Flag::n, 0);
-        this->cpu->SetFlag(Flag::h, 1);
-        this->cpu->SetFlag(Flag::c, 0);
-    }
-
     bool AndByte::Step() {
         switch (this->step_i++) {
             case 0:
                 this->dst &= this->src;
-                this->SetFlags();
+                this->cpu->RecordFlags(FlagOperation::And, this->dst, this->src, 0, this->dst);
                 return true;
             default:
                 return true;
@@ -234,18 +196,11 @@ namespace Cpu::Operations {
     XorByte::XorByte(Cpu* const cpu, uint8_t& dst, const uint8_t src)
         : Operation(cpu), dst(dst), src(src) {}
 
-    void XorByte::SetFlags() {
-        this->cpu->SetFlag(Flag::z, this->dst == 0x00);
-        this->cpu->SetFlag(Flag::n, 0);
-        this->cpu->SetFlag(Flag::h, 0);
-        this->cpu->SetFlag(Flag::c, 0);
-    }
-
     bool XorByte::Step() {
         switch (this->step_i++) {
             case 0:
                 this->dst ^= this->src;
-                this->SetFlags();
+                this->cpu->RecordFlags(FlagOperation::Or, this->dst, this->src, 0, this->dst);
                 return true;
             default:
                 return true;
@@ -255,18 +210,11 @@ namespace Cpu::Operations {
     OrByte::OrByte(Cpu* const cpu, uint8_t& dst, const uint8_t src)
         : Operation(cpu), dst(dst), src(src) {}
 
-    void OrByte::SetFlags() {
-        this->cpu->SetFlag(Flag::z, this->dst == 0x00);
-        this->cpu->SetFlag(Flag::n, 0);
-        this->cpu->SetFlag(Flag::h, 0);
-        this->cpu->SetFlag(Flag::c, 0);
-    }
-
     bool OrByte::Step() {
         switch (this->step_i++) {
             case 0:
                 this->dst |= this->src;
-                this->SetFlags();
+                this->cpu->RecordFlags(FlagOperation::Or, this->dst, this->src, 0, this->dst);
                 return true;
             default:
                 return true;
@@ -280,10 +228,7 @@ namespace Cpu::Operations {
         switch (this->step_i++) {
             case 0: {
                 int16_t tmp = this->dst - this->src;
-                this->cpu->SetFlag(Flag::z, tmp == 0x00);
-                this->cpu->SetFlag(Flag::n, 1);
-                this->cpu->SetFlag(Flag::h, (this->dst > 0x0F) && (tmp <= 0x0F));
-                this->cpu->SetFlag(Flag::c, tmp < 0);
+                this->cpu->RecordFlags(FlagOperation::Subtract, this->dst, this->src, 0, static_cast<uint8_t>(tmp));
                 return true;
             }
             default:
@@ -291,88 +236,73 @@ namespace Cpu::Operations {
         }
     }
 
-    IncreaseDoubleByte::IncreaseDoubleByte(Cpu* const cpu, uint8_t& upper_byte, uint8_t& lower_byte)
-        : Operation(cpu), upper_byte(upper_byte), lower_byte(lower_byte) {}
+    IncreaseDoubleByte::IncreaseDoubleByte(Cpu* const cpu, uint16_t& double_byte)
+        : Operation(cpu), double_byte(double_byte) {}
 
     bool IncreaseDoubleByte::Step() {
         switch (this->step_i++) {
             case 0:
-                this->lower_byte++;
-                return false;
-            case 1:
-                if (!this->lower_byte)
-                    this->upper_byte++;
+                this->double_byte++;
                 return true;
             default:
                 return true;
         }
     }
 
-    DecreaseDoubleByte::DecreaseDoubleByte(Cpu* const cpu, uint8_t& upper_byte, uint8_t& lower_byte)
-        : Operation(cpu), upper_byte(upper_byte), lower_byte(lower_byte) {}
+    DecreaseDoubleByte::DecreaseDoubleByte(Cpu* const cpu, uint16_t& double_byte)
+        : Operation(cpu), double_byte(double_byte) {}
 
     bool DecreaseDoubleByte::Step() {
         switch (this->step_i++) {
             case 0:
-                this->lower_byte--;
-                return false;
-            case 1:
-                if (this->lower_byte == 0xFF)
-                    this->upper_byte--;
+                this->double_byte--;
                 return true;
             default:
                 return true;
         }
     }
 
-    LoadDoubleByte::LoadDoubleByte(Cpu* const cpu, uint8_t& upper_dst, uint8_t& lower_dst, const uint8_t upper_src, const uint8_t lower_src)
-        : Operation(cpu), upper_dst(upper_dst), lower_dst(lower_dst), upper_src(upper_src), lower_src(lower_src) {}
+    LoadDoubleByte::LoadDoubleByte(Cpu* const cpu, uint16_t& dst, const uint16_t src)
+        : Operation(cpu), dst(dst), src(src) {}
 
     bool LoadDoubleByte::Step() {
         switch (this->step_i++) {
             case 0:
-                lower_dst = lower_src;
-                return false;
-            case 1:
-                upper_dst = upper_src;
+                this->dst = this->src;
                 return true;
             default:
                 return true;
         }
     }
 
-    StoreDoubleByte::StoreDoubleByte(Cpu* const cpu, const uint16_t memory_address, const uint8_t upper_src, const uint8_t lower_src)
-        : Operation(cpu), memory_address(memory_address), upper_src(upper_src), lower_src(lower_src) {}
+    StoreDoubleByte::StoreDoubleByte(Cpu* const cpu, const uint16_t memory_address, const uint16_t src)
+        : Operation(cpu), memory_address(memory_address), src(src) {}
 
     bool StoreDoubleByte::Step() {
         switch (this->step_i++) {
-            case 0:
-                (*this->cpu->memory)[this->memory_address] = upper_src;
-                return false;
-            case 1:
-                (*this->cpu->memory)[this->memory_address + 1] = lower_src;
+            case 0: {
+                // the upper byte goes first, at the lower address
+                this->cpu->Write(this->memory_address, this->src >> 8);
+                this->cpu->Write(this->memory_address + 1, this->src & 0xFF);
                 return true;
+            }
             default:
                 return true;
         }
     }
 
-    AddDoubleByte::AddDoubleByte(Cpu* const cpu, uint8_t& upper_dst, uint8_t& lower_dst, const uint8_t upper_src, const uint8_t lower_src)
-        : Operation(cpu), upper_dst(upper_dst), lower_dst(lower_dst), upper_src(upper_src), lower_src(lower_src) {}
+    AddDoubleByte::AddDoubleByte(Cpu* const cpu, uint16_t& dst, const uint16_t src)
+        : Operation(cpu), dst(dst), src(src) {}
 
     bool AddDoubleByte::Step() {
         switch (this->step_i++) {
             case 0: {
-                uint16_t tmp = this->lower_dst + this->lower_src;
-                this->cpu->SetFlag(Flag::h, tmp > 0xFF);
-                this->lower_dst = tmp & 0xFF;
-                return false;
-            }
-            case 1: {
-                uint16_t tmp = this->upper_dst + this->upper_src + this->cpu->GetFlag(Flag::h);
-                this->cpu->SetFlag(Flag::c, tmp > 0xFF);
-                this->upper_dst = tmp & 0xFF;
+                uint32_t tmp = this->dst + this->src;
+                // h is the carry out of the lower byte
+                this->cpu->SetFlag(Flag::h, (this->dst & 0xFF) + (this->src & 0xFF) > 0xFF);
+                this->cpu->SetFlag(Flag::c, tmp > 0xFFFF);
                 this->cpu->SetFlag(Flag::n, 0);
+                this->dst = tmp & 0xFFFF;
                 return true;
             }
             default:
@@ -380,34 +310,34 @@ namespace Cpu::Operations {
         }
     }
 
-    PopDoubleByte::PopDoubleByte(Cpu* const cpu, uint8_t& upper_dst, uint8_t& lower_dst)
-        : Operation(cpu), upper_dst(upper_dst), lower_dst(lower_dst) {}
+    PopDoubleByte::PopDoubleByte(Cpu* const cpu, uint16_t& dst)
+        : Operation(cpu), dst(dst) {}
 
     bool PopDoubleByte::Step() {
         switch (this->step_i++) {
-            case 0:
-                lower_dst = *Helpers::DereferenceSP(this->cpu, Helpers::DoubleByteOperation::Increase);
-                return false;
-            case 1:
-                upper_dst = *Helpers::DereferenceSP(this->cpu, Helpers::DoubleByteOperation::Increase);
+            case 0: {
+                uint8_t lower = this->cpu->bus->Read(this->cpu->state->SP);
+                uint8_t upper = this->cpu->bus->Read(this->cpu->state->SP + 1);
+                this->cpu->state->SP += 2;
+                this->dst = Helpers::JoinBytes(upper, lower);
                 return true;
+            }
             default:
                 return true;
         }
     }
 
-    PushDoubleByte::PushDoubleByte(Cpu* const cpu, const uint8_t upper_src, const uint8_t lower_src)
-        : Operation(cpu), upper_src(upper_src), lower_src(lower_src) {}
+    PushDoubleByte::PushDoubleByte(Cpu* const cpu, const uint16_t src)
+        : Operation(cpu), src(src) {}
 
     bool PushDoubleByte::Step() {
         switch (this->step_i++) {
-            // lol ugly code
-            case 0:
-                *Helpers::DereferenceSP(this->cpu, Helpers::DoubleByteOperation::Decrease) = this->upper_src;
-                return false;
-            case 1:
-                *Helpers::DereferenceSP(this->cpu, Helpers::DoubleByteOperation::Decrease) = this->lower_src;
+            case 0: {
+                this->cpu->state->SP -= 2;
+                this->cpu->Write(this->cpu->state->SP + 1, this->src >> 8);
+                this->cpu->Write(this->cpu->state->SP, this->src & 0xFF);
                 return true;
+            }
             default:
                 return true;
         }
@@ -419,7 +349,7 @@ namespace Cpu::Operations {
     bool JumpRelative::Step() {
         switch (this->step_i++) {
             case 0:
-                this->cpu->PC += this->jump_offset - 128 - 2;
+                this->cpu->state->PC += this->jump_offset - 128 - 2;
                 return true;
             default:
                 return true;
@@ -427,7 +357,7 @@ namespace Cpu::Operations {
     }
 
     JumpRelativeConditional::JumpRelativeConditional(Cpu* const cpu, const uint8_t jump_offset, const Flag flag, const bool flag_value)
-        : Operation(cpu), jump_offset(jump_offset), flag(flag), flag_value(flag_value) { branch = false; }
+        : Operation(cpu), jump_offset(jump_offset), flag(flag), flag_value(flag_value) {}
 
     bool JumpRelativeConditional::Step() {
         switch(this->step_i++) {
@@ -438,7 +368,7 @@ namespace Cpu::Operations {
                 } else { return true; }
             case 1:
                 if (this->branch)
-                    this->cpu->PC += this->jump_offset - 128 - 2;
+                    this->cpu->state->PC += this->jump_offset - 128 - 2;
                 return true;
             default:
                 return true;
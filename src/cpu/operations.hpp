@@ -1,10 +1,16 @@
 #pragma once
 #include <cstdint>
-#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
 
 namespace Cpu {
     class Cpu;
     enum class Flag : uint8_t;
+
+    namespace Decoding {
+        struct OpcodeInfo;
+    }
 }
 
 namespace Cpu::Operations {
@@ -12,38 +18,21 @@ namespace Cpu::Operations {
      * A generic CPU operation. Must be derived to be used.
      * Each time Step() is called, a sub-operation ("microcode") shall be executed.
      * After the last sub-operation is executed, CPU flags may be set.
+     * Conditional operations set branch when the condition is met.
      */
     class Operation {
     public:
         Cpu* const cpu;
         uint8_t step_i;
+        bool branch;
 
         Operation(Cpu* const cpu);
+        virtual ~Operation() = default;
         virtual bool Step() = 0;
     };
 
-    /**
-     * CPU instruction. Each time Step() is called, a sub-operation is executed.
-     * When Execute() is called, all remaining sub-operations are executed and
-     * flags are automatically set, accordingly.
-     */
-    class Instruction {
-    public:
-        const std::shared_ptr<Operation> operation;
-        const uint8_t opcode;
-        const std::shared_ptr<uint8_t[]> args;
-        const uint8_t extra_steps;
-        uint8_t extra_step_i;
-
-        Instruction(const std::shared_ptr<Operation> operation, const uint8_t opcode, const std::shared_ptr<uint8_t[]> args, const uint8_t extra_steps);
-        bool Step();
-        void Execute();
-    };
-
     /// Increases an 8-bit unsigned integer and sets related flags.
     class IncreaseByte : public Operation {
-    private:
-        void SetFlags();
     public:
         uint8_t& byte;
 
@@ -53,8 +42,6 @@ namespace Cpu::Operations {
 
     /// Decreases an 8-bit unsigned integer and sets related flags.
     class DecreaseByte : public Operation {
-    private:
-        void SetFlags();
     public:
         uint8_t& byte;
 
@@ -91,8 +78,6 @@ namespace Cpu::Operations {
     };
 
     class AddByte : public Operation {
-    private:
-        void SetFlags();
     public:
         uint8_t& dst;
         const uint8_t src;
@@ -102,8 +87,6 @@ namespace Cpu::Operations {
     };
 
     class AdcByte : public Operation {
-    private:
-        void SetFlags();
     public:
         uint8_t& dst;
         const uint8_t src;
@@ -113,8 +96,6 @@ namespace Cpu::Operations {
     };
 
     class SubByte : public Operation {
-    private:
-        void SetFlags();
     public:
         uint8_t& dst;
         const uint8_t src;
@@ -124,8 +105,6 @@ namespace Cpu::Operations {
     };
 
     class SbcByte : public Operation {
-    private:
-        void SetFlags();
     public:
         uint8_t& dst;
         const uint8_t src;
@@ -135,8 +114,6 @@ namespace Cpu::Operations {
     };
 
     class AndByte : public Operation {
-    private:
-        void SetFlags();
     public:
         uint8_t& dst;
         const uint8_t src;
@@ -146,8 +123,6 @@ namespace Cpu::Operations {
     };
 
     class XorByte : public Operation {
-    private:
-        void SetFlags();
     public:
         uint8_t& dst;
         const uint8_t src;
@@ -157,8 +132,6 @@ namespace Cpu::Operations {
     };
 
     class OrByte : public Operation {
-    private:
-        void SetFlags();
     public:
         uint8_t& dst;
         const uint8_t src;
@@ -176,74 +149,65 @@ namespace Cpu::Operations {
         virtual bool Step();
     };
 
-    /// Increases the value of an unsigned 16-bit integer treated as two bytes.
+    /// Increases the value of a register pair.
     class IncreaseDoubleByte : public Operation {
     public:
-        uint8_t& upper_byte;
-        uint8_t& lower_byte;
+        uint16_t& double_byte;
 
-        IncreaseDoubleByte(Cpu* const cpu, uint8_t& upper_byte, uint8_t& lower_byte);
+        IncreaseDoubleByte(Cpu* const cpu, uint16_t& double_byte);
         virtual bool Step();
     };
 
-    /// Decreases the value of an unsigned 16-bit integer treated as two bytes.
+    /// Decreases the value of a register pair.
     class DecreaseDoubleByte : public Operation {
     public:
-        uint8_t& upper_byte;
-        uint8_t& lower_byte;
+        uint16_t& double_byte;
 
-        DecreaseDoubleByte(Cpu* const cpu, uint8_t& upper_byte, uint8_t& lower_byte);
+        DecreaseDoubleByte(Cpu* const cpu, uint16_t& double_byte);
         virtual bool Step();
     };
 
-    /// Loads a double-byte to the specified double-byte register.
+    /// Loads a double-byte to the specified register pair.
     class LoadDoubleByte : public Operation {
     public:
-        uint8_t& upper_dst;
-        uint8_t& lower_dst;
-        const uint8_t upper_src;
-        const uint8_t lower_src;
+        uint16_t& dst;
+        const uint16_t src;
 
-        LoadDoubleByte(Cpu* const cpu, uint8_t& upper_dst, uint8_t& lower_dst, const uint8_t upper_src, const uint8_t lower_src);
+        LoadDoubleByte(Cpu* const cpu, uint16_t& dst, const uint16_t src);
         virtual bool Step();
     };
 
     class StoreDoubleByte : public Operation {
     public:
         const uint16_t memory_address;
-        const uint8_t upper_src;
-        const uint8_t lower_src;
+        const uint16_t src;
 
-        StoreDoubleByte(Cpu* const cpu, const uint16_t memory_address, const uint8_t upper_src, const uint8_t lower_src);
+        StoreDoubleByte(Cpu* const cpu, const uint16_t memory_address, const uint16_t src);
         virtual bool Step();
     };
 
     class AddDoubleByte : public Operation {
     public:
-        uint8_t& upper_dst;
-        uint8_t& lower_dst;
-        const uint8_t upper_src;
-        const uint8_t lower_src;
+        uint16_t& dst;
+        const uint16_t src;
 
-        AddDoubleByte(Cpu* const cpu, uint8_t& upper_dst, uint8_t& lower_dst, const uint8_t upper_src, const uint8_t lower_src);
+        AddDoubleByte(Cpu* const cpu, uint16_t& dst, const uint16_t src);
         virtual bool Step();
     };
 
     class PopDoubleByte : public Operation {
     public:
-        uint8_t& upper_dst;
-        uint8_t& lower_dst;
+        uint16_t& dst;
 
-        PopDoubleByte(Cpu* const cpu, uint8_t& upper_dst, uint8_t& lower_dst);
+        PopDoubleByte(Cpu* const cpu, uint16_t& dst);
         virtual bool Step();
     };
 
     class PushDoubleByte : public Operation {
     public:
-        const uint8_t upper_src;
-        const uint8_t lower_src;
+        const uint16_t src;
 
-        PushDoubleByte(Cpu* const cpu, const uint8_t upper_src, const uint8_t lower_src);
+        PushDoubleByte(Cpu* const cpu, const uint16_t src);
         virtual bool Step();
     };
 
@@ -260,9 +224,58 @@ namespace Cpu::Operations {
         const uint8_t jump_offset;
         const Flag flag;
         const bool flag_value;
-        bool branch;
 
         JumpRelativeConditional(Cpu* const cpu, const uint8_t jump_offset, const Flag flag, const bool flag_value);
         virtual bool Step();
     };
+
+    /// Storage large enough to hold any of the operations above.
+    using OperationStorage = std::aligned_union_t<0,
+        IncreaseByte, DecreaseByte, RotateByte, LoadByte,
+        AddByte, AdcByte, SubByte, SbcByte, AndByte, XorByte, OrByte, CpByte,
+        IncreaseDoubleByte, DecreaseDoubleByte, LoadDoubleByte, StoreDoubleByte, AddDoubleByte,
+        PopDoubleByte, PushDoubleByte, JumpRelative, JumpRelativeConditional>;
+
+    /**
+     * CPU instruction. Each time Step() is called, a sub-operation is executed.
+     * When Execute() is called, all remaining sub-operations are executed and
+     * flags are automatically set, accordingly.
+     * The operation is built in-place by Emplace(), so that an instruction can
+     * be reused for every fetch without any heap allocation.
+     */
+    class Instruction {
+    private:
+        OperationStorage storage;
+    public:
+        Operation* operation;
+        const Decoding::OpcodeInfo* info;
+        uint8_t opcode;
+        uint8_t args[2];
+        uint8_t extra_steps;
+        uint8_t extra_step_i;
+        /// Bus byte an operand reference points to instead of memory, see Cpu::WriteBack.
+        uint8_t memory_operand;
+        uint16_t memory_address;
+
+        Instruction();
+        ~Instruction();
+        Instruction(const Instruction&) = delete;
+        Instruction& operator=(const Instruction&) = delete;
+
+        /// Destroys the current operation, if any, and constructs a new one in its place.
+        template <typename T, typename... Args>
+        T* Emplace(const uint8_t extra_steps, Args&&... args) {
+            static_assert(sizeof(T) <= sizeof(OperationStorage) && alignof(T) <= alignof(OperationStorage));
+            this->Clear();
+            T* operation = new (&this->storage) T(std::forward<Args>(args)...);
+            this->operation = operation;
+            this->extra_steps = extra_steps;
+            this->extra_step_i = 0;
+            return operation;
+        }
+
+        void Clear();
+        bool Step();
+        void Execute();
+    };
 }
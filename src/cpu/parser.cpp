@@ -1,71 +1,61 @@
 #include "parser.hpp"
 #include "cpu.hpp"
+#include "decoding.hpp"
 
 namespace Cpu {
     Parser::Parser(Cpu* const cpu) : cpu(cpu) {}
 
-    uint8_t* Parser::ChooseOperandByte(const uint8_t index) {
+    uint8_t* Parser::ChooseOperandByte(Operations::Instruction& instruction, const uint8_t index, const bool read) {
         switch (index) {
-            case 0: return &this->cpu->B;
-            case 1: return &this->cpu->C;
-            case 2: return &this->cpu->D;
-            case 3: return &this->cpu->E;
-            case 4: return &this->cpu->H;
-            case 5: return &this->cpu->L;
-            case 6: return Helpers::DereferenceHL(this->cpu, Helpers::DoubleByteOperation::None);
-            case 7: return &this->cpu->A;
+            case 0: return &this->cpu->state->B;
+            case 1: return &this->cpu->state->C;
+            case 2: return &this->cpu->state->D;
+            case 3: return &this->cpu->state->E;
+            case 4: return &this->cpu->state->H;
+            case 5: return &this->cpu->state->L;
+            case 6: return this->ChooseMemoryOperand(instruction, Helpers::AddressHL(this->cpu, Helpers::DoubleByteOperation::None), read);
+            case 7: return &this->cpu->state->A;
             default: return nullptr;
         }
     }
 
-    uint8_t* Parser::ChooseOperandDoubleByte(const uint8_t index) {
+    uint16_t* Parser::ChooseOperandDoubleByte(const uint8_t index) {
         switch (index) {
-            case 0: return &this->cpu->B;
-            case 1: return &this->cpu->C;
-            case 2: return &this->cpu->D;
-            case 3: return &this->cpu->E;
-            case 4: return &this->cpu->H;
-            case 5: return &this->cpu->L;
-            case 6: return &this->cpu->S;
-            case 7: return &this->cpu->P;
+            case 0: return &this->cpu->state->BC;
+            case 1: return &this->cpu->state->DE;
+            case 2: return &this->cpu->state->HL;
+            case 3: return &this->cpu->state->SP;
             default: return nullptr;
         }
     }
 
-    uint8_t* Parser::ChooseDereference(const uint8_t index) {
+    uint8_t* Parser::ChooseDereference(Operations::Instruction& instruction, const uint8_t index, const bool read) {
         switch (index) {
-            case 0: return Helpers::DereferenceBC(this->cpu);
-            case 1: return Helpers::DereferenceDE(this->cpu);
-            case 2: return Helpers::DereferenceHL(this->cpu, Helpers::DoubleByteOperation::Increase);
-            case 3: return Helpers::DereferenceHL(this->cpu, Helpers::DoubleByteOperation::Decrease);
+            case 0: return this->ChooseMemoryOperand(instruction, Helpers::AddressBC(this->cpu), read);
+            case 1: return this->ChooseMemoryOperand(instruction, Helpers::AddressDE(this->cpu), read);
+            case 2: return this->ChooseMemoryOperand(instruction, Helpers::AddressHL(this->cpu, Helpers::DoubleByteOperation::Increase), read);
+            case 3: return this->ChooseMemoryOperand(instruction, Helpers::AddressHL(this->cpu, Helpers::DoubleByteOperation::Decrease), read);
             default: return nullptr;
         }
     }
 
-    std::shared_ptr<Operations::Operation> Parser::ChooseAluOperation(const uint8_t index, const uint8_t operand) {
-        switch (index) {
-            case 0: return std::make_shared<Operations::AddByte>(this->cpu, this->cpu->A, operand);
-            case 1: return std::make_shared<Operations::AdcByte>(this->cpu, this->cpu->A, operand);
-            case 2: return std::make_shared<Operations::SubByte>(this->cpu, this->cpu->A, operand);
-            case 3: return std::make_shared<Operations::SbcByte>(this->cpu, this->cpu->A, operand);
-            case 4: return std::make_shared<Operations::AndByte>(this->cpu, this->cpu->A, operand);
-            case 5: return std::make_shared<Operations::XorByte>(this->cpu, this->cpu->A, operand);
-            case 6: return std::make_shared<Operations::OrByte>(this->cpu, this->cpu->A, operand);
-            case 7: return std::make_shared<Operations::CpByte>(this->cpu, this->cpu->A, operand);
-            default: return nullptr;
-        }
+    uint8_t* Parser::ChooseMemoryOperand(Operations::Instruction& instruction, const uint16_t address, const bool read) {
+        instruction.memory_address = address;
+        // reading an I/O register may have side effects
+        instruction.memory_operand = read ? this->cpu->bus->Read(address) : 0;
+        return &instruction.memory_operand;
     }
 
-    uint8_t* Parser::ChooseStackDoubleByte(const uint8_t index) {
+    Operations::Operation* Parser::ChooseAluOperation(Operations::Instruction& instruction, const uint8_t extra_steps, const uint8_t index, const uint8_t operand) {
         switch (index) {
-            case 0: return &this->cpu->B;
-            case 1: return &this->cpu->C;
-            case 2: return &this->cpu->D;
-            case 3: return &this->cpu->E;
-            case 4: return &this->cpu->H;
-            case 5: return &this->cpu->L;
-            case 6: return &this->cpu->A;
-            case 7: return &this->cpu->F;
+            case 0: return instruction.Emplace<Operations::AddByte>(extra_steps, this->cpu, this->cpu->state->A, operand);
+            case 1: return instruction.Emplace<Operations::AdcByte>(extra_steps, this->cpu, this->cpu->state->A, operand);
+            case 2: return instruction.Emplace<Operations::SubByte>(extra_steps, this->cpu, this->cpu->state->A, operand);
+            case 3: return instruction.Emplace<Operations::SbcByte>(extra_steps, this->cpu, this->cpu->state->A, operand);
+            case 4: return instruction.Emplace<Operations::AndByte>(extra_steps, this->cpu, this->cpu->state->A, operand);
+            case 5: return instruction.Emplace<Operations::XorByte>(extra_steps, this->cpu, this->cpu->state->A, operand);
+            case 6: return instruction.Emplace<Operations::OrByte>(extra_steps, this->cpu, this->cpu->state->A, operand);
+            case 7: return instruction.Emplace<Operations::CpByte>(extra_steps, this->cpu, this->cpu->state->A, operand);
             default: return nullptr;
         }
     }
@@ -77,175 +67,126 @@ namespace Cpu {
         }
     }
 
-    std::shared_ptr<Operations::Instruction> Parser::Parse(const uint8_t opcode, std::shared_ptr<uint8_t[]> args) {
-        uint8_t upper_hb = opcode >> 4;
-        uint8_t lower_hb = opcode & 0x0F;
-        printf("%02x %02x %02x\n", opcode, args[0], args[1]);
-
-        if (upper_hb < 0x04) {
-            switch (opcode) {
-                // NOP
-                case 0x00:
-                    return nullptr; // to be implemented
-                // LD (u16),SP
-                case 0x08:
-                    return std::make_shared<Operations::Instruction>(
-                        std::make_shared<Operations::StoreDoubleByte>(
-                            this->cpu,
-                            Helpers::JoinBytes(args[0], args[1]),
-                            this->cpu->S,
-                            this->cpu->P),
-                        opcode, args, 3);
-                // STOP
-                case 0x10:
-                    return nullptr; // to be implemented
-            }
-            switch (lower_hb) {
-                // LD rr,u16
-                case 0x01:
-                    return std::make_shared<Operations::Instruction>(
-                        std::make_shared<Operations::LoadDoubleByte>(
-                            this->cpu,
-                            *this->ChooseOperandDoubleByte(2 * upper_hb),
-                            *this->ChooseOperandDoubleByte(2 * upper_hb + 1),
-                            args[0],
-                            args[1]),
-                        opcode, args, 1);
-                // LD (rr),A
-                case 0x02:
-                    return std::make_shared<Operations::Instruction>(
-                        std::make_shared<Operations::LoadByte>(
-                            this->cpu,
-                            *this->ChooseDereference(upper_hb),
-                            this->cpu->A),
-                        opcode, args, 1);
-                // LD A,(rr)
-                case 0x0A:
-                    return std::make_shared<Operations::Instruction>(
-                        std::make_shared<Operations::LoadByte>(
-                            this->cpu,
-                            this->cpu->A,
-                            *this->ChooseDereference(upper_hb)),
-                        opcode, args, 1);
-                // INC rr
-                case 0x03:
-                    return std::make_shared<Operations::Instruction>(
-                        std::make_shared<Operations::IncreaseDoubleByte>(
-                            this->cpu,
-                            *this->ChooseOperandDoubleByte(2 * upper_hb),
-                            *this->ChooseOperandDoubleByte(2 * upper_hb + 1)),
-                        opcode, args, 0);
-                // ADD rr,rr
-                case 0x09:
-                    return std::make_shared<Operations::Instruction>(
-                        std::make_shared<Operations::AddDoubleByte>(
-                            this->cpu,
-                            this->cpu->H,
-                            this->cpu->L,
-                            *this->ChooseOperandDoubleByte(2 * upper_hb),
-                            *this->ChooseOperandDoubleByte(2 * upper_hb + 1)),
-                        opcode, args, 0);
-                // DEC rr
-                case 0x0B:
-                    return std::make_shared<Operations::Instruction>(
-                        std::make_shared<Operations::DecreaseDoubleByte>(
-                            this->cpu,
-                            *this->ChooseOperandDoubleByte(2 * upper_hb),
-                            *this->ChooseOperandDoubleByte(2 * upper_hb + 1)),
-                        opcode, args, 0);
-            }
-            switch (lower_hb % 8) {
-                case 0x00:
-                    // JR i8
-                    if (upper_hb < 0x02)
-                        return std::make_shared<Operations::Instruction>(
-                            std::make_shared<Operations::JumpRelative>(
-                                this->cpu,
-                                args[0]),
-                        opcode, args, 2);
-                    // JR [cnd] i8
-                    else
-                        return std::make_shared<Operations::Instruction>(
-                            std::make_shared<Operations::JumpRelativeConditional>(
-                                this->cpu,
-                                args[0],
-                                this->ChooseFlag(upper_hb - 2),
-                                lower_hb == 0x08),
-                        opcode, args, 1);
-                // INC r
-                case 0x04:
-                    return std::make_shared<Operations::Instruction>(
-                        std::make_shared<Operations::IncreaseByte>(
-                            this->cpu,
-                            *this->ChooseOperandByte((opcode - 4) >> 3)),
-                        opcode, args, 2 * (opcode == 0x34));
-                // DEC r
-                case 0x05:
-                    return std::make_shared<Operations::Instruction>(
-                        std::make_shared<Operations::DecreaseByte>(
-                            this->cpu,
-                            *this->ChooseOperandByte((opcode - 5) >> 3)),
-                        opcode, args, 2 * (opcode == 0x35));
-                // LD r,u8
-                case 0x06:
-                    return std::make_shared<Operations::Instruction>(
-                        std::make_shared<Operations::LoadByte>(
-                            this->cpu,
-                            *this->ChooseOperandByte((opcode - 6) >> 3),
-                            args[0]),
-                        opcode, args, opcode == 0x36);
-                case 0x07:
-                    // RLCA / RRCA
-                    if (upper_hb < 0x01)
-                        return std::make_shared<Operations::Instruction>(
-                            std::make_shared<Operations::RotateByte>(
-                                this->cpu,
-                                this->cpu->A,
-                                static_cast<Operations::ShiftDirection>(lower_hb == 0x07),
-                                1),
-                            opcode, args, 0);
-            }
-        } else if (upper_hb < 0x08 && opcode != 0x76) {
-            // LD r,r
-            return std::make_shared<Operations::Instruction>(
-                std::make_shared<Operations::LoadByte>(
-                    this->cpu,
-                    *this->ChooseOperandByte(((opcode - (lower_hb % 8)) >> 3) % 8),
-                    *this->ChooseOperandByte(lower_hb % 8)),
-                opcode, args, ((lower_hb % 8) == 6) || (upper_hb == 0x07 && lower_hb < 0x08));
-        } else if (opcode == 0x76) {
-            // HALT: to be implemented
-        } else if (upper_hb < 0x0C) {
-            return std::make_shared<Operations::Instruction>(
-                this->ChooseAluOperation(((opcode - (lower_hb % 8)) >> 3) % 8, *this->ChooseOperandByte(lower_hb % 8)),
-                opcode, args, lower_hb == 0x06);
-        } else {
-            switch (lower_hb) {
-                // POP rr
-                case 0x01:
-                    return std::make_shared<Operations::Instruction>(
-                        std::make_shared<Operations::PopDoubleByte>(
-                            this->cpu,
-                            *this->ChooseStackDoubleByte(2 * (upper_hb - 0xC)),
-                            *this->ChooseStackDoubleByte(2 * (upper_hb - 0xC) + 1)),
-                        opcode, args, 1);
-                // PUSh rr
-                case 0x05:
-                    return std::make_shared<Operations::Instruction>(
-                        std::make_shared<Operations::PushDoubleByte>(
-                            this->cpu,
-                            *this->ChooseStackDoubleByte(2 * (upper_hb - 0xC)),
-                            *this->ChooseStackDoubleByte(2 * (upper_hb - 0xC) + 1)),
-                        opcode, args, 2);
-            }
-            switch (lower_hb % 8) {
-                case 6:
-                    return std::make_shared<Operations::Instruction>(
-                        this->ChooseAluOperation((opcode - 198) >> 3, args[0]),
-                        opcode, args, 1);
-            }
+    uint8_t* Parser::ChooseOperand(Operations::Instruction& instruction, const Decoding::Operand operand, const bool read) {
+        switch (operand) {
+            case Decoding::Operand::IndirectBC:
+            case Decoding::Operand::IndirectDE:
+            case Decoding::Operand::IndirectHLIncrement:
+            case Decoding::Operand::IndirectHLDecrement:
+                return this->ChooseDereference(instruction, (uint8_t) operand - (uint8_t) Decoding::Operand::IndirectBC, read);
+            case Decoding::Operand::Immediate8:
+                return &instruction.args[0];
+            default:
+                if (operand <= Decoding::Operand::A)
+                    return this->ChooseOperandByte(instruction, (uint8_t) operand, read);
+                return nullptr;
         }
+    }
+
+    uint16_t* Parser::ChooseOperandPair(const Decoding::Operand operand) {
+        if (operand == Decoding::Operand::AF)
+            return &this->cpu->state->AF;
+        return this->ChooseOperandDoubleByte((uint8_t) operand - (uint8_t) Decoding::Operand::BC);
+    }
+
+    Operations::Operation* Parser::BuildLoadByte(Operations::Instruction& instruction, const Decoding::OpcodeInfo& info) {
+        return instruction.Emplace<Operations::LoadByte>(
+            info.extra_steps,
+            this->cpu,
+            *this->ChooseOperand(instruction, info.dst, false),
+            *this->ChooseOperand(instruction, info.src, true));
+    }
+
+    Operations::Operation* Parser::BuildLoadDoubleByte(Operations::Instruction& instruction, const Decoding::OpcodeInfo& info) {
+        return instruction.Emplace<Operations::LoadDoubleByte>(
+            info.extra_steps,
+            this->cpu,
+            *this->ChooseOperandPair(info.dst),
+            Helpers::JoinBytes(instruction.args[0], instruction.args[1]));
+    }
+
+    Operations::Operation* Parser::BuildStoreDoubleByte(Operations::Instruction& instruction, const Decoding::OpcodeInfo& info) {
+        return instruction.Emplace<Operations::StoreDoubleByte>(
+            info.extra_steps,
+            this->cpu,
+            Helpers::JoinBytes(instruction.args[0], instruction.args[1]),
+            this->cpu->state->SP);
+    }
+
+    Operations::Operation* Parser::BuildIncreaseByte(Operations::Instruction& instruction, const Decoding::OpcodeInfo& info) {
+        return instruction.Emplace<Operations::IncreaseByte>(
+            info.extra_steps,
+            this->cpu,
+            *this->ChooseOperand(instruction, info.dst, true));
+    }
+
+    Operations::Operation* Parser::BuildDecreaseByte(Operations::Instruction& instruction, const Decoding::OpcodeInfo& info) {
+        return instruction.Emplace<Operations::DecreaseByte>(
+            info.extra_steps,
+            this->cpu,
+            *this->ChooseOperand(instruction, info.dst, true));
+    }
+
+    Operations::Operation* Parser::BuildIncreaseDoubleByte(Operations::Instruction& instruction, const Decoding::OpcodeInfo& info) {
+        return instruction.Emplace<Operations::IncreaseDoubleByte>(info.extra_steps, this->cpu, *this->ChooseOperandPair(info.dst));
+    }
+
+    Operations::Operation* Parser::BuildDecreaseDoubleByte(Operations::Instruction& instruction, const Decoding::OpcodeInfo& info) {
+        return instruction.Emplace<Operations::DecreaseDoubleByte>(info.extra_steps, this->cpu, *this->ChooseOperandPair(info.dst));
+    }
+
+    Operations::Operation* Parser::BuildAddDoubleByte(Operations::Instruction& instruction, const Decoding::OpcodeInfo& info) {
+        return instruction.Emplace<Operations::AddDoubleByte>(
+            info.extra_steps,
+            this->cpu,
+            this->cpu->state->HL,
+            *this->ChooseOperandPair(info.src));
+    }
+
+    Operations::Operation* Parser::BuildRotateAccumulator(Operations::Instruction& instruction, const Decoding::OpcodeInfo& info) {
+        return instruction.Emplace<Operations::RotateByte>(
+            info.extra_steps,
+            this->cpu,
+            this->cpu->state->A,
+            static_cast<Operations::ShiftDirection>(info.index),
+            1);
+    }
+
+    Operations::Operation* Parser::BuildAlu(Operations::Instruction& instruction, const Decoding::OpcodeInfo& info) {
+        return this->ChooseAluOperation(instruction, info.extra_steps, info.index, *this->ChooseOperand(instruction, info.src, true));
+    }
+
+    Operations::Operation* Parser::BuildPopDoubleByte(Operations::Instruction& instruction, const Decoding::OpcodeInfo& info) {
+        // F is accessed directly as a byte, so pending lazy flags must be written back first
+        if (info.dst == Decoding::Operand::AF)
+            this->cpu->MaterializeFlags();
+        return instruction.Emplace<Operations::PopDoubleByte>(info.extra_steps, this->cpu, *this->ChooseOperandPair(info.dst));
+    }
+
+    Operations::Operation* Parser::BuildPushDoubleByte(Operations::Instruction& instruction, const Decoding::OpcodeInfo& info) {
+        if (info.dst == Decoding::Operand::AF)
+            this->cpu->MaterializeFlags();
+        return instruction.Emplace<Operations::PushDoubleByte>(info.extra_steps, this->cpu, *this->ChooseOperandPair(info.dst));
+    }
+
+    Operations::Operation* Parser::BuildJumpRelative(Operations::Instruction& instruction, const Decoding::OpcodeInfo& info) {
+        return instruction.Emplace<Operations::JumpRelative>(info.extra_steps, this->cpu, instruction.args[0]);
+    }
+
+    Operations::Operation* Parser::BuildJumpRelativeConditional(Operations::Instruction& instruction, const Decoding::OpcodeInfo& info) {
+        uint8_t condition = (uint8_t) info.dst - (uint8_t) Decoding::Operand::NotZero;
+        return instruction.Emplace<Operations::JumpRelativeConditional>(
+            info.extra_steps,
+            this->cpu,
+            instruction.args[0],
+            this->ChooseFlag(condition >> 1),
+            condition & 0x01);
+    }
 
-        return nullptr;
+    Operations::Operation* Parser::Parse(Operations::Instruction& instruction) {
+        const Decoding::OpcodeInfo& info = *instruction.info;
+        if (info.handler == nullptr)
+            return nullptr;
+        return (this->*info.handler)(instruction, info);
     }
 }
@@ -1,23 +1,53 @@
 #pragma once
 #include <cstdint>
-#include <memory>
 #include "helpers.hpp"
 #include "operations.hpp"
 
 namespace Cpu {
     class Cpu;
 
+    namespace Decoding {
+        enum class Operand : uint8_t;
+        struct OpcodeInfo;
+    }
+
     class Parser {
     public:
         Cpu* const cpu;
 
         Parser(Cpu* const cpu);
-        uint8_t* ChooseOperandByte(const uint8_t index);
-        uint8_t* ChooseOperandDoubleByte(const uint8_t index);
-        uint8_t* ChooseDereference(const uint8_t index);
-        std::shared_ptr<Operations::Operation> ChooseAluOperation(const uint8_t index, const uint8_t operand);
-        uint8_t* ChooseStackDoubleByte(const uint8_t index);
+        uint8_t* ChooseOperandByte(Operations::Instruction& instruction, const uint8_t index, const bool read);
+        uint16_t* ChooseOperandDoubleByte(const uint8_t index);
+        uint8_t* ChooseDereference(Operations::Instruction& instruction, const uint8_t index, const bool read);
+        /// Points the memory operand of the instruction at address, to be operated on and written back.
+        /// The byte there is read into it unless the operand is only written to.
+        uint8_t* ChooseMemoryOperand(Operations::Instruction& instruction, const uint16_t address, const bool read);
+        Operations::Operation* ChooseAluOperation(Operations::Instruction& instruction, const uint8_t extra_steps, const uint8_t index, const uint8_t operand);
         Flag ChooseFlag(const uint8_t index);
-        std::shared_ptr<Operations::Instruction> Parse(const uint8_t opcode, std::shared_ptr<uint8_t[]> args);
+        /// Resolves an 8-bit operand selector to a register, memory location or argument.
+        /// Memory is not read when read is false, e.g. for the destination of a load.
+        uint8_t* ChooseOperand(Operations::Instruction& instruction, const Decoding::Operand operand, const bool read);
+        /// Resolves a 16-bit operand selector to a register pair.
+        uint16_t* ChooseOperandPair(const Decoding::Operand operand);
+
+        // handlers referenced by the decoding tables, see decoding.hpp
+        Operations::Operation* BuildLoadByte(Operations::Instruction& instruction, const Decoding::OpcodeInfo& info);
+        Operations::Operation* BuildLoadDoubleByte(Operations::Instruction& instruction, const Decoding::OpcodeInfo& info);
+        Operations::Operation* BuildStoreDoubleByte(Operations::Instruction& instruction, const Decoding::OpcodeInfo& info);
+        Operations::Operation* BuildIncreaseByte(Operations::Instruction& instruction, const Decoding::OpcodeInfo& info);
+        Operations::Operation* BuildDecreaseByte(Operations::Instruction& instruction, const Decoding::OpcodeInfo& info);
+        Operations::Operation* BuildIncreaseDoubleByte(Operations::Instruction& instruction, const Decoding::OpcodeInfo& info);
+        Operations::Operation* BuildDecreaseDoubleByte(Operations::Instruction& instruction, const Decoding::OpcodeInfo& info);
+        Operations::Operation* BuildAddDoubleByte(Operations::Instruction& instruction, const Decoding::OpcodeInfo& info);
+        Operations::Operation* BuildRotateAccumulator(Operations::Instruction& instruction, const Decoding::OpcodeInfo& info);
+        Operations::Operation* BuildAlu(Operations::Instruction& instruction, const Decoding::OpcodeInfo& info);
+        Operations::Operation* BuildPopDoubleByte(Operations::Instruction& instruction, const Decoding::OpcodeInfo& info);
+        Operations::Operation* BuildPushDoubleByte(Operations::Instruction& instruction, const Decoding::OpcodeInfo& info);
+        Operations::Operation* BuildJumpRelative(Operations::Instruction& instruction, const Decoding::OpcodeInfo& info);
+        Operations::Operation* BuildJumpRelativeConditional(Operations::Instruction& instruction, const Decoding::OpcodeInfo& info);
+
+        /// Builds the operation for the instruction's opcode and arguments in-place.
+        /// Returns nullptr if the opcode is not implemented.
+        Operations::Operation* Parse(Operations::Instruction& instruction);
     };
 }
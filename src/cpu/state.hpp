@@ -0,0 +1,69 @@
+#pragma once
+#include <cstdint>
+
+// flags of ALU operations are computed when read, rather than when set
+#ifndef GBEMU_LAZY_FLAGS
+#define GBEMU_LAZY_FLAGS 1
+#endif
+
+// a register pair, accessible both as a 16-bit value and as its two 8-bit halves,
+// the halves laid out in host byte order so the 16-bit view needs no conversion
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#define GBEMU_REGISTER_PAIR(upper, lower) union { uint16_t upper##lower; struct { uint8_t upper, lower; }; }
+#else
+#define GBEMU_REGISTER_PAIR(upper, lower) union { uint16_t upper##lower; struct { uint8_t lower, upper; }; }
+#endif
+
+namespace Cpu {
+    enum class Flag : uint8_t {
+        z = 0x80,
+        n = 0x40,
+        h = 0x20,
+        c = 0x10
+    };
+
+    /// How to derive the flags from a recorded ALU operation. XOR shares the flags of OR.
+    enum class FlagOperation : uint8_t {
+        None,
+        Add,
+        Subtract,
+        And,
+        Or,
+        Increase,
+        Decrease
+    };
+
+    /// The last ALU operation, from which F is computed when needed.
+    struct LazyFlags {
+        FlagOperation operation;  // None: F is up to date
+        uint8_t operand;          // destination value before the operation
+        uint8_t source;
+        uint8_t carry;            // carry in for ADC / SBC
+        uint8_t result;
+        // INC / DEC keep c: the operation that set it, its operand, source and carry left as they were, None if in F
+        FlagOperation carry_operation;
+    };
+
+    /**
+     * Registers and counters of the CPU: everything that Run changes besides memory and caches.
+     * Trivially copyable, so that it lives in the arena of an instance (see Arena) and is saved
+     * and restored along with it. Compiled blocks address it directly, see Jit::NativeBlock.
+     */
+    struct State {
+        GBEMU_REGISTER_PAIR(A, F);
+        GBEMU_REGISTER_PAIR(B, C);
+        GBEMU_REGISTER_PAIR(D, E);
+        GBEMU_REGISTER_PAIR(H, L);
+        GBEMU_REGISTER_PAIR(S, P);
+        uint16_t PC;
+        /// Set when the running block must be left after the current instruction.
+        bool block_exit;
+        LazyFlags lazy_flags;
+        /// M-cycles elapsed since power on.
+        uint64_t cycles;
+        /// Instructions executed by Run().
+        uint64_t instructions;
+        /// M-cycles peripherals have been ticked up to.
+        uint64_t peripherals_cycles;
+    };
+}
@@ -0,0 +1,86 @@
+#pragma once
+#include <cstddef>
+#include <cstdlib>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define GBEMU_ZEROED_MMAP 1
+#include <sys/mman.h>
+#include <unistd.h>
+#else
+#define GBEMU_ZEROED_MMAP 0
+#endif
+
+namespace Cpu {
+    /// Frees an array from AllocateZeroed: mapped arrays remember their size, 0 for those from std::calloc.
+    struct ZeroedDeleter {
+        size_t mapped_size = 0;
+
+        void operator()(void* const pointer) const {
+#if GBEMU_ZEROED_MMAP
+            if (this->mapped_size != 0) {
+                munmap(pointer, this->mapped_size);
+                return;
+            }
+#endif
+            std::free(pointer);
+        }
+    };
+
+    /// An array allocated zeroed, see AllocateZeroed.
+    template <typename T>
+    using ZeroedArray = std::unique_ptr<T[], ZeroedDeleter>;
+
+    /// Arrays from this size on are mapped rather than allocated.
+    constexpr size_t zeroed_mapping_size = 64 * 1024;
+
+    /**
+     * Returns count zeroed elements. Unlike new T[count](), large arrays are not written to:
+     * they are mapped to fresh pages from the OS, zeroed on first access, so allocating the
+     * caches of a new Cpu costs nothing until they are used. std::calloc alone does not
+     * ensure this: once a large block has been freed, malloc raises its mapping threshold and
+     * calloc clears recycled heap memory instead, megabytes for every Cpu of a clone.
+     */
+    template <typename T>
+    ZeroedArray<T> AllocateZeroed(const size_t count) {
+        static_assert(std::is_trivial_v<T>, "zeroed memory must be a valid T");
+#if GBEMU_ZEROED_MMAP
+        const size_t size = count * sizeof(T);
+        if (size >= zeroed_mapping_size) {
+            void* const memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (memory == MAP_FAILED)
+                throw std::bad_alloc();
+            return ZeroedArray<T>(static_cast<T*>(memory), ZeroedDeleter{ size });
+        }
+#endif
+        T* const pointer = static_cast<T*>(std::calloc(count, sizeof(T)));
+        if (pointer == nullptr)
+            throw std::bad_alloc();
+        return ZeroedArray<T>(pointer);
+    }
+
+    /// Bytes of memory behind array: for a mapped one, only its pages touched so far, where the system tells.
+    template <typename T>
+    size_t ZeroedBytes(const ZeroedArray<T>& array, const size_t count) {
+        const size_t size = count * sizeof(T);
+#if defined(__linux__)
+        const size_t mapped = array.get_deleter().mapped_size;
+        const size_t page = (size_t) sysconf(_SC_PAGESIZE);
+        if (mapped != 0) {
+            std::vector<unsigned char> resident((mapped + page - 1) / page);
+            if (mincore(array.get(), mapped, resident.data()) == 0) {
+                size_t pages = 0;
+                for (const unsigned char flags : resident)
+                    pages += flags & 1;
+                return pages * page;
+            }
+        }
+#else
+        (void) array;
+#endif
+        return size;
+    }
+}
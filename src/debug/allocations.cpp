@@ -0,0 +1,42 @@
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+#include "allocations.hpp"
+
+namespace Debug {
+    std::atomic<uint64_t> allocation_count { 0 };
+
+    uint64_t AllocationCount() {
+        return allocation_count.load(std::memory_order_relaxed);
+    }
+}
+
+// replace the global allocation functions to count calls,
+// the nothrow overloads forward to these by default
+void* operator new(std::size_t size) {
+    Debug::allocation_count.fetch_add(1, std::memory_order_relaxed);
+    if (void* pointer = std::malloc(size ? size : 1))
+        return pointer;
+    throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size) {
+    return operator new(size);
+}
+
+void operator delete(void* pointer) noexcept {
+    std::free(pointer);
+}
+
+void operator delete[](void* pointer) noexcept {
+    std::free(pointer);
+}
+
+void operator delete(void* pointer, std::size_t) noexcept {
+    std::free(pointer);
+}
+
+void operator delete[](void* pointer, std::size_t) noexcept {
+    std::free(pointer);
+}
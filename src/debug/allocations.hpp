@@ -0,0 +1,9 @@
+#pragma once
+#include <cstdint>
+
+namespace Debug {
+
+    /// Returns the number of heap allocations made by the process so far.
+    uint64_t AllocationCount();
+
+}
@@ -0,0 +1,44 @@
+#include "checks.hpp"
+#include "frames.hpp"
+#include "handlers.hpp"
+#include "jit.hpp"
+#include "tiles.hpp"
+#include "timing.hpp"
+#include "../ppu/tiles.hpp"
+
+namespace Debug {
+
+    /// A self-check, printing its report to file. Returns the number of mismatches.
+    struct Check {
+        const char* name;
+        uint32_t (*Run)(std::FILE* const file);
+    };
+
+    const Check checks[] = {
+        { "handlers", [](std::FILE* const) { return CompareHandlers(64); } },
+        { "tile kernels", [](std::FILE* const file) {
+            const uint32_t mismatches = CompareTileKernels(16);
+            std::fprintf(file, "using %s\n", Ppu::Tiles::Select().name);
+            BenchmarkTileKernels(file);
+            return mismatches;
+        } },
+        { "frame hashes", &CheckFrameHashes },
+        { "I/O timing", &CheckTiming },
+        { "JIT", [](std::FILE* const file) {
+            const uint32_t mismatches = CompareJit(64, file);
+            BenchmarkJit(file);
+            return mismatches;
+        } },
+    };
+
+    uint32_t RunChecks(std::FILE* const file) {
+        uint32_t failed = 0;
+        for (const Check& check : checks) {
+            const uint32_t mismatches = check.Run(file);
+            std::fprintf(file, "%s: %u mismatches\n", check.name, mismatches);
+            failed += mismatches != 0;
+        }
+        return failed;
+    }
+
+}
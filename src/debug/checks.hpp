@@ -0,0 +1,15 @@
+#pragma once
+#include <cstdint>
+#include <cstdio>
+
+namespace Debug {
+
+    /**
+     * Runs every self-check without a window or a ROM: opcode handlers against the reference operations,
+     * SIMD tile kernels against the scalar ones, frame hashes of both PPU renderers, and the M-cycle I/O
+     * registers are read at by each way of running code, and compiled blocks against the interpreter. Prints
+     * a line per check to file, along with the tile kernel and JIT benchmarks. Returns the number of checks that failed.
+     */
+    uint32_t RunChecks(std::FILE* const file);
+
+}
@@ -0,0 +1,164 @@
+#include <memory>
+
+#include "frames.hpp"
+#include "../arena.hpp"
+#include "../cpu/cpu.hpp"
+
+namespace Debug {
+
+    /// A picture drawn from power on, with the LCD off until Setup turns it on.
+    struct Scene {
+        const char* name;
+        /// Fills VRAM, OAM and registers, LCDC last.
+        void (*Setup)(Memory::Bus* const bus);
+        /// Called at M-cycle raster_cycle of each visible line, nullptr for static scenes.
+        void (*Raster)(Memory::Bus* const bus, const uint8_t line);
+        uint32_t raster_cycle;
+        /// Expected hashes of the second frame, by Ppu::Renderer.
+        uint64_t hashes[2];
+    };
+
+    /// Tiles, both tile maps and palettes, from fixed patterns.
+    void Fill(Memory::Bus* const bus) {
+        for (uint32_t i = 0; i < 0x1800; i++)
+            bus->Write(0x8000 + i, (i * 37 + (i >> 4) * 11) ^ (i >> 7));
+        for (uint32_t i = 0; i < 0x800; i++)
+            bus->Write(0x9800 + i, i * 7 + (i >> 5) * 3);
+        bus->Write(0xFF47, 0xE4);
+        bus->Write(0xFF48, 0xD2);
+        bus->Write(0xFF49, 0x1B);
+    }
+
+    /// 40 sprites, some overlapping, partly offscreen or more than 10 on a line, with every flag combination.
+    void FillOam(Memory::Bus* const bus) {
+        for (uint32_t i = 0; i < 40; i++) {
+            bus->Write(0xFE00 + i * 4, i < 12 ? 16 + 60 : (i * 29) % 170);
+            bus->Write(0xFE01 + i * 4, i < 12 ? i * 13 : (i * 53) % 176);
+            bus->Write(0xFE02 + i * 4, i * 5);
+            bus->Write(0xFE03 + i * 4, (i & 0x0F) << 4);
+        }
+    }
+
+    const Scene scenes[] = {
+        { "background", [](Memory::Bus* const bus) {
+            Fill(bus);
+            bus->Write(0xFF42, 37);
+            bus->Write(0xFF43, 13);
+            bus->Write(0xFF40, 0x91);
+        }, nullptr, 0, { 0xB35D588BFDB05189, 0xB35D588BFDB05189 } },
+        { "signed tiles", [](Memory::Bus* const bus) {
+            Fill(bus);
+            bus->Write(0xFF43, 4);
+            bus->Write(0xFF40, 0x89);
+        }, nullptr, 0, { 0xA335E73191817297, 0xA335E73191817297 } },
+        { "window", [](Memory::Bus* const bus) {
+            Fill(bus);
+            bus->Write(0xFF43, 3);
+            bus->Write(0xFF4A, 40);
+            bus->Write(0xFF4B, 47);
+            bus->Write(0xFF40, 0xF1);
+        }, nullptr, 0, { 0x739094A875D0D75A, 0x739094A875D0D75A } },
+        { "window left of the screen", [](Memory::Bus* const bus) {
+            Fill(bus);
+            bus->Write(0xFF4A, 0);
+            bus->Write(0xFF4B, 3);
+            bus->Write(0xFF40, 0xB1);
+        }, nullptr, 0, { 0x41D3CB6D2A097387, 0x41D3CB6D2A097387 } },
+        { "sprites", [](Memory::Bus* const bus) {
+            Fill(bus);
+            FillOam(bus);
+            bus->Write(0xFF43, 5);
+            bus->Write(0xFF40, 0x93);
+        }, nullptr, 0, { 0xC098DBB8857BFFEA, 0xC098DBB8857BFFEA } },
+        { "8x16 sprites and window", [](Memory::Bus* const bus) {
+            Fill(bus);
+            FillOam(bus);
+            bus->Write(0xFF4A, 90);
+            bus->Write(0xFF4B, 100);
+            bus->Write(0xFF40, 0xF7);
+        }, nullptr, 0, { 0xE9B4D21D18D7B76D, 0xE9B4D21D18D7B76D } },
+        // raster effects, written outside of mode 3: the same for both renderers
+        { "palette per line", [](Memory::Bus* const bus) {
+            Fill(bus);
+            bus->Write(0xFF40, 0x91);
+        }, [](Memory::Bus* const bus, const uint8_t line) {
+            bus->Write(0xFF47, 0xE4 ^ line);
+        }, 2, { 0x745726D238EA94C9, 0x745726D238EA94C9 } },
+        { "scroll per line", [](Memory::Bus* const bus) {
+            Fill(bus);
+            FillOam(bus);
+            bus->Write(0xFF40, 0x93);
+        }, [](Memory::Bus* const bus, const uint8_t line) {
+            bus->Write(0xFF43, line * 3);
+            bus->Write(0xFF42, line / 5);
+        }, 100, { 0x6D0DAD49DF2A9901, 0x6D0DAD49DF2A9901 } },
+        // written during mode 3: the FIFO only moves the fetch by whole tiles, and shifts pixels out later
+        { "scroll mid-line", [](Memory::Bus* const bus) {
+            Fill(bus);
+            bus->Write(0xFF40, 0x91);
+        }, [](Memory::Bus* const bus, const uint8_t line) {
+            bus->Write(0xFF43, line * 11);
+        }, 40, { 0x181F9839FB3FF2AB, 0x925889FDE6F63B75 } },
+        { "palette mid-line", [](Memory::Bus* const bus) {
+            Fill(bus);
+            bus->Write(0xFF40, 0x91);
+        }, [](Memory::Bus* const bus, const uint8_t line) {
+            bus->Write(0xFF47, line & 1 ? 0x1B : 0xE4);
+        }, 30, { 0x6A5F9A4C2D5CAA4C, 0x924D5C85BD4BD74C } },
+    };
+
+    uint64_t HashFrame(const Scene& scene, const Ppu::Renderer renderer) {
+        std::shared_ptr<Arena> arena = std::make_shared<Arena>();
+        Memory::Bus bus(std::shared_ptr<uint8_t[]>(arena, arena->ram), arena->high);
+        Cpu::Cpu cpu(&bus, &arena->cpu);
+        Ppu::Ppu ppu(&cpu, &bus, &arena->ppu, nullptr);
+        ppu.renderer = renderer;
+        scene.Setup(&bus);
+
+        // M-cycles from the LCD being turned on
+        const uint64_t start = cpu.state->cycles;
+        auto run_to = [&](const uint64_t cycle) {
+            cpu.state->cycles = start + cycle;
+            cpu.CatchUp();
+        };
+        constexpr uint32_t frame_cycles = 154 * 114;
+        if (scene.Raster != nullptr) {
+            for (uint32_t frame = 0; frame < 2; frame++) {
+                for (uint8_t line = 0; line < Ppu::height; line++) {
+                    run_to(frame * frame_cycles + line * 114 + scene.raster_cycle);
+                    scene.Raster(&bus, line);
+                }
+            }
+        }
+        // VBlank of the second frame
+        run_to(frame_cycles + Ppu::height * 114);
+
+        // FNV-1a
+        uint64_t hash = 0xCBF29CE484222325;
+        for (uint32_t y = 0; y < Ppu::height; y++) {
+            for (uint32_t x = 0; x < Ppu::width; x++) {
+                hash ^= ppu.framebuffer[y][x];
+                hash *= 0x100000001B3;
+            }
+        }
+        return hash;
+    }
+
+    uint32_t CheckFrameHashes(std::FILE* const file) {
+        const char* const names[2] = { "scanline", "fifo" };
+        uint32_t mismatches = 0;
+        for (const Scene& scene : scenes) {
+            std::fprintf(file, "%-26s", scene.name);
+            for (const Ppu::Renderer renderer : { Ppu::Renderer::Scanline, Ppu::Renderer::Fifo }) {
+                const uint32_t index = (uint32_t) renderer;
+                const uint64_t hash = HashFrame(scene, renderer);
+                const bool expected = hash == scene.hashes[index];
+                mismatches += !expected;
+                std::fprintf(file, " %s %016llX%s", names[index], (unsigned long long) hash, expected ? "" : " (differs)");
+            }
+            std::fprintf(file, "\n");
+        }
+        return mismatches;
+    }
+
+}
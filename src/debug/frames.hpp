@@ -0,0 +1,15 @@
+#pragma once
+#include <cstdint>
+#include <cstdio>
+
+namespace Debug {
+
+    /**
+     * Draws each scene of a fixed set, tile data, maps, sprites and raster effects set up through the bus,
+     * with both PPU renderers, and compares a hash of its second frame with the one expected from each.
+     * Scenes without writes during mode 3 expect the same hash from both. Prints a line per scene to file.
+     * Returns the number of frames whose hash differs.
+     */
+    uint32_t CheckFrameHashes(std::FILE* const file);
+
+}
@@ -0,0 +1,116 @@
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <random>
+
+#include "handlers.hpp"
+#include "../arena.hpp"
+#include "../cpu/cpu.hpp"
+#include "../memory/bus.hpp"
+
+namespace Debug {
+    constexpr uint32_t ram_size = Memory::Bus::ram_size;
+
+    bool SameState(Cpu::Cpu& a, Cpu::Cpu& b) {
+        a.MaterializeFlags();
+        b.MaterializeFlags();
+        const Cpu::State& x = *a.state;
+        const Cpu::State& y = *b.state;
+        return x.AF == y.AF && x.BC == y.BC && x.DE == y.DE && x.HL == y.HL && x.SP == y.SP && x.PC == y.PC
+            && x.block_exit == y.block_exit;
+    }
+
+    bool SameMemory(Memory::Bus& a, Memory::Bus& b) {
+        return std::memcmp(a.ram.get(), b.ram.get(), ram_size) == 0
+            && std::memcmp(a.high.bytes, b.high.bytes, Memory::page_size) == 0;
+    }
+
+    uint32_t CompareHandlers(const uint32_t rounds) {
+        std::mt19937 random(0x5EED);
+        std::shared_ptr<Arena> arenas[3] = { std::make_shared<Arena>(), std::make_shared<Arena>(), std::make_shared<Arena>() };
+        Memory::Bus buses[3] = {
+            { std::shared_ptr<uint8_t[]>(arenas[0], arenas[0]->ram), arenas[0]->high },
+            { std::shared_ptr<uint8_t[]>(arenas[1], arenas[1]->ram), arenas[1]->high },
+            { std::shared_ptr<uint8_t[]>(arenas[2], arenas[2]->ram), arenas[2]->high } };
+        // ROM is read-only: every bus maps the same image
+        std::unique_ptr<uint8_t[]> rom(new uint8_t[Memory::Bus::rom_size]);
+        for (Memory::Bus& bus : buses)
+            bus.MapRom(rom.get(), Memory::Bus::rom_size);
+        Cpu::Cpu reference(&buses[0], &arenas[0]->cpu);
+        Cpu::Cpu handlers(&buses[1], &arenas[1]->cpu);
+        Cpu::Cpu stepped(&buses[2], &arenas[2]->cpu);
+        uint32_t mismatches = 0;
+
+        for (uint32_t page = 0; page < 2; page++) {
+            for (uint32_t opcode = 0; opcode < 256; opcode++) {
+                const Cpu::Decoding::OpcodeInfo& info = page ? Cpu::Decoding::cb_opcodes[opcode] : Cpu::Decoding::opcodes[opcode];
+                const Cpu::Handlers::Executor execute = Cpu::Handlers::Lookup<Cpu::Accuracy::InstructionGranular>(info);
+                const Cpu::Handlers::Executor execute_stepped = Cpu::Handlers::Lookup<Cpu::Accuracy::MCycle>(info);
+                if ((execute == nullptr) != (info.handler == nullptr) || (execute_stepped == nullptr) != (info.handler == nullptr)) {
+                    std::fprintf(stderr, "%s%02X: implemented by only one of handlers and operations\n", page ? "CB " : "", opcode);
+                    mismatches++;
+                    continue;
+                }
+                if (execute == nullptr)
+                    continue;
+
+                for (uint32_t round = 0; round < rounds; round++) {
+                    for (uint32_t i = 0; i < Memory::Bus::rom_size; i++)
+                        rom[i] = random();
+                    for (uint32_t i = 0; i < ram_size; i++)
+                        buses[0].ram[i] = random();
+                    for (uint32_t i = 0; i < Memory::page_size; i++)
+                        buses[0].high.bytes[i] = random();
+                    for (uint32_t i = 1; i < 3; i++) {
+                        std::memcpy(buses[i].ram.get(), buses[0].ram.get(), ram_size);
+                        std::memcpy(buses[i].high.bytes, buses[0].high.bytes, Memory::page_size);
+                    }
+
+                    Cpu::Cpu* const cpus[3] = { &reference, &handlers, &stepped };
+                    const uint16_t registers[6] = {
+                        (uint16_t) random(), (uint16_t) random(), (uint16_t) random(),
+                        (uint16_t) random(), (uint16_t) random(), (uint16_t) random() };
+                    for (Cpu::Cpu* const cpu : cpus) {
+                        cpu->state->lazy_flags.operation = Cpu::FlagOperation::None;
+                        cpu->state->block_exit = false;
+                        cpu->state->AF = registers[0] & 0xFFF0;
+                        cpu->state->BC = registers[1];
+                        cpu->state->DE = registers[2];
+                        cpu->state->HL = registers[3];
+                        cpu->state->SP = registers[4];
+                        // as in Cpu::Cycle, PC already points past the instruction
+                        cpu->state->PC = registers[5] + info.length;
+                    }
+
+                    Cpu::Operations::Instruction& instruction = reference.instruction;
+                    instruction.opcode = page ? 0xCB : opcode;
+                    instruction.args[0] = page ? opcode : random();
+                    instruction.args[1] = random();
+                    instruction.info = &info;
+                    reference.parser->Parse(instruction);
+                    instruction.Execute();
+                    const bool reference_branch = instruction.operation->branch;
+                    const bool handlers_branch = execute(&handlers, instruction.args);
+                    stepped.steps = 0;
+                    const bool stepped_branch = execute_stepped(&stepped, instruction.args);
+
+                    if (reference_branch != handlers_branch || !SameState(reference, handlers) || !SameMemory(buses[0], buses[1])) {
+                        std::fprintf(stderr, "%s%02X: %s differs from its reference operation\n", page ? "CB " : "", opcode, info.mnemonic);
+                        mismatches++;
+                        break;
+                    }
+                    // its accesses fit in the M-cycles left after fetching the opcode and arguments
+                    const uint8_t total = stepped_branch ? info.cycles_branch : info.cycles;
+                    if (stepped_branch != handlers_branch || !SameState(stepped, handlers) || !SameMemory(buses[2], buses[1])
+                        || stepped.steps + info.length > total) {
+                        std::fprintf(stderr, "%s%02X: %s differs when stepped\n", page ? "CB " : "", opcode, info.mnemonic);
+                        mismatches++;
+                        break;
+                    }
+                }
+            }
+        }
+
+        return mismatches;
+    }
+}
@@ -0,0 +1,14 @@
+#pragma once
+#include <cstdint>
+
+namespace Debug {
+
+    /**
+     * Runs every implemented opcode, with random registers, memory and arguments,
+     * through its Cpu::Handlers executor, its executor for Accuracy::MCycle, and the Operation
+     * built by the Parser.
+     * Returns the number of runs whose registers, memory or branch differ.
+     */
+    uint32_t CompareHandlers(const uint32_t rounds);
+
+}
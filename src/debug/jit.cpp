@@ -0,0 +1,167 @@
+#include <chrono>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include "jit.hpp"
+#include "../arena.hpp"
+#include "../cpu/cpu.hpp"
+
+namespace Debug {
+
+    /**
+     * A CPU with its own memory, running a program from ROM or from WRAM. The blocks of the
+     * first size bytes are translated up front, and compiled rather than after
+     * Jit::Compiler::threshold runs, which few of them would reach: blocks, and so the
+     * instructions a run of RunBlocks stops after, are the same with or without the JIT.
+     */
+    struct Machine {
+        std::shared_ptr<Arena> arena;
+        Memory::Bus bus;
+        Cpu::Cpu cpu;
+
+        Machine(const std::vector<uint8_t>& rom, const std::vector<uint8_t>& wram, const uint32_t size, const bool jit)
+            : arena(std::make_shared<Arena>()), bus(std::shared_ptr<uint8_t[]>(this->arena, this->arena->ram), this->arena->high),
+              cpu(&this->bus, &this->arena->cpu) {
+            this->bus.MapRom(rom.data(), rom.size());
+            for (uint32_t i = 0; i < wram.size(); i++)
+                this->bus.Write(0xC000 + i, wram[i]);
+            this->cpu.jit_enabled &= jit;
+            this->cpu.state->PC = wram.empty() ? 0x0000 : 0xC000;
+            this->cpu.state->SP = 0xDFF0;
+            this->cpu.state->HL = 0xC100;
+            this->cpu.state->BC = 0xC200;
+            this->cpu.state->DE = 0xD000;
+            for (uint32_t address = this->cpu.state->PC; address < this->cpu.state->PC + size;) {
+                Cpu::Block* const block = this->cpu.blocks.Translate(&this->cpu, address);
+                if (this->cpu.jit_enabled)
+                    this->cpu.jit.Compile(&this->cpu, *block);
+                address = block->end;
+            }
+        }
+
+        /// Registers, cycle counter and memory from 8000 on, as a hash.
+        uint64_t Hash() {
+            this->cpu.MaterializeFlags();
+            const Cpu::State& state = *this->cpu.state;
+            uint64_t hash = 0xCBF29CE484222325;
+            for (const uint64_t value : { (uint64_t) state.AF, (uint64_t) state.BC, (uint64_t) state.DE, (uint64_t) state.HL,
+                                          (uint64_t) state.SP, (uint64_t) state.PC, state.cycles })
+                hash = (hash ^ value) * 0x100000001B3;
+            for (uint32_t address = 0x8000; address < 0x10000; address++)
+                hash = (hash ^ this->bus.Read(address)) * 0x100000001B3;
+            return hash;
+        }
+    };
+
+    // instructions with no arguments the programs are made of: ALU, INC and DEC, loads and stores
+    // through BC, DE, HL, HL+ and HL-, including those that move HL itself
+    constexpr uint8_t plain_opcodes[] = {
+        0x80, 0x81, 0x88, 0x89, 0x8F, 0x90, 0x91, 0x98, 0x9A, 0xBB, 0xB8, 0xA0, 0xB0, 0xA8, 0x97, 0x87, 0x9F, 0xBF,
+        0x04, 0x05, 0x0C, 0x0D, 0x3C, 0x3D, 0x14, 0x1D, 0x24, 0x2D, 0x03, 0x0B, 0x23, 0x2B, 0x07, 0x0F, 0x41, 0x78,
+        0x02, 0x12, 0x0A, 0x1A, 0x22, 0x2A, 0x32, 0x3A, 0x70, 0x71, 0x72, 0x73, 0x74, 0x75, 0x77,
+        0x46, 0x4E, 0x56, 0x5E, 0x66, 0x6E, 0x7E, 0x86, 0x8E, 0x96, 0x9E, 0xA6, 0xAE, 0xB6, 0xBE
+    };
+
+    /// A random program of size bytes: plain instructions, immediates, pointers to WRAM, HRAM or I/O registers, and short loops.
+    std::vector<uint8_t> Program(std::mt19937& random, const uint32_t size) {
+        std::vector<uint8_t> program(size);
+        uint32_t pc = 0;
+        while (pc + 3 <= size) {
+            const uint32_t kind = random() % 16;
+            if (kind < 11) {
+                program[pc++] = plain_opcodes[random() % sizeof(plain_opcodes)];
+            } else if (kind < 13) {
+                // LD r,u8 / LD (HL),u8 / ALU A,u8
+                constexpr uint8_t opcodes[] = { 0x06, 0x0E, 0x3E, 0x36, 0xC6, 0xCE, 0xD6, 0xDE, 0xFE };
+                program[pc++] = opcodes[random() % sizeof(opcodes)];
+                program[pc++] = random();
+            } else if (kind < 15) {
+                // LD BC / DE / HL,u16, the upper byte first as in Operations::LoadDoubleByte
+                constexpr uint8_t opcodes[] = { 0x01, 0x11, 0x21 };
+                program[pc++] = opcodes[random() % sizeof(opcodes)];
+                program[pc++] = random() % 8 == 0 ? 0xFF : 0xC0 + random() % 0x20;
+                program[pc++] = random();
+            } else {
+                // JR cc back a few bytes, the argument biased as Handlers::JumpRelative expects
+                program[pc++] = 0x20 + (random() % 4) * 8;
+                program[pc++] = 128 + 2 - 1 - random() % 12;
+            }
+        }
+        return program;
+    }
+
+    uint32_t CompareJit(const uint32_t rounds, std::FILE* const file) {
+        std::mt19937 random(0x5EED);
+        uint32_t mismatches = 0;
+        uint64_t compiled = 0;
+        uint64_t chained = 0;
+        for (uint32_t round = 0; round < rounds; round++) {
+            // odd rounds run from WRAM, where stores hit code
+            const bool from_wram = round & 1;
+            std::vector<uint8_t> rom(Memory::Bus::rom_size);
+            std::vector<uint8_t> wram;
+            const uint32_t program_size = from_wram ? 0x1000 : 0x2000;
+            if (from_wram)
+                wram = Program(random, program_size);
+            else
+                rom = Program(random, program_size);
+            rom.resize(Memory::Bus::rom_size);
+
+            Machine interpreted(rom, wram, program_size, false);
+            Machine native(rom, wram, program_size, true);
+            if (!native.cpu.jit_enabled) {
+                std::fprintf(file, "no JIT\n");
+                return 0;
+            }
+            for (uint32_t slice = 0; slice < 200; slice++) {
+                interpreted.cpu.RunBlocks(500);
+                native.cpu.RunBlocks(500);
+                if (interpreted.Hash() != native.Hash()) {
+                    if (mismatches < 8)
+                        std::fprintf(file, "program %u (%s) differs after %u slices, PC %04X\n", round,
+                            from_wram ? "WRAM" : "ROM", slice + 1, native.cpu.state->PC);
+                    mismatches++;
+                    break;
+                }
+            }
+            compiled += native.cpu.jit.compiled;
+            chained += native.cpu.blocks.chained;
+        }
+        std::fprintf(file, "%u programs, %llu blocks compiled, %llu chained to\n", rounds,
+            (unsigned long long) compiled, (unsigned long long) chained);
+        return mismatches;
+    }
+
+    void BenchmarkJit(std::FILE* const file) {
+        struct Loop {
+            const char* name;
+            std::vector<uint8_t> code;
+        };
+        // arguments of JR biased as Handlers::JumpRelative expects
+        const Loop loops[] = {
+            // LD B,0; LD C,3; loop: ADD A,C; SUB D; INC E; DEC B; JR NZ,loop; JR to the start
+            { "ALU", { 0x06, 0x00, 0x0E, 0x03, 0x81, 0x92, 0x1C, 0x05, 0x20, 130 - 6, 0x18, 130 - 12 } },
+            // LD B,0; loop: LD A,(HL+); ADD A,(HL); LD (DE),A; INC DE; DEC B; JR NZ,loop; LD HL,C100; LD DE,D000; JR to the start
+            { "copy", { 0x06, 0x00, 0x2A, 0x86, 0x12, 0x13, 0x05, 0x20, 130 - 7, 0x21, 0xC1, 0x00, 0x11, 0xD0, 0x00, 0x18, 130 - 17 } },
+        };
+        constexpr uint32_t slices = 300;
+        constexpr uint32_t slice_cycles = 20000;
+
+        for (const Loop& loop : loops) {
+            std::vector<uint8_t> rom(loop.code);
+            rom.resize(Memory::Bus::rom_size);
+            double seconds[2];
+            for (const bool jit : { false, true }) {
+                Machine machine(rom, {}, 0, jit);
+                const auto start = std::chrono::steady_clock::now();
+                for (uint32_t slice = 0; slice < slices; slice++)
+                    machine.cpu.RunBlocks(slice_cycles);
+                seconds[jit] = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            }
+            std::fprintf(file, "%-5s %7.1f M M-cycles/s interpreted, %7.1f compiled, %.1fx\n", loop.name,
+                slices * slice_cycles / seconds[0] / 1e6, slices * slice_cycles / seconds[1] / 1e6, seconds[0] / seconds[1]);
+        }
+    }
+
+}
@@ -0,0 +1,18 @@
+#pragma once
+#include <cstdint>
+#include <cstdio>
+
+namespace Debug {
+
+    /**
+     * Runs random programs of ALU, load, store and JR instructions, some of them from ROM and some
+     * from WRAM, where they overwrite their own code, both interpreted and through Cpu::Jit::Compiler
+     * with blocks compiled and linked. Registers, the cycle counter and memory are compared after
+     * each call to RunBlocks. Returns the number of programs whose runs differ, 0 without a JIT.
+     */
+    uint32_t CompareJit(const uint32_t rounds, std::FILE* const file);
+
+    /// Prints the M-cycles per second a few loops run at, interpreted and compiled, to file.
+    void BenchmarkJit(std::FILE* const file);
+
+}
@@ -0,0 +1,91 @@
+#include <chrono>
+#include <cstring>
+#include <random>
+
+#include "tiles.hpp"
+#include "../ppu/tiles.hpp"
+
+namespace Debug {
+
+    // a few lines of tiles, so that every kernel runs both its vector loop and its scalar tail
+    constexpr uint32_t max_rows = 64;
+
+    uint32_t CompareTileKernels(const uint32_t rounds) {
+        const std::vector<const Ppu::Tiles::Kernels*> kernels = Ppu::Tiles::Supported();
+        const Ppu::Tiles::Kernels& reference = Ppu::Tiles::scalar;
+        std::mt19937 random(0x5EED);
+
+        uint32_t mismatches = 0;
+        for (uint32_t round = 0; round < rounds; round++) {
+            uint8_t planes[max_rows * 2];
+            uint8_t numbers[max_rows * 8];
+            uint8_t palette[4];
+            for (uint8_t& byte : planes)
+                byte = random();
+            for (uint8_t& number : numbers)
+                number = random() & 3;
+            for (uint8_t& shade : palette)
+                shade = random();
+
+            for (uint32_t count = 0; count <= max_rows; count++) {
+                for (const bool flip : { false, true }) {
+                    uint8_t expected[max_rows * 8];
+                    uint8_t expected_shades[max_rows * 8];
+                    reference.Decode(planes, count, flip, expected);
+                    reference.Map(numbers, count * 8, palette, expected_shades);
+
+                    for (const Ppu::Tiles::Kernels* const tested : kernels) {
+                        // bytes past the output must be left alone
+                        uint8_t colors[max_rows * 8 + 1];
+                        uint8_t shades[max_rows * 8 + 1];
+                        colors[count * 8] = 0xA5;
+                        shades[count * 8] = 0xA5;
+                        tested->Decode(planes, count, flip, colors);
+                        tested->Map(numbers, count * 8, palette, shades);
+                        if (std::memcmp(colors, expected, count * 8) != 0 || std::memcmp(shades, expected_shades, count * 8) != 0
+                            || colors[count * 8] != 0xA5 || shades[count * 8] != 0xA5) {
+                            if (mismatches < 8)
+                                std::printf("%s: %u rows%s differ\n", tested->name, count, flip ? " flipped" : "");
+                            mismatches++;
+                        }
+                    }
+                }
+            }
+        }
+        return mismatches;
+    }
+
+    void BenchmarkTileKernels(std::FILE* const file) {
+        // a line's worth of tile rows and pixels, as the PPU decodes and maps them
+        constexpr uint32_t rows = 21;
+        constexpr uint32_t pixels = 160;
+        constexpr uint32_t repeats = 200000;
+
+        uint8_t input[rows * 2];
+        uint8_t palette[4] = { 0xFF, 0xAA, 0x55, 0x00 };
+        std::mt19937 random(0x5EED);
+        for (uint8_t& byte : input)
+            byte = random();
+
+        // kernels giving the same output print the same checksum
+        for (const Ppu::Tiles::Kernels* const kernels : Ppu::Tiles::Supported()) {
+            uint8_t planes[rows * 2];
+            std::memcpy(planes, input, sizeof(planes));
+            uint8_t colors[rows * 8];
+            uint8_t shades[rows * 8];
+            uint32_t checksum = 0;
+            const auto start = std::chrono::steady_clock::now();
+            for (uint32_t i = 0; i < repeats; i++) {
+                // a changing input, so that calls are not folded together
+                planes[i % (rows * 2)] ^= i;
+                kernels->Decode(planes, rows, i & 1, colors);
+                kernels->Map(colors, pixels, palette, shades);
+                checksum += shades[i % pixels];
+            }
+            const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+            std::fprintf(file, "%-6s %7.1f M rows/s, %8.1f M pixels/s decoded and mapped (%08X)\n", kernels->name,
+                rows * repeats / elapsed.count() / 1e6, pixels * repeats / elapsed.count() / 1e6, checksum);
+        }
+    }
+
+}
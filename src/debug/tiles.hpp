@@ -0,0 +1,17 @@
+#pragma once
+#include <cstdint>
+#include <cstdio>
+
+namespace Debug {
+
+    /**
+     * Decodes random tile rows, flipped or not, and maps random color numbers through random palettes
+     * with every supported Ppu::Tiles kernel, at every length up to a few lines.
+     * Returns the number of runs whose output differs from the scalar kernels'.
+     */
+    uint32_t CompareTileKernels(const uint32_t rounds);
+
+    /// Prints the tile rows decoded and pixels mapped per second by each supported kernel to file.
+    void BenchmarkTileKernels(std::FILE* const file);
+
+}
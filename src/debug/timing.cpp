@@ -0,0 +1,102 @@
+#include <memory>
+#include <vector>
+
+#include "timing.hpp"
+#include "../arena.hpp"
+#include "../cpu/cpu.hpp"
+
+namespace Debug {
+
+    /// How the program is run, see Read.
+    enum class Runner : uint8_t {
+        Stepped,
+        Cycle,
+        Run,
+        Blocks,
+        Compiled
+    };
+
+    constexpr const char* runner_names[] = { "M-cycle", "Cycle", "Run", "RunBlocks", "compiled" };
+    constexpr uint32_t line_cycles = 114;
+
+    /**
+     * Turns the LCD on, then runs LD HL,FF44; increments times INC B; LD A,(HL); JR -2 from 0000.
+     * Returns the value of A once the JR is reached, or 0xFF if runner is not available.
+     */
+    uint8_t Read(const uint32_t increments, const Runner runner) {
+        std::vector<uint8_t> rom(Memory::Bus::rom_size);
+        uint32_t pc = 0;
+        rom[pc++] = 0x21;
+        rom[pc++] = 0xFF;  // LD HL,u16 takes the upper byte first, as Operations::LoadDoubleByte
+        rom[pc++] = 0x44;
+        for (uint32_t i = 0; i < increments; i++)
+            rom[pc++] = 0x04;
+        rom[pc++] = 0x7E;
+        const uint16_t loop = pc;
+        rom[pc++] = 0x18;
+        rom[pc++] = 128;  // to itself, as Handlers::JumpRelative computes it
+
+        std::shared_ptr<Arena> arena = std::make_shared<Arena>();
+        Memory::Bus bus(std::shared_ptr<uint8_t[]>(arena, arena->ram), arena->high);
+        bus.MapRom(rom.data(), rom.size());
+        Cpu::Cpu cpu(&bus, &arena->cpu);
+        Ppu::Ppu ppu(&cpu, &bus, &arena->ppu, nullptr);
+        bus.Write(0xFF40, 0x91);
+
+        cpu.jit_enabled = runner == Runner::Compiled;
+        if (runner == Runner::Compiled) {
+            if (!cpu.jit.Available())
+                return 0xFF;
+            // compile every block up front rather than after Jit::Compiler::threshold runs
+            for (uint16_t address = 0; address < loop;) {
+                Cpu::Block* const block = cpu.blocks.Translate(&cpu, address);
+                if (!cpu.jit.Compile(&cpu, *block))
+                    return 0xFF;
+                address = block->end;
+            }
+        }
+
+        while (cpu.state->PC != loop) {
+            switch (runner) {
+                case Runner::Stepped:
+                    cpu.Cycle<Cpu::Accuracy::MCycle>();
+                    break;
+                case Runner::Cycle:
+                    cpu.Cycle<Cpu::Accuracy::InstructionGranular>();
+                    break;
+                case Runner::Run:
+                    cpu.Run(1);
+                    break;
+                case Runner::Blocks:
+                case Runner::Compiled:
+                    cpu.RunBlocks<Cpu::Accuracy::InstructionGranular>(1);
+                    break;
+            }
+        }
+        return cpu.state->A;
+    }
+
+    uint32_t CheckTiming(std::FILE* const file) {
+        uint32_t mismatches = 0;
+        for (const uint32_t increments : { 109u, 110u, 111u, 112u, 120u }) {
+            // whole instructions read at the M-cycle they start, stepped ones on the next
+            const uint32_t start = 3 + increments;
+            const uint8_t expected = start >= line_cycles;
+            const uint8_t expected_stepped = start + 1 >= line_cycles;
+            std::fprintf(file, "LD A,(HL) at M-cycle %u, LY %u (%u stepped):", start, expected, expected_stepped);
+            for (const Runner runner : { Runner::Stepped, Runner::Cycle, Runner::Run, Runner::Blocks, Runner::Compiled }) {
+                const uint8_t ly = Read(increments, runner);
+                const uint8_t expected_ly = runner == Runner::Stepped ? expected_stepped : expected;
+                if (ly == 0xFF) {
+                    std::fprintf(file, " %s unavailable", runner_names[(uint8_t) runner]);
+                    continue;
+                }
+                mismatches += ly != expected_ly;
+                std::fprintf(file, " %s %u%s", runner_names[(uint8_t) runner], ly, ly == expected_ly ? "" : " (differs)");
+            }
+            std::fprintf(file, "\n");
+        }
+        return mismatches;
+    }
+
+}
@@ -0,0 +1,15 @@
+#pragma once
+#include <cstdint>
+#include <cstdio>
+
+namespace Debug {
+
+    /**
+     * Reads LY with LD A,(HL) after a run of INC B long enough to straddle the end of line 0,
+     * through every way the CPU runs code: Cycle with either Accuracy policy, Run, RunBlocks and
+     * compiled blocks. Each must see the line change at the M-cycle the read happens. Prints a line per run length to file.
+     * Returns the number of reads that saw the wrong line.
+     */
+    uint32_t CheckTiming(std::FILE* const file);
+
+}
@@ -1,37 +1,191 @@
 #include "emu.hpp"
 
-Emu::Emu() {
-    this->memory = new uint8_t [32768];  // arbitrary size
+Emu::Emu(const char* const rom_path, ArenaPool* const pool) : pool(pool) {
+    std::string save_path;
+    if (rom_path != nullptr) {
+        this->rom = Cartridge::Rom::Open(rom_path);
+        save_path = rom_path;
+        const size_t extension = save_path.find_last_of("./");
+        if (extension != std::string::npos && save_path[extension] == '.')
+            save_path.erase(extension);
+        save_path += ".sav";
+    }
+    if (this->rom == nullptr) {
+        // testing
+        const uint8_t program[Memory::Bus::rom_size] = { 0x18, 0xFF };
+        this->rom = Cartridge::Rom::FromBytes(program, sizeof(program));
+    }
+
+    // zeroed, like RAM and registers before the boot ROM runs
+    this->arena = this->AllocateArena();
+    this->bus = std::make_unique<Memory::Bus>(std::shared_ptr<uint8_t[]>(this->arena, this->arena->ram), this->arena->high);
+
+    this->cpu = std::make_unique<Cpu::Cpu>(this->bus.get(), &this->arena->cpu);
+
+    this->mbc = Cartridge::Mbc::Create(this->cpu.get(), this->bus.get(), &this->arena->mbc, this->rom, save_path.empty() ? nullptr : save_path.c_str());
+    if (this->mbc == nullptr)
+        this->bus->MapRom(this->rom->Data(), this->rom->Size());
+
+    const bool cgb = this->rom->Size() > 0x143 && (this->rom->Data()[0x143] & 0x80);
+    this->dma = std::make_unique<Memory::Dma>(this->cpu.get(), this->bus.get(), &this->arena->dma, cgb);
+    this->ppu = std::make_unique<Ppu::Ppu>(this->cpu.get(), this->bus.get(), &this->arena->ppu, this->dma.get());
+
+    // GBEMU_JIT=0 keeps every block in the interpreter
+    if (const char* jit = std::getenv("GBEMU_JIT"))
+        this->cpu->jit_enabled &= jit[0] != '0';
+
+    // GBEMU_PPU=fifo draws lines through the pixel FIFOs, with mode 3 of variable length
+    if (const char* renderer = std::getenv("GBEMU_PPU"); renderer != nullptr && std::strcmp(renderer, "fifo") == 0)
+        this->ppu->renderer = Ppu::Renderer::Fifo;
+}
 
-    this->cpu = std::make_unique<Cpu::Cpu>(&this->memory);
+Emu::Emu(Emu* const parent) : pool(parent->pool) {
+    this->rom = parent->rom;
+    // without RAM: the bus reads it from the parent's arena
+    this->arena = this->AllocateArena(false);
+
+    // the bus is cloned unblocked and unwatched, then both get blocked again
+    parent->ppu->Flush();
+    parent->dma->Suspend();
+    this->bus = parent->bus->Clone(this->arena->high);
+    parent->dma->Resume();
+
+    this->cpu = std::make_unique<Cpu::Cpu>(this->bus.get(), &this->arena->cpu);
+    this->cpu->jit_enabled = parent->cpu->jit_enabled;
+    std::memcpy(this->arena.get(), parent->arena.get(), arena_state_size);
+
+    if (parent->mbc != nullptr)
+        this->mbc = parent->mbc->Clone(this->cpu.get(), this->bus.get(), &this->arena->mbc);
+    this->dma = std::make_unique<Memory::Dma>(*parent->dma, this->cpu.get(), this->bus.get(), &this->arena->dma);
+    this->dma->Resume();
+    this->ppu = std::make_unique<Ppu::Ppu>(*parent->ppu, this->cpu.get(), this->bus.get(), &this->arena->ppu, this->dma.get());
+}
+
+std::shared_ptr<Arena> Emu::AllocateArena(const bool with_ram) {
+    if (this->pool != nullptr)
+        return this->pool->Allocate(with_ram);
+    if (with_ram)
+        return std::make_shared<Arena>();
+    void* const memory = ::operator new(arena_state_size, std::align_val_t(alignof(Arena)));
+    std::memset(memory, 0, arena_state_size);
+    return std::shared_ptr<Arena>(reinterpret_cast<Arena*>(memory), [](Arena* const arena) {
+        ::operator delete((void*) arena, std::align_val_t(alignof(Arena)));
+    });
+}
+
+std::unique_ptr<Emu> Emu::Clone() {
+    return std::unique_ptr<Emu>(new Emu(this));
+}
 
-    // testing
-    memory[0] = 0x18;
-    memory[1] = 0xFF;
+size_t Emu::Footprint::Total() const {
+    return this->arena + this->objects + this->caches + this->code + this->copies;
+}
+
+Emu::Footprint Emu::Measure() const {
+    Footprint footprint = {};
+    footprint.arena = this->bus->ram.get() == this->arena->ram ? sizeof(Arena) : arena_state_size;
+    footprint.objects = sizeof(Cpu::Cpu) + sizeof(Cpu::Parser) + sizeof(Memory::Bus) + sizeof(Ppu::Ppu) + sizeof(Memory::Dma)
+        + (this->mbc != nullptr ? sizeof(Cartridge::Mbc) : 0);
+    footprint.caches = this->cpu->decode_cache.ResidentBytes() + this->cpu->blocks.ResidentBytes();
+    footprint.code = this->cpu->jit.CodeBytes();
+    footprint.copies = this->bus->CopyBytes() + this->ppu->BufferBytes();
+    return footprint;
+}
+
+void Emu::Report(std::FILE* const file) const {
+    const Footprint footprint = this->Measure();
+    std::fprintf(file, "instance: %zu bytes, %zu arena, %zu objects, %zu caches, %zu code, %zu copies and buffers\n",
+        footprint.Total(), footprint.arena, footprint.objects, footprint.caches, footprint.code, footprint.copies);
+}
+
+size_t Emu::CartridgeRamSize() const {
+    return this->mbc != nullptr ? this->mbc->RamSize() : 0;
+}
+
+void Emu::Snapshot(Arena* const snapshot, uint8_t* const cartridge_ram) const {
+    // the window line saved is that of the due lines, which Restore takes as drawn
+    this->ppu->Flush();
+    std::memcpy(snapshot, this->arena.get(), arena_state_size);
+    this->bus->StoreRam(snapshot->ram);
+    if (cartridge_ram != nullptr && this->mbc != nullptr)
+        this->mbc->StoreRam(cartridge_ram);
+}
+
+void Emu::Restore(const Arena* const snapshot, const uint8_t* const cartridge_ram) {
+    // RAM is loaded into the unblocked and unwatched bus, which is blocked again if a transfer was in progress in snapshot
+    this->ppu->Flush();
+    this->dma->Suspend();
+    std::memcpy(this->arena.get(), snapshot, arena_state_size);
+    this->bus->LoadRam(snapshot->ram);
+    if (this->mbc != nullptr) {
+        if (cartridge_ram != nullptr)
+            this->mbc->LoadRam(cartridge_ram);
+        this->mbc->Restore();
+    }
+    this->dma->Resume();
+
+    this->bus->MarkDirty(0, Memory::page_count);
+    this->cpu->InvalidateCode(0, 0x10000);
+    this->ppu->Restore();
+    // which asks a running block to be left: there is none
+    this->cpu->state->block_exit = snapshot->cpu.block_exit;
 }
 
 Emu::~Emu() {
-    delete[] this->memory;
-    this->memory = nullptr;
+    this->mbc = nullptr;
+    this->ppu = nullptr;
     this->cpu = nullptr;
+    this->dma = nullptr;
+    this->bus = nullptr;
+    this->rom = nullptr;
+    this->arena = nullptr;
 }
 
 int Emu::Play() {
     int error = 0;
 
     bool done = false;
-    std::shared_ptr<Cpu::Operations::Instruction> instruction = nullptr;
+    Cpu::Operations::Instruction* instruction = nullptr;
+    uint64_t allocations = 0;
+    double instructions_per_second = 0;
     while (!done) {
         SDL_Event event;
         while (SDL_PollEvent(&event)) {
             ImGui_ImplSDL2_ProcessEvent(&event);
             done = Gui::ShouldDestroy(event);
 
-            if (event.type == SDL_KEYDOWN && event.key.keysym.sym == SDLK_n)
+            if (event.type == SDL_KEYDOWN && event.key.keysym.sym == SDLK_n) {
+                uint64_t allocation_count = Debug::AllocationCount();
                 instruction = this->cpu->Cycle();
+                allocations = Debug::AllocationCount() - allocation_count;
+            }
+
+            // run a frame worth of M-cycles through the block translator
+            if (event.type == SDL_KEYDOWN && event.key.keysym.sym == SDLK_f) {
+                this->cpu->RunBlocks(17556);
+                instruction = &this->cpu->instruction;
+            }
+
+            // run a frame worth of M-cycles through the interpreter main loop
+            if (event.type == SDL_KEYDOWN && event.key.keysym.sym == SDLK_r) {
+                uint64_t instructions = this->cpu->state->instructions;
+                auto start = std::chrono::steady_clock::now();
+                this->cpu->Run(17556);
+                std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+                instructions_per_second = (this->cpu->state->instructions - instructions) / elapsed.count();
+                instruction = nullptr;
+            }
+
+            // switch between the scanline and FIFO renderers
+            if (event.type == SDL_KEYDOWN && event.key.keysym.sym == SDLK_p)
+                this->ppu->renderer = this->ppu->renderer == Ppu::Renderer::Fifo ? Ppu::Renderer::Scanline : Ppu::Renderer::Fifo;
         }
 
-        Gui::ImGuiFrameRender(this->cpu.get(), this->memory, instruction);
+        if (this->mbc != nullptr)
+            this->mbc->Flush();
+        this->ppu->Flush();
+
+        Gui::ImGuiFrameRender(this->cpu.get(), this->bus.get(), this->ppu.get(), instruction, allocations, instructions_per_second);
     }
 
     Gui::DestroyInterface();
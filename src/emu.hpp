@@ -1,17 +1,82 @@
 #pragma once
+#include <chrono>
+#include <cstddef>
 #include <cstdint>
 #include <cstdio>
+#include <cstdlib>
+#include <cstring>
 #include <memory>
+#include <new>
+#include <string>
 #include <SDL2/SDL.h>
 #include "gui/gui.hpp"
+#include "arena.hpp"
+#include "arena_pool.hpp"
 #include "cpu/cpu.hpp"
+#include "memory/bus.hpp"
+#include "memory/dma.hpp"
+#include "ppu/ppu.hpp"
+#include "cartridge/rom.hpp"
+#include "cartridge/mbc.hpp"
+#include "debug/allocations.hpp"
 
 class Emu {
+public:
+    /// Memory taken by one instance, for reporting. The ROM image, shared by every instance running it, is not counted.
+    struct Footprint {
+        size_t arena;    // sizeof(Arena), or arena_state_size for a clone reading RAM from its parent's
+        size_t objects;  // CPU, bus page tables, PPU, DMA and bank controller
+        size_t caches;   // decode and block caches, pages in memory only
+        size_t code;     // compiled code
+        size_t copies;   // RAM copied on write and PPU buffers, those shared with clones divided among them
+        size_t Total() const;
+    };
 private:
-    uint8_t* memory;
+    /// Where arenas are allocated, nullptr for the heap.
+    ArenaPool* pool = nullptr;
+    /// Shared with clones, which read the RAM they have not written from it.
+    std::shared_ptr<Arena> arena = nullptr;
+    /// Shared with every other instance running the same image.
+    std::shared_ptr<const Cartridge::Rom> rom = nullptr;
+    std::unique_ptr<Memory::Bus> bus = nullptr;
     std::unique_ptr<Cpu::Cpu> cpu = nullptr;
+    std::unique_ptr<Memory::Dma> dma = nullptr;
+    std::unique_ptr<Ppu::Ppu> ppu = nullptr;
+    /// nullptr for ROM-only cartridges.
+    std::unique_ptr<Cartridge::Mbc> mbc = nullptr;
+
+    /// The clone of parent, see Clone.
+    explicit Emu(Emu* const parent);
+    /// Returns a zeroed arena, from pool if there is one; without ram, only its arena_state_size bytes.
+    std::shared_ptr<Arena> AllocateArena(const bool with_ram = true);
 public:
-    Emu();
+    /// Runs the ROM image at rom_path, or a test program if nullptr or it can't be opened.
+    /// Battery-backed RAM is saved next to the image, with the .sav extension.
+    /// The arena, and those of clones, is allocated from pool if not nullptr: it must outlive them.
+    Emu(const char* const rom_path = nullptr, ArenaPool* const pool = nullptr);
     ~Emu();
+    /**
+     * Returns an instance in the same state, which then runs independently of this one.
+     * Memory is not copied but shared, each instance copying a page on its first write to it,
+     * so that many branches can be forked from one state. Caches of the clone start empty.
+     */
+    std::unique_ptr<Emu> Clone();
+    /// Bytes of cartridge RAM, saved and restored apart from the arena, 0 without RAM.
+    size_t CartridgeRamSize() const;
+    /**
+     * Saves the state of this instance to snapshot: a copy of its arena, RAM written since it was cloned included.
+     * Cartridge RAM, up to 128 KiB, is not part of the arena: it is saved to the CartridgeRamSize() bytes at
+     * cartridge_ram, or left out if nullptr, e.g. when the game never writes it between snapshots.
+     */
+    void Snapshot(Arena* const snapshot, uint8_t* const cartridge_ram = nullptr) const;
+    /**
+     * Returns to the state in snapshot, taken by this instance or another one running the same image.
+     * Cartridge RAM is loaded from cartridge_ram, saved along with snapshot, and is left as is if nullptr.
+     */
+    void Restore(const Arena* const snapshot, const uint8_t* const cartridge_ram = nullptr);
+    /// Measures what this instance takes now: caches and copies grow as it runs.
+    Footprint Measure() const;
+    /// Prints Measure() to file, on one line.
+    void Report(std::FILE* const file) const;
     int Play();
 };
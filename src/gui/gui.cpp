@@ -5,6 +5,8 @@ namespace Gui {
     SDL_Window* window = nullptr;
     ImGuiIO* p_io = nullptr;
     ImVec4 clear_color = ImVec4(0.45f, 0.55f, 0.60f, 1.00f);
+    /// The PPU framebuffer, uploaded as is every frame.
+    GLuint screen_texture = 0;
 
     bool InitInterface() {
         if (SDL_Init(SDL_INIT_VIDEO | SDL_INIT_TIMER | SDL_INIT_GAMECONTROLLER) != 0) {
@@ -12,11 +14,12 @@ namespace Gui {
             return 1;
         }
 
-        const char* glsl_version = "#version 130";
+        // 3.3 for texture swizzles
+        const char* glsl_version = "#version 150";
         SDL_GL_SetAttribute(SDL_GL_CONTEXT_FLAGS, 0);
         SDL_GL_SetAttribute(SDL_GL_CONTEXT_PROFILE_MASK, SDL_GL_CONTEXT_PROFILE_CORE);
         SDL_GL_SetAttribute(SDL_GL_CONTEXT_MAJOR_VERSION, 3);
-        SDL_GL_SetAttribute(SDL_GL_CONTEXT_MINOR_VERSION, 0);
+        SDL_GL_SetAttribute(SDL_GL_CONTEXT_MINOR_VERSION, 3);
 
         SDL_WindowFlags window_flags = (SDL_WindowFlags)(SDL_WINDOW_OPENGL | SDL_WINDOW_ALLOW_HIGHDPI);
         window = SDL_CreateWindow("gbemu", SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, 256, 128, window_flags);
@@ -45,9 +48,18 @@ namespace Gui {
 
         ImGui_ImplSDL2_InitForOpenGL(window, gl_context);
         ImGui_ImplOpenGL3_Init(glsl_version);
+
+        // one byte of grey level per pixel, spread to RGB by the sampler
+        const GLint grey[] = { GL_RED, GL_RED, GL_RED, GL_ONE };
+        glGenTextures(1, &screen_texture);
+        glBindTexture(GL_TEXTURE_2D, screen_texture);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_RGBA, grey);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, Ppu::width, Ppu::height, 0, GL_RED, GL_UNSIGNED_BYTE, nullptr);
     }
 
-    void ImGuiFrameRender(Cpu::Cpu* const cpu, uint8_t* const memory, std::shared_ptr<Cpu::Operations::Instruction> instruction) {
+    void ImGuiFrameRender(Cpu::Cpu* const cpu, Memory::Bus* const bus, const Ppu::Ppu* const ppu, const Cpu::Operations::Instruction* const instruction, const uint64_t allocations, const double instructions_per_second) {
         ImGui_ImplOpenGL3_NewFrame();
         ImGui_ImplSDL2_NewFrame(window);
         ImGui::NewFrame();
@@ -57,12 +69,13 @@ namespace Gui {
 
         std::stringstream hexss;
 
-        std::string AF = std::bitset<16>(Cpu::Helpers::JoinBytes(cpu->A, cpu->F)).to_string();
-        std::string BC = std::bitset<16>(Cpu::Helpers::JoinBytes(cpu->B, cpu->C)).to_string();
-        std::string DE = std::bitset<16>(Cpu::Helpers::JoinBytes(cpu->D, cpu->E)).to_string();
-        std::string HL = std::bitset<16>(Cpu::Helpers::JoinBytes(cpu->H, cpu->L)).to_string();
-        std::string SP = std::bitset<16>(Cpu::Helpers::JoinBytes(cpu->S, cpu->P)).to_string();
-        std::string PC = std::bitset<16>(cpu->PC).to_string();
+        cpu->MaterializeFlags();
+        std::string AF = std::bitset<16>(cpu->state->AF).to_string();
+        std::string BC = std::bitset<16>(cpu->state->BC).to_string();
+        std::string DE = std::bitset<16>(cpu->state->DE).to_string();
+        std::string HL = std::bitset<16>(cpu->state->HL).to_string();
+        std::string SP = std::bitset<16>(cpu->state->SP).to_string();
+        std::string PC = std::bitset<16>(cpu->state->PC).to_string();
 
         uint8_t opcode = 0;
         if (instruction != nullptr)
@@ -73,6 +86,9 @@ namespace Gui {
         for (uint8_t i = 0; i < argn; i++)
             hexss << " " <<  std::hex << std::setfill('0') << std::setw(2) << std::bitset<8>(instruction->args[i]).to_ulong();
 
+        if (instruction != nullptr)
+            hexss << "  " << Cpu::Decoding::Disassemble(opcode, instruction->args);
+
         std::string instr = hexss.str();
 
         ImGui::Text("registers");
@@ -98,7 +114,20 @@ namespace Gui {
         ImGui::Text("@ ");
         ImGui::SameLine();
         ImGui::Text(instr.c_str());
+        ImGui::Text("cycles: %llu", (unsigned long long) cpu->state->cycles);
+        ImGui::Text("decode cache: %llu hits, %llu misses", (unsigned long long) cpu->decode_cache.hits, (unsigned long long) cpu->decode_cache.misses);
+        ImGui::Text("blocks: %llu translated, %llu run, %llu chained", (unsigned long long) cpu->blocks.translations, (unsigned long long) cpu->blocks.executions, (unsigned long long) cpu->blocks.chained);
+        ImGui::Text("jit: %s, %llu compiled, %llu rejected", cpu->jit_enabled ? "on" : "off", (unsigned long long) cpu->jit.compiled, (unsigned long long) cpu->jit.rejected);
+        ImGui::Text("dispatch: %s, %.1f M instructions/s", GBEMU_THREADED_DISPATCH ? "threaded" : "loop", instructions_per_second / 1e6);
+        ImGui::Text("allocations: %llu", (unsigned long long) allocations);
+
+        ImGui::End();
 
+        glBindTexture(GL_TEXTURE_2D, screen_texture);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, Ppu::width, Ppu::height, GL_RED, GL_UNSIGNED_BYTE, ppu->framebuffer.get());
+        ImGui::Begin("screen", &p_open, ImGuiWindowFlags_AlwaysAutoResize);
+        ImGui::Image((ImTextureID)(intptr_t) screen_texture, ImVec2(Ppu::width * 2, Ppu::height * 2));
+        ImGui::Text("mode %u, %s renderer", ppu->Mode(), ppu->renderer == Ppu::Renderer::Fifo ? "fifo" : "scanline");
         ImGui::End();
 
         ImGui::Render();
@@ -126,6 +155,7 @@ namespace Gui {
     }
 
     void DestroyInterface() {
+        glDeleteTextures(1, &screen_texture);
         ImGui_ImplOpenGL3_Shutdown();
         ImGui_ImplSDL2_Shutdown();
         ImGui::DestroyContext();
@@ -14,11 +14,13 @@
 #include "imgui_impl_opengl3.h"
 
 #include "../cpu/cpu.hpp"
+#include "../memory/bus.hpp"
+#include "../ppu/ppu.hpp"
 
 namespace Gui {
 
     bool InitInterface();
-    void ImGuiFrameRender(Cpu::Cpu* const cpu, uint8_t* const memory, std::shared_ptr<Cpu::Operations::Instruction> instruction);
+    void ImGuiFrameRender(Cpu::Cpu* const cpu, Memory::Bus* const bus, const Ppu::Ppu* const ppu, const Cpu::Operations::Instruction* const instruction, const uint64_t allocations, const double instructions_per_second);
     bool ShouldDestroy(SDL_Event event);
     void DestroyInterface();
 
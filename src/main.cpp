@@ -1,12 +1,26 @@
 #include <cstdio>
 #include <cstdint>
+#include <cstdlib>
+#include <cstring>
 #include <memory>
 
 #include "emu.hpp"
+#include "debug/checks.hpp"
+
+int main(int argc, char* argv[]) {
+    // --check runs the self-checks, without a window, and fails if any does
+    if (argc > 1 && std::strcmp(argv[1], "--check") == 0)
+        return Debug::RunChecks(stdout) == 0 ? 0 : 1;
 
-int main() {
     Gui::InitInterface();
-    std::unique_ptr<Emu> emulator = std::make_unique<Emu>();
+    // declared first, so that it is destroyed after the instances it holds the arenas of
+    ArenaPool pool;
+    std::unique_ptr<Emu> emulator = std::make_unique<Emu>(argc > 1 ? argv[1] : nullptr, &pool);
     emulator->Play();
+    // GBEMU_POOL_STATS=1 reports, once the window is closed, how arenas are backed and what the instance took
+    if (const char* stats = std::getenv("GBEMU_POOL_STATS"); stats != nullptr && stats[0] != '0') {
+        pool.Report(stdout);
+        emulator->Report(stdout);
+    }
     return 0;
 }
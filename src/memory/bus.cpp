@@ -0,0 +1,429 @@
+#include <algorithm>
+#include <cstring>
+#include <functional>
+#include <utility>
+
+#include "bus.hpp"
+
+namespace Memory {
+    uint8_t Unmapped::Read(const uint16_t) {
+        return 0xFF;
+    }
+
+    void Unmapped::Write(const uint16_t, const uint8_t) {}
+
+    // unused and read-only bits of the DMG and CGB I/O registers
+    constexpr std::array<IoRegister, io_register_count> io_registers = [] {
+        std::array<IoRegister, io_register_count> registers = {};
+        for (IoRegister& reg : registers)
+            reg.unused = 0xFF;
+        auto define = [&](const uint8_t offset, const uint8_t unused, const uint8_t read_only) {
+            registers[offset] = { nullptr, unused, read_only, false };
+        };
+
+        define(0x00, 0xCF, 0x0F);  // P1: buttons read as released until a joypad handles them
+        define(0x01, 0x00, 0x00);  // SB
+        define(0x02, 0x7E, 0x00);  // SC
+        define(0x04, 0x00, 0x00);  // DIV
+        define(0x05, 0x00, 0x00);  // TIMA
+        define(0x06, 0x00, 0x00);  // TMA
+        define(0x07, 0xF8, 0x00);  // TAC
+        define(0x0F, 0xE0, 0x00);  // IF
+        // sound: lengths and frequencies are write-only
+        define(0x10, 0x80, 0x00);
+        define(0x11, 0x3F, 0x00);
+        define(0x12, 0x00, 0x00);
+        define(0x13, 0xFF, 0x00);
+        define(0x14, 0xBF, 0x00);
+        define(0x16, 0x3F, 0x00);
+        define(0x17, 0x00, 0x00);
+        define(0x18, 0xFF, 0x00);
+        define(0x19, 0xBF, 0x00);
+        define(0x1A, 0x7F, 0x00);
+        define(0x1B, 0xFF, 0x00);
+        define(0x1C, 0x9F, 0x00);
+        define(0x1D, 0xFF, 0x00);
+        define(0x1E, 0xBF, 0x00);
+        define(0x20, 0xFF, 0x00);
+        define(0x21, 0x00, 0x00);
+        define(0x22, 0x00, 0x00);
+        define(0x23, 0xBF, 0x00);
+        define(0x24, 0x00, 0x00);
+        define(0x25, 0x00, 0x00);
+        define(0x26, 0x70, 0x0F);  // NR52: channel status is read-only
+        for (uint8_t offset = 0x30; offset < 0x40; offset++)
+            define(offset, 0x00, 0x00);  // wave RAM
+        define(0x40, 0x00, 0x00);  // LCDC
+        define(0x41, 0x80, 0x07);  // STAT: mode and coincidence are read-only
+        define(0x42, 0x00, 0x00);  // SCY
+        define(0x43, 0x00, 0x00);  // SCX
+        define(0x44, 0x00, 0xFF);  // LY
+        define(0x45, 0x00, 0x00);  // LYC
+        define(0x46, 0x00, 0x00);  // DMA
+        define(0x47, 0x00, 0x00);  // BGP
+        define(0x48, 0x00, 0x00);  // OBP0
+        define(0x49, 0x00, 0x00);  // OBP1
+        define(0x4A, 0x00, 0x00);  // WY
+        define(0x4B, 0x00, 0x00);  // WX
+        // CGB
+        define(0x4D, 0x7E, 0x80);  // KEY1: current speed is read-only
+        define(0x4F, 0xFE, 0x00);  // VBK
+        define(0x51, 0xFF, 0x00);  // HDMA1-4 are write-only
+        define(0x52, 0xFF, 0x00);
+        define(0x53, 0xFF, 0x00);
+        define(0x54, 0xFF, 0x00);
+        define(0x55, 0x00, 0x00);  // HDMA5
+        define(0x56, 0x3C, 0x00);  // RP
+        define(0x68, 0x40, 0x00);  // BCPS
+        define(0x69, 0x00, 0x00);  // BCPD
+        define(0x6A, 0x40, 0x00);  // OCPS
+        define(0x6B, 0x00, 0x00);  // OCPD
+        define(0x70, 0xF8, 0x00);  // SVBK
+        return registers;
+    }();
+
+    HighPage::HighPage(uint8_t* const bytes) {
+        this->bytes = bytes;
+        this->registers = io_registers;
+        this->catch_up = nullptr;
+        this->catch_up_context = nullptr;
+    }
+
+    IoRegister HighPage::Map(const uint8_t offset, Handler* const handler, const bool observed) {
+        const IoRegister previous = this->registers[offset];
+        this->registers[offset].handler = handler;
+        this->registers[offset].observed = observed;
+        return previous;
+    }
+
+    uint8_t HighPage::Read(const uint16_t address) {
+        const uint8_t offset = address & (page_size - 1);
+        if (offset >= io_register_count)
+            return this->bytes[offset];
+
+        const IoRegister& reg = this->registers[offset];
+        if (reg.observed && this->catch_up != nullptr)
+            this->catch_up(this->catch_up_context);
+        const uint8_t value = reg.handler != nullptr ? reg.handler->Read(address) : this->bytes[offset];
+        return value | reg.unused;
+    }
+
+    void HighPage::Write(const uint16_t address, const uint8_t value) {
+        const uint8_t offset = address & (page_size - 1);
+        if (offset >= io_register_count) {
+            this->bytes[offset] = value;
+            return;
+        }
+
+        const IoRegister& reg = this->registers[offset];
+        if (reg.observed && this->catch_up != nullptr)
+            this->catch_up(this->catch_up_context);
+        if (reg.handler != nullptr)
+            reg.handler->Write(address, value);
+        else
+            this->bytes[offset] = (this->bytes[offset] & reg.read_only) | (value & ~reg.read_only);
+    }
+
+    Bus::Bus(std::shared_ptr<uint8_t[]> ram, uint8_t* const high) : ram(std::move(ram)), high(high) {
+        uint8_t* const vram = this->ram.get();
+        uint8_t* const external_ram = vram + vram_size;
+        uint8_t* const wram = external_ram + external_ram_size;
+        uint8_t* const oam = wram + wram_size;
+        this->page_memory = {};
+        this->writable = {};
+        this->copy_on_write = {};
+        this->shared = false;
+        this->private_memory = nullptr;
+        this->private_size = 0;
+        this->blocked = false;
+        this->watched = {};
+        this->watcher = nullptr;
+        this->dirty = {};
+        this->page_epochs = {};
+        this->epoch = 1;
+
+        // pages without a handler of their own, writes to ROM included, are unmapped until MapRom
+        this->MapHandler(0x00, page_count, &this->unmapped);
+        this->MapMemory(0x80, vram_size / page_size, vram, true);
+        this->MapMemory(0xA0, external_ram_size / page_size, external_ram, true);
+        this->MapMemory(0xC0, wram_size / page_size, wram, true);
+        // echo RAM: E000-FDFF shows C000-DDFF
+        this->MapMemory(0xE0, 0xFE - 0xE0, wram, true);
+        this->MapMemory(0xFE, 1, oam, true);
+        this->MapHandler(0xFF, 1, &this->high);
+    }
+
+    Bus::Bus(const Bus& parent, uint8_t* const high)
+        : page_memory(parent.page_memory), writable(parent.writable), copy_on_write(parent.copy_on_write),
+          shared(parent.shared), private_memory(nullptr), private_size(0), copies(parent.copies), blocked(false),
+          watched({}), watcher(nullptr),
+          read_pages(parent.read_pages), write_pages(parent.write_pages), handlers(parent.handlers),
+          dirty(parent.dirty), page_epochs(parent.page_epochs), epoch(parent.epoch), ram(parent.ram), high(parent.high) {
+        this->ReplaceHandler(&parent.unmapped, &this->unmapped);
+        this->ReplaceHandler(&parent.high, &this->high);
+        this->high.bytes = high;
+        std::memcpy(this->high.bytes, parent.high.bytes, page_size);
+        this->high.catch_up = nullptr;
+        this->high.catch_up_context = nullptr;
+        // the parent still writes its private memory
+        for (uint32_t page = 0; page < page_count; page++) {
+            if (this->page_memory[page] != nullptr && parent.Private(this->page_memory[page]))
+                this->MapHandler(page, 1, &this->unmapped);
+        }
+    }
+
+    std::unique_ptr<Bus> Bus::Clone(uint8_t* const high) {
+        this->Share();
+        return std::unique_ptr<Bus>(new Bus(*this, high));
+    }
+
+    size_t Bus::CopyBytes() const {
+        size_t bytes = this->copies.capacity() * sizeof(PageCopy);
+        for (const PageCopy& copy : this->copies)
+            bytes += page_size / copy.memory.use_count();
+        return bytes;
+    }
+
+    void Bus::StoreRam(uint8_t* const destination) const {
+        this->StoreMemory(this->ram.get(), ram_size, destination);
+    }
+
+    void Bus::LoadRam(const uint8_t* const source) {
+        this->LoadMemory(this->ram.get(), ram_size, source);
+    }
+
+    void Bus::StoreMemory(const uint8_t* const memory, const uint32_t size, uint8_t* const destination) const {
+        if (!this->shared) {
+            std::memcpy(destination, memory, size);
+            return;
+        }
+        for (uint32_t offset = 0; offset < size; offset += page_size) {
+            const uint8_t* const original = memory + offset;
+            const PageCopy* const copy = this->FindCopy(original);
+            std::memcpy(destination + offset, copy != nullptr ? copy->memory.get() : original, page_size);
+        }
+    }
+
+    void Bus::LoadMemory(uint8_t* const memory, const uint32_t size, const uint8_t* const source) {
+        if (!this->shared) {
+            std::memcpy(memory, source, size);
+            return;
+        }
+        // shared memory may be read by other buses
+        for (uint32_t offset = 0; offset < size; offset += page_size) {
+            uint8_t* const original = memory + offset;
+            const PageCopy* const copy = this->FindCopy(original);
+            if (this->Private(original))
+                std::memcpy(original, source + offset, page_size);
+            else if (copy != nullptr && !copy->shared)
+                std::memcpy(copy->memory.get(), source + offset, page_size);
+            else
+                this->CopyPage(original, source + offset);
+        }
+    }
+
+    void Bus::Share() {
+        this->shared = true;
+        // this bus' copies become shared as well
+        for (PageCopy& copy : this->copies)
+            copy.shared = true;
+        this->copy_on_write = this->writable;
+        for (uint32_t page = 0; page < page_count; page++) {
+            if (this->Private(this->page_memory[page]))
+                this->copy_on_write[page >> 6] &= ~(uint64_t(1) << (page & 63));
+            else if (this->writable[page >> 6] >> (page & 63) & 1)
+                this->write_pages[page] = nullptr;
+        }
+    }
+
+    void Bus::KeepPrivate(const uint8_t* const memory, const uint32_t size) {
+        this->private_memory = memory;
+        this->private_size = size;
+    }
+
+    bool Bus::CopiedBefore(const PageCopy& copy, const uint8_t* const original) {
+        return std::less<const uint8_t*>()(copy.original, original);
+    }
+
+    const Bus::PageCopy* Bus::FindCopy(const uint8_t* const original) const {
+        const auto copy = std::lower_bound(this->copies.begin(), this->copies.end(), original, CopiedBefore);
+        return copy != this->copies.end() && copy->original == original ? &*copy : nullptr;
+    }
+
+    uint8_t* Bus::CopyPage(const uint8_t page) {
+        return this->CopyPage(this->page_memory[page], this->read_pages[page]);
+    }
+
+    uint8_t* Bus::CopyPage(const uint8_t* const original, const uint8_t* const contents) {
+        std::shared_ptr<uint8_t[]> memory(new uint8_t[page_size]);
+        std::memcpy(memory.get(), contents, page_size);
+        const auto position = std::lower_bound(this->copies.begin(), this->copies.end(), original, CopiedBefore);
+        if (position != this->copies.end() && position->original == original)
+            *position = { original, memory, false };
+        else
+            this->copies.insert(position, { original, memory, false });
+
+        // echo RAM shows the same memory at another page
+        for (uint32_t alias = 0; alias < page_count; alias++) {
+            if (this->page_memory[alias] != original || !(this->copy_on_write[alias >> 6] >> (alias & 63) & 1))
+                continue;
+            this->read_pages[alias] = memory.get();
+            this->write_pages[alias] = memory.get();
+            this->copy_on_write[alias >> 6] &= ~(uint64_t(1) << (alias & 63));
+        }
+        return memory.get();
+    }
+
+    void Bus::ReplaceHandler(const Handler* const previous, Handler* const handler) {
+        for (Handler*& page_handler : this->handlers) {
+            if (page_handler == previous)
+                page_handler = handler;
+        }
+        for (IoRegister& reg : this->high.registers) {
+            if (reg.handler == previous)
+                reg.handler = handler;
+        }
+    }
+
+    void Bus::Block(Handler* const handler) {
+        this->blocked_read_pages = this->read_pages;
+        this->blocked_write_pages = this->write_pages;
+        this->blocked_handlers = this->handlers;
+        this->blocked_copy_on_write = this->copy_on_write;
+        this->blocked = true;
+        for (uint32_t page = 0; page < 0xFF; page++) {
+            this->read_pages[page] = nullptr;
+            this->write_pages[page] = nullptr;
+            this->handlers[page] = handler;
+        }
+        this->copy_on_write = {};
+    }
+
+    void Bus::Unblock() {
+        this->read_pages = this->blocked_read_pages;
+        this->write_pages = this->blocked_write_pages;
+        this->handlers = this->blocked_handlers;
+        this->copy_on_write = this->blocked_copy_on_write;
+        this->blocked = false;
+    }
+
+    void Bus::Watch(const uint8_t first_page, const uint16_t pages, Handler* const watcher) {
+        // while blocked, the saved mappings are watched, for Unblock to restore
+        std::array<uint8_t*, page_count>& write_pages = this->blocked ? this->blocked_write_pages : this->write_pages;
+        this->watcher = watcher;
+        for (uint32_t page = first_page; page < first_page + pages; page++) {
+            if (!(this->writable[page >> 6] >> (page & 63) & 1))
+                continue;
+            this->watched[page >> 6] |= uint64_t(1) << (page & 63);
+            write_pages[page] = nullptr;
+        }
+    }
+
+    void Bus::Unwatch() {
+        std::array<uint8_t*, page_count>& write_pages = this->blocked ? this->blocked_write_pages : this->write_pages;
+        const std::array<const uint8_t*, page_count>& read_pages = this->blocked ? this->blocked_read_pages : this->read_pages;
+        const PageSet& copy_on_write = this->blocked ? this->blocked_copy_on_write : this->copy_on_write;
+        for (uint32_t page = 0; page < page_count; page++) {
+            if (!(this->watched[page >> 6] >> (page & 63) & 1))
+                continue;
+            // a writable page is written where it is read, unless it is still shared
+            if ((this->writable[page >> 6] >> (page & 63) & 1) && !(copy_on_write[page >> 6] >> (page & 63) & 1))
+                write_pages[page] = const_cast<uint8_t*>(read_pages[page]);
+        }
+        this->watched = {};
+    }
+
+    void Bus::WriteWatched(const uint16_t address, const uint8_t value) {
+        this->Unwatch();
+        this->watcher->Write(address, value);
+        this->Write(address, value);
+    }
+
+    void Bus::MapMemory(const uint8_t first_page, const uint16_t pages, uint8_t* const memory, const bool writable) {
+        this->MarkDirty(first_page, pages);
+        for (uint16_t i = 0; i < pages; i++) {
+            const uint32_t page = first_page + i;
+            uint8_t* page_memory = memory + i * page_size;
+            this->page_memory[page] = page_memory;
+            this->writable[page >> 6] &= ~(uint64_t(1) << (page & 63));
+            this->writable[page >> 6] |= uint64_t(writable) << (page & 63);
+            this->copy_on_write[page >> 6] &= ~(uint64_t(1) << (page & 63));
+
+            // once shared, writable memory shows through its copy, or is copied on first write
+            bool copied = true;
+            if (writable && this->shared && !this->Private(page_memory)) {
+                const PageCopy* const copy = this->FindCopy(page_memory);
+                if (copy != nullptr) {
+                    page_memory = copy->memory.get();
+                    copied = !copy->shared;
+                } else {
+                    copied = false;
+                }
+                this->copy_on_write[page >> 6] |= uint64_t(!copied) << (page & 63);
+            }
+
+            this->read_pages[page] = page_memory;
+            this->write_pages[page] = writable && copied ? page_memory : nullptr;
+        }
+    }
+
+    void Bus::MapRom(const uint8_t* const data, const size_t size) {
+        const size_t pages = std::min<size_t>(size / page_size, rom_size / page_size);
+        // read-only, so the image is never written through the cast
+        this->MapMemory(0x00, pages, const_cast<uint8_t*>(data), false);
+        this->MapHandler(pages, rom_size / page_size - pages, &this->unmapped);
+    }
+
+    void Bus::MapHandler(const uint8_t first_page, const uint16_t pages, Handler* const handler) {
+        this->MarkDirty(first_page, pages);
+        for (uint32_t page = first_page; page < first_page + pages; page++) {
+            this->page_memory[page] = nullptr;
+            this->writable[page >> 6] &= ~(uint64_t(1) << (page & 63));
+            this->copy_on_write[page >> 6] &= ~(uint64_t(1) << (page & 63));
+        }
+        for (uint16_t i = 0; i < pages; i++) {
+            this->read_pages[first_page + i] = nullptr;
+            this->write_pages[first_page + i] = nullptr;
+            this->handlers[first_page + i] = handler;
+        }
+    }
+
+    void Bus::MarkDirty(const uint8_t first_page, const uint16_t pages) {
+        for (uint32_t page = first_page; page < first_page + pages; page++)
+            this->dirty[page >> 6] |= uint64_t(1) << (page & 63);
+    }
+
+    void Bus::Fold() {
+        // echo RAM: E000-FDFF shows C000-DDFF
+        constexpr uint32_t echo_first = 0xE0, echo_pages = 0xFE - 0xE0, echo_distance = 0x20;
+        for (uint32_t word = 0; word < this->dirty.size(); word++) {
+            const uint64_t bits = this->dirty[word];
+            this->dirty[word] = 0;
+            if (bits == 0)
+                continue;
+            for (uint32_t bit = 0; bit < 64; bit++) {
+                if (!(bits >> bit & 1))
+                    continue;
+                const uint32_t page = word * 64 + bit;
+                this->page_epochs[page] = this->epoch;
+                if (page >= echo_first && page < echo_first + echo_pages)
+                    this->page_epochs[page - echo_distance] = this->epoch;
+                else if (page >= echo_first - echo_distance && page < echo_first - echo_distance + echo_pages)
+                    this->page_epochs[page + echo_distance] = this->epoch;
+            }
+        }
+    }
+
+    uint32_t Bus::Checkpoint() {
+        this->Fold();
+        return this->epoch++;
+    }
+
+    PageSet Bus::ChangedSince(const uint32_t since) {
+        this->Fold();
+        PageSet changed = {};
+        for (uint32_t page = 0; page < page_count; page++)
+            changed[page >> 6] |= uint64_t(this->page_epochs[page] > since) << (page & 63);
+        return changed;
+    }
+}
@@ -0,0 +1,247 @@
+#pragma once
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace Memory {
+    constexpr uint32_t page_bits = 8;
+    constexpr uint32_t page_size = 1 << page_bits;
+    constexpr uint32_t page_count = 0x10000 >> page_bits;
+
+    /// Accesses to a page that is not plain memory, such as I/O registers or bank controllers.
+    class Handler {
+    public:
+        virtual ~Handler() = default;
+        virtual uint8_t Read(const uint16_t address) = 0;
+        virtual void Write(const uint16_t address, const uint8_t value) = 0;
+    };
+
+    /// Reads as 0xFF and ignores writes, e.g. writes to ROM without a bank controller.
+    class Unmapped : public Handler {
+    public:
+        virtual uint8_t Read(const uint16_t address);
+        virtual void Write(const uint16_t address, const uint8_t value);
+    };
+
+    constexpr uint32_t io_register_count = 0x80;
+
+    /// How an I/O register in FF00-FF7F is accessed.
+    struct IoRegister {
+        /// Owner of the register, nullptr if it is a plain byte of HighPage::bytes.
+        Handler* handler;
+        /// Bits reading as 1, whatever was written: unused or write-only bits.
+        uint8_t unused;
+        /// Bits writes leave unchanged, for registers without a handler.
+        uint8_t read_only;
+        /// Peripherals are caught up before the register is accessed, so that it reflects the current cycle.
+        bool observed;
+    };
+
+    /**
+     * The FF page: I/O registers, HRAM and IE.
+     * Each I/O register is dispatched through its entry of a 128-entry table, to the handler
+     * of the peripheral owning it or to a plain byte, with its unused and read-only bits applied.
+     * Peripherals need not run ahead of time: reading or writing one of their observed registers
+     * catches them up first, through catch_up.
+     */
+    class HighPage : public Handler {
+    public:
+        /// Stored I/O registers, HRAM and IE: page_size bytes, in the arena of the instance.
+        uint8_t* bytes;
+        std::array<IoRegister, io_register_count> registers;
+        /// Brings peripherals up to the current cycle, called with catch_up_context. nullptr if there is no clock.
+        void (*catch_up)(void* const context);
+        void* catch_up_context;
+
+        explicit HighPage(uint8_t* const bytes);
+        /// Routes the register at offset (from FF00) to handler. Returns the previous entry.
+        IoRegister Map(const uint8_t offset, Handler* const handler, const bool observed);
+        virtual uint8_t Read(const uint16_t address);
+        virtual void Write(const uint16_t address, const uint8_t value);
+    };
+
+    /// One bit per page of the address space.
+    using PageSet = std::array<uint64_t, page_count / 64>;
+
+    /**
+     * The 64 KiB address space, as 256 pages of 256 bytes.
+     * A page maps either to host memory, separately for reads and writes, or to a Handler.
+     * Accesses to plain memory are a table lookup and a load or store. Regions appearing at
+     * more than one address, such as echo RAM, are pages pointing to the same host memory.
+     *
+     * A bus can be cloned without copying memory: from then on, the parent and the clone share
+     * the memory they had as read-only, and each copies a page the first time it writes to it.
+     * Writes to a shared page take the slow path once, then the page is private again.
+     * Memory kept private, such as cartridge RAM backed by a save file, is never shared: this bus
+     * keeps writing it in place, and clones leave it unmapped until they map memory of their own.
+     */
+    class Bus {
+    private:
+        /// A private copy of a shared page. Copies are shared in turn by the next Clone.
+        struct PageCopy {
+            const uint8_t* original;
+            std::shared_ptr<uint8_t[]> memory;
+            bool shared;
+        };
+
+        /// Memory each page was mapped to by MapMemory, before copy-on-write, nullptr for handler pages.
+        std::array<uint8_t*, page_count> page_memory;
+        /// Pages mapped writable by MapMemory.
+        PageSet writable;
+        /// Writable pages still showing shared memory, copied on first write.
+        PageSet copy_on_write;
+        /// Set once memory has been shared with a clone.
+        bool shared;
+        /// Memory never shared with clones, see KeepPrivate. Empty if private_size is 0.
+        const uint8_t* private_memory;
+        uint32_t private_size;
+        /// Copies of shared pages, sorted by the memory they were copied from: a clone copies them in one allocation.
+        std::vector<PageCopy> copies;
+        // mappings saved while blocked
+        std::array<const uint8_t*, page_count> blocked_read_pages;
+        std::array<uint8_t*, page_count> blocked_write_pages;
+        std::array<Handler*, page_count> blocked_handlers;
+        PageSet blocked_copy_on_write;
+        bool blocked;
+        /// Pages whose next write goes to watcher first, see Watch.
+        PageSet watched;
+        Handler* watcher;
+
+        /// The clone of parent, its high page stored at high. Memory must already be shared, see Share.
+        Bus(const Bus& parent, uint8_t* const high);
+        /// Makes every writable page read-only and copied on first write, in this bus, but for private memory.
+        void Share();
+        /// Whether memory lies in the memory kept private.
+        bool Private(const uint8_t* const memory) const {
+            return memory >= this->private_memory && memory < this->private_memory + this->private_size;
+        }
+        /// Orders copies by the memory they were copied from.
+        static bool CopiedBefore(const PageCopy& copy, const uint8_t* const original);
+        /// The copy of original, nullptr if there is none.
+        const PageCopy* FindCopy(const uint8_t* const original) const;
+        /// Tells the watcher about a write to a watched page, then lets it land, the pages no longer watched.
+        void WriteWatched(const uint16_t address, const uint8_t value);
+        /// Gives page a private copy of the memory it shows, along with the pages aliasing it. Returns the copy.
+        uint8_t* CopyPage(const uint8_t page);
+        /// Gives the pages showing original, or a shared copy of it, a private copy of contents. Returns the copy.
+        uint8_t* CopyPage(const uint8_t* const original, const uint8_t* const contents);
+    public:
+        /// The 0000-7FFF window, bank 0 followed by the switchable bank.
+        static constexpr uint32_t rom_size = 0x8000;
+        static constexpr uint32_t vram_size = 0x2000;
+        static constexpr uint32_t external_ram_size = 0x2000;
+        static constexpr uint32_t wram_size = 0x2000;
+        static constexpr uint32_t oam_size = page_size;  // including the unusable FEA0-FEFF
+        static constexpr uint32_t ram_size = vram_size + external_ram_size + wram_size + oam_size;
+
+        /// Host memory of each page for reads, nullptr if reads go through the page's handler.
+        std::array<const uint8_t*, page_count> read_pages;
+        /// Host memory of each page for writes, nullptr if writes go through the page's handler.
+        std::array<uint8_t*, page_count> write_pages;
+        std::array<Handler*, page_count> handlers;
+
+        /**
+         * Pages written since the last Fold, set by every write whatever the page maps to.
+         * Folding stamps them with the current epoch: which pages changed since an epoch is
+         * then known without looking at memory, e.g. for save states, rewind or code caches.
+         * Remapping a page also counts as writing it, since different bytes show through it.
+         */
+        PageSet dirty;
+        /// Epoch in which each page was last written, as of the last Fold.
+        std::array<uint32_t, page_count> page_epochs;
+        /// Stamped on pages written from now on.
+        uint32_t epoch;
+
+        /// VRAM, external RAM, WRAM and OAM, in this order, ram_size bytes. Shared, read-only, once cloned.
+        std::shared_ptr<uint8_t[]> ram;
+        Unmapped unmapped;
+        HighPage high;
+
+        /// Maps the ram_size bytes of RAM at ram, and the high page stored in the page_size bytes at high.
+        Bus(std::shared_ptr<uint8_t[]> ram, uint8_t* const high);
+        Bus(const Bus&) = delete;
+        Bus& operator=(const Bus&) = delete;
+
+        uint8_t Read(const uint16_t address) {
+            const uint8_t* const page = this->read_pages[address >> page_bits];
+            if (page != nullptr)
+                return page[address & (page_size - 1)];
+            return this->handlers[address >> page_bits]->Read(address);
+        }
+
+        void Write(const uint16_t address, const uint8_t value) {
+            this->dirty[address >> (page_bits + 6)] |= uint64_t(1) << (address >> page_bits & 63);
+            uint8_t* const page = this->write_pages[address >> page_bits];
+            if (page != nullptr)
+                page[address & (page_size - 1)] = value;
+            else if (this->watched[address >> (page_bits + 6)] >> (address >> page_bits & 63) & 1)
+                this->WriteWatched(address, value);
+            else if (this->copy_on_write[address >> (page_bits + 6)] >> (address >> page_bits & 63) & 1)
+                this->CopyPage(address >> page_bits)[address & (page_size - 1)] = value;
+            else
+                this->handlers[address >> page_bits]->Write(address, value);
+        }
+
+        /**
+         * Returns a bus with the memory and state of this one, sharing its memory: both copy pages on
+         * first write from now on. The high page is copied to high instead. Pages and registers mapped
+         * to handlers other than the bus' own still go to this bus' handlers, see ReplaceHandler.
+         * The bus must not be blocked or watched.
+         */
+        std::unique_ptr<Bus> Clone(uint8_t* const high);
+        /**
+         * Keeps the size bytes of memory at memory, mapped or to be mapped by MapMemory, out of Clone:
+         * this bus writes them in place even once shared, and pages showing them are unmapped in clones.
+         * E.g. battery-backed cartridge RAM, which only the instance owning its save file should write.
+         */
+        void KeepPrivate(const uint8_t* const memory, const uint32_t size);
+        /// Bytes of the pages this bus copied on write, those still shared with clones divided among them.
+        size_t CopyBytes() const;
+        /// Copies RAM as this bus shows it, copies on write included, to ram_size bytes at destination.
+        void StoreRam(uint8_t* const destination) const;
+        /// Overwrites RAM with ram_size bytes from source. Shared memory is not written, but copied. The bus must not be blocked or watched.
+        void LoadRam(const uint8_t* const source);
+        /// Copies size bytes of memory mapped by MapMemory, e.g. banks of cartridge RAM, as this bus shows them. size is a multiple of page_size.
+        void StoreMemory(const uint8_t* const memory, const uint32_t size, uint8_t* const destination) const;
+        /// Overwrites size bytes of memory mapped by MapMemory from source, as LoadRam does RAM.
+        void LoadMemory(uint8_t* const memory, const uint32_t size, const uint8_t* const source);
+        /// Points pages and I/O registers handled by previous to handler, e.g. to the clone of a peripheral.
+        void ReplaceHandler(const Handler* const previous, Handler* const handler);
+        /// Routes every page but FF to handler until Unblock, e.g. while OAM DMA holds the bus.
+        void Block(Handler* const handler);
+        void Unblock();
+        /**
+         * Has the next write to any of the writable pages [first_page, first_page + pages) call
+         * watcher->Write first, with the address and value of the write, which then lands as usual.
+         * The pages are unwatched on that write, or by Unwatch. Watched pages take the slow path
+         * of Write until then, while reads and other pages are unaffected: e.g. the PPU renders
+         * the lines it deferred before VRAM changes under them.
+         */
+        void Watch(const uint8_t first_page, const uint16_t pages, Handler* const watcher);
+        void Unwatch();
+        /// Host memory page shows, nullptr for handler pages, as if unblocked: what the PPU sees while the CPU is kept off the bus.
+        const uint8_t* Peek(const uint8_t page) const {
+            return (this->blocked ? this->blocked_read_pages : this->read_pages)[page];
+        }
+        /// Maps pages [first_page, first_page + pages) to host memory, read-only if writable is not set.
+        void MapMemory(const uint8_t first_page, const uint16_t pages, uint8_t* const memory, const bool writable);
+        /**
+         * Maps the ROM window to size bytes of ROM image at data, read-only.
+         * The image is not copied: it must outlive the mapping, e.g. as a shared Cartridge::Rom.
+         * Pages past the end of a short image are unmapped.
+         */
+        void MapRom(const uint8_t* const data, const size_t size);
+        /// Maps pages [first_page, first_page + pages) to handler, for reads and writes.
+        void MapHandler(const uint8_t first_page, const uint16_t pages, Handler* const handler);
+        /// Marks pages [first_page, first_page + pages) as written, for writes not going through Write, e.g. DMA.
+        void MarkDirty(const uint8_t first_page, const uint16_t pages);
+        /// Stamps pages written since the last call with the current epoch. Echo RAM and the WRAM it shows are stamped together.
+        void Fold();
+        /// Ends the current epoch and returns it: pages written from now on have a later one.
+        uint32_t Checkpoint();
+        /// Returns the pages written after epoch since, a value returned by Checkpoint. O(pages).
+        PageSet ChangedSince(const uint32_t since);
+    };
+}
@@ -0,0 +1,182 @@
+#include <algorithm>
+#include <cstring>
+
+#include "dma.hpp"
+#include "../cpu/cpu.hpp"
+
+namespace Memory {
+    Dma::Dma(Cpu::Cpu* const cpu, Bus* const bus, DmaState* const state, const bool cgb) : cpu(cpu), bus(bus), state(state) {
+        this->state->oam_source = 0xFF;
+        this->state->oam_remaining = 0;
+        this->state->stale_begin = 0x10000;
+        this->state->stale_end = 0;
+        this->state->vram_source = 0;
+        this->state->vram_destination = 0;
+        this->state->vram_blocks = 0;
+
+        this->bus->high.Map(0x46, this, true);
+        if (cgb) {
+            for (uint8_t offset = 0x51; offset <= 0x54; offset++)
+                this->bus->high.Map(offset, this, false);
+            this->bus->high.Map(0x55, this, true);
+        }
+        this->cpu->Attach(this);
+    }
+
+    Dma::Dma(const Dma& parent, Cpu::Cpu* const cpu, Bus* const bus, DmaState* const state) : cpu(cpu), bus(bus), state(state) {
+        this->bus->ReplaceHandler(&parent, this);
+        this->cpu->Attach(this);
+    }
+
+    void Dma::Suspend() {
+        if (this->state->oam_remaining != 0)
+            this->bus->Unblock();
+    }
+
+    void Dma::Resume() {
+        if (this->state->oam_remaining != 0)
+            this->bus->Block(this);
+    }
+
+    void Dma::Copy(uint16_t source, uint16_t destination, uint32_t length) {
+        const uint16_t begin = destination;
+        const uint32_t end = destination + length;
+        while (length > 0) {
+            // a chunk stays within a page of both source and destination
+            const uint32_t chunk = std::min({ length, page_size - (source & (page_size - 1)), page_size - (destination & (page_size - 1)) });
+            const uint8_t* const from = this->bus->read_pages[source >> page_bits];
+            uint8_t* const to = this->bus->write_pages[destination >> page_bits];
+            if (from != nullptr && to != nullptr) {
+                std::memcpy(to + (destination & (page_size - 1)), from + (source & (page_size - 1)), chunk);
+                this->bus->MarkDirty(destination >> page_bits, 1);
+            } else {
+                for (uint32_t i = 0; i < chunk; i++)
+                    this->bus->Write(destination + i, this->bus->Read(source + i));
+            }
+            source += chunk;
+            destination += chunk;
+            length -= chunk;
+        }
+        this->cpu->InvalidateCode(begin, end);
+    }
+
+    void Dma::StartOam(const uint8_t value) {
+        if (this->state->oam_remaining != 0)
+            this->Unblock();
+
+        this->state->oam_source = value;
+        // E000-FFFF sources read from WRAM
+        uint16_t source = value << page_bits;
+        if (source >= 0xE000)
+            source -= 0x2000;
+        this->Copy(source, 0xFE00, oam_length);
+        this->bus->Block(this);
+        this->state->oam_remaining = oam_cycles + 1;
+        this->state->stale_begin = 0x10000;
+        this->state->stale_end = 0;
+    }
+
+    void Dma::Unblock() {
+        this->bus->Unblock();
+        this->state->oam_remaining = 0;
+        // code decoded from bytes read while blocked was decoded from 0xFF
+        if (this->state->stale_begin < this->state->stale_end)
+            this->cpu->InvalidateCode(this->state->stale_begin, this->state->stale_end);
+    }
+
+    void Dma::CopyVramBlock() {
+        this->Copy(this->state->vram_source, 0x8000 + this->state->vram_destination, vram_block);
+        this->state->vram_source += vram_block;
+        this->state->vram_destination = (this->state->vram_destination + vram_block) & 0x1FF0;
+        this->state->vram_blocks--;
+        this->cpu->state->cycles += vram_block_cycles;
+    }
+
+    uint8_t Dma::Read(const uint16_t address) {
+        if (address < 0xFF00) {
+            // the bus may have been blocked for longer than the peripherals know
+            this->cpu->CatchUp();
+            if (this->state->oam_remaining == 0)
+                return this->bus->Read(address);
+            this->state->stale_begin = std::min<uint32_t>(this->state->stale_begin, address);
+            this->state->stale_end = std::max<uint32_t>(this->state->stale_end, address + 1);
+            return 0xFF;
+        }
+
+        switch (address & (page_size - 1)) {
+            case 0x46:
+                return this->state->oam_source;
+            case 0x55:
+                // bit 7 reset while an HBlank DMA is active
+                return this->state->vram_blocks != 0 ? (this->state->vram_blocks - 1) & 0x7F : 0xFF;
+            default:
+                return 0xFF;
+        }
+    }
+
+    void Dma::Write(const uint16_t address, const uint8_t value) {
+        if (address < 0xFF00) {
+            this->cpu->CatchUp();
+            if (this->state->oam_remaining == 0)
+                this->bus->Write(address, value);
+            return;
+        }
+
+        switch (address & (page_size - 1)) {
+            case 0x46:
+                this->StartOam(value);
+                break;
+            case 0x51:
+                this->state->vram_source = (this->state->vram_source & 0x00F0) | value << 8;
+                break;
+            case 0x52:
+                this->state->vram_source = (this->state->vram_source & 0xFF00) | (value & 0xF0);
+                break;
+            case 0x53:
+                this->state->vram_destination = (this->state->vram_destination & 0x00F0) | (value & 0x1F) << 8;
+                break;
+            case 0x54:
+                this->state->vram_destination = (this->state->vram_destination & 0x1F00) | (value & 0xF0);
+                break;
+            case 0x55: {
+                // writing with bit 7 reset stops an active HBlank DMA
+                if (this->state->vram_blocks != 0 && !(value & 0x80)) {
+                    this->state->vram_blocks = 0;
+                    break;
+                }
+
+                const uint8_t blocks = (value & 0x7F) + 1;
+                if (value & 0x80) {
+                    this->state->vram_blocks = blocks;
+                    break;
+                }
+
+                // general purpose DMA: all at once, the CPU halted meanwhile; it stops at the end of VRAM
+                const uint32_t length = std::min<uint32_t>(blocks * vram_block, 0x2000 - this->state->vram_destination);
+                this->Copy(this->state->vram_source, 0x8000 + this->state->vram_destination, length);
+                this->state->vram_source += length;
+                this->state->vram_destination = (this->state->vram_destination + length) & 0x1FF0;
+                this->cpu->state->cycles += length / vram_block * vram_block_cycles;
+                break;
+            }
+        }
+    }
+
+    void Dma::Tick(const uint32_t m_cycles) {
+        if (this->state->oam_remaining == 0)
+            return;
+        if (m_cycles >= this->state->oam_remaining)
+            this->Unblock();
+        else
+            this->state->oam_remaining -= m_cycles;
+    }
+
+    void Dma::HBlank() {
+        if (this->state->vram_blocks != 0)
+            this->CopyVramBlock();
+    }
+
+    bool Dma::Blocking() const {
+        return this->state->oam_remaining != 0;
+    }
+}
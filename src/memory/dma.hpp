@@ -0,0 +1,68 @@
+#pragma once
+#include <cstdint>
+#include "bus.hpp"
+#include "../cpu/clock.hpp"
+
+namespace Cpu {
+    class Cpu;
+}
+
+namespace Memory {
+
+    /// Registers and progress of the DMA engine, trivially copyable so that they live in the arena of an instance.
+    struct DmaState {
+        uint32_t oam_remaining;       // M-cycles left, 0 if the bus is not blocked
+        // range of addresses read while blocked, whose decoded code is stale once unblocked
+        uint32_t stale_begin;
+        uint32_t stale_end;
+        uint16_t vram_source;         // HDMA1-2
+        uint16_t vram_destination;    // HDMA3-4, from 8000
+        uint8_t oam_source;           // last value written to FF46
+        uint8_t vram_blocks;          // 16-byte blocks left for HBlank DMA, 0 if inactive
+    };
+
+    /**
+     * OAM DMA (FF46) and, on CGB, general purpose and HBlank VRAM DMA (FF51-FF55).
+     * Transfers are copied at once, as a single memcpy when their source page is plain memory,
+     * and then accounted for in time: OAM DMA blocks the bus for 160 M-cycles, during which the
+     * CPU only reaches HRAM, and GDMA halts the CPU for 8 M-cycles per 16 bytes.
+     * The bus is blocked by pointing every page but FF at the engine, not by checking on every
+     * access. The first blocked access catches peripherals up, so that blocking ends on time
+     * even if they are only ticked once in a while.
+     */
+    class Dma : public Handler, public Cpu::Peripheral {
+    private:
+        static constexpr uint32_t oam_length = 0xA0;
+        static constexpr uint32_t oam_cycles = oam_length;  // plus 1 of setup
+        static constexpr uint32_t vram_block = 0x10;
+        static constexpr uint32_t vram_block_cycles = 8;     // single speed
+
+        Cpu::Cpu* const cpu;
+        Bus* const bus;
+        DmaState* const state;
+
+        /// Copies length bytes from source to destination, a single memcpy when both pages are memory.
+        void Copy(uint16_t source, uint16_t destination, uint32_t length);
+        void StartOam(const uint8_t value);
+        void Unblock();
+        /// Copies the next 16-byte block of a VRAM transfer.
+        void CopyVramBlock();
+    public:
+        /// Resets state. cgb maps the VRAM DMA registers as well.
+        Dma(Cpu::Cpu* const cpu, Bus* const bus, DmaState* const state, const bool cgb);
+        /// The clone of parent, for the clones of its CPU and bus, state already holding a copy of parent's. See Suspend.
+        Dma(const Dma& parent, Cpu::Cpu* const cpu, Bus* const bus, DmaState* const state);
+        /// Unblocks the bus until Resume, the transfer still in progress, so that the bus can be cloned or its state restored.
+        void Suspend();
+        void Resume();
+        /// DMA registers, and pages other than FF while the bus is blocked.
+        virtual uint8_t Read(const uint16_t address);
+        virtual void Write(const uint16_t address, const uint8_t value);
+        virtual void Tick(const uint32_t m_cycles);
+        /// Called by the PPU on entering HBlank: copies the next block of an HBlank DMA, if any.
+        void HBlank();
+        /// Whether OAM DMA currently blocks the bus.
+        bool Blocking() const;
+    };
+
+}
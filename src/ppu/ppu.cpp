@@ -0,0 +1,649 @@
+#include <algorithm>
+#include <cstring>
+#include <utility>
+
+#include "ppu.hpp"
+#include "../cpu/cpu.hpp"
+#include "../memory/dma.hpp"
+
+namespace Ppu {
+    // offsets of the registers in the FF page
+    constexpr uint8_t IF = 0x0F;
+    constexpr uint8_t LCDC = 0x40;
+    constexpr uint8_t STAT = 0x41;
+    constexpr uint8_t SCY = 0x42;
+    constexpr uint8_t SCX = 0x43;
+    constexpr uint8_t LY = 0x44;
+    constexpr uint8_t LYC = 0x45;
+    constexpr uint8_t BGP = 0x47;
+    constexpr uint8_t OBP0 = 0x48;
+    constexpr uint8_t OBP1 = 0x49;
+    constexpr uint8_t WY = 0x4A;
+    constexpr uint8_t WX = 0x4B;
+
+    constexpr uint8_t vram_first_page = 0x80;
+    constexpr uint8_t vram_pages = 0x20;
+    constexpr uint8_t oam_page = 0xFE;
+    constexpr uint8_t max_line_sprites = 10;
+
+    // tiles covering a line whatever its fine scroll
+    constexpr uint8_t line_tiles = width / 8 + 1;
+
+    Ppu::Ppu(Cpu::Cpu* const cpu, Memory::Bus* const bus, State* const state, Memory::Dma* const dma)
+        : cpu(cpu), bus(bus), state(state), dma(dma), registers(bus->high.bytes), tiles(&Tiles::Select()) {
+        this->state->frames = 0;
+        this->state->line_cycles = 0;
+        this->state->window_line = 0;
+        this->state->stat_signal = false;
+        this->registers[LY] = 0;
+        this->registers[STAT] &= ~0x07;
+        this->framebuffer.reset(new uint8_t[height][width]);
+        std::memset(this->framebuffer.get(), shades[0], height * width);
+        this->decoded_tiles.reset(new uint8_t[tile_count][8][8]);
+        this->tiles_epoch = this->bus->Checkpoint();
+        this->DecodeTiles((uint32_t(1) << tile_pages) - 1);
+        this->ticking = false;
+        this->renderer = Renderer::Scanline;
+
+        // rendering registers are logged, at the current cycle
+        for (const uint8_t offset : { LCDC, STAT, SCY, SCX, LY, LYC, BGP, OBP0, OBP1, WY, WX })
+            this->bus->high.Map(offset, this, true);
+        this->cpu->Attach(this);
+
+        if (this->registers[LCDC] & 0x80)
+            this->SetMode(2);
+        this->Restore();
+    }
+
+    Ppu::Ppu(const Ppu& parent, Cpu::Cpu* const cpu, Memory::Bus* const bus, State* const state, Memory::Dma* const dma)
+        : cpu(cpu), bus(bus), state(state), dma(dma), registers(bus->high.bytes), tiles(&Tiles::Select()),
+          decoded_tiles(parent.decoded_tiles), framebuffer(parent.framebuffer) {
+        // the bus was cloned with the parent's dirty pages and epochs
+        this->tiles_epoch = parent.tiles_epoch;
+        std::memcpy(this->replayed, parent.replayed, sizeof(this->replayed));
+        std::copy(parent.log.begin(), parent.log.begin() + parent.log_length, this->log.begin());
+        this->log_length = parent.log_length;
+        this->next_line = parent.next_line;
+        // the bus was cloned unwatched
+        this->watching = false;
+        this->ticking = false;
+        this->renderer = parent.renderer;
+        this->bus->ReplaceHandler(&parent, this);
+        this->cpu->Attach(this);
+    }
+
+    uint8_t Ppu::Mode() const {
+        return this->registers[STAT] & 0x03;
+    }
+
+    void Ppu::SetMode(const uint8_t mode) {
+        this->registers[STAT] = (this->registers[STAT] & ~0x03) | mode;
+        if (mode == 1)
+            this->registers[IF] |= 0x01;
+        this->UpdateStat();
+    }
+
+    void Ppu::UpdateStat() {
+        uint8_t& stat = this->registers[STAT];
+        if (!(this->registers[LCDC] & 0x80)) {
+            this->state->stat_signal = false;
+            return;
+        }
+
+        stat = (stat & ~0x04) | (this->registers[LY] == this->registers[LYC] ? 0x04 : 0);
+        const uint8_t mode = stat & 0x03;
+        const bool signal = ((stat & 0x40) && (stat & 0x04)) || (mode == 0 && (stat & 0x08))
+            || (mode == 1 && (stat & 0x10)) || (mode == 2 && (stat & 0x20));
+        if (signal && !this->state->stat_signal)
+            this->registers[IF] |= 0x02;
+        this->state->stat_signal = signal;
+    }
+
+    void Ppu::StartLine() {
+        const uint8_t line = this->registers[LY];
+        if (line == height) {
+            this->state->frames++;
+            this->SetMode(1);
+            this->Flush();
+        } else if (line < height) {
+            if (line == 0) {
+                // VBlank writes only apply from the first line on
+                this->Settle();
+                this->next_line = 0;
+            }
+            this->SetMode(2);
+        } else {
+            // still in VBlank, LY changed
+            this->UpdateStat();
+        }
+    }
+
+    uint8_t Ppu::Read(const uint16_t address) {
+        return this->registers[address & (Memory::page_size - 1)];
+    }
+
+    void Ppu::Write(const uint16_t address, const uint8_t value) {
+        if (address < 0xFF00) {
+            // VRAM or OAM is about to change: the bus dropped its watch, caught up unless the write comes from Tick
+            this->watching = false;
+            if (!this->ticking)
+                this->cpu->CatchUp();
+            this->Flush();
+            return;
+        }
+
+        const uint8_t offset = address & (Memory::page_size - 1);
+        switch (offset) {
+            case LCDC: {
+                const bool was_on = this->registers[LCDC] & 0x80;
+                if (was_on == bool(value & 0x80)) {
+                    this->Log(LCDC, value);
+                    break;
+                }
+                // switching the LCD either way restarts from line 0, in HBlank while it is off
+                this->Flush();
+                this->Settle();
+                this->registers[LCDC] = value;
+                this->replayed[0] = value;
+                this->next_line = 0;
+                this->state->line_cycles = 0;
+                this->state->window_line = 0;
+                this->registers[LY] = 0;
+                this->SetMode(was_on ? 0 : 2);
+                break;
+            }
+            case STAT:
+                // the mode and LY=LYC flag are read-only
+                this->registers[STAT] = (this->registers[STAT] & 0x07) | (value & 0x78);
+                this->UpdateStat();
+                break;
+            case LYC:
+                this->registers[LYC] = value;
+                this->UpdateStat();
+                break;
+            case LY:
+                // read-only
+                break;
+            default:
+                this->Log(offset, value);
+                break;
+        }
+    }
+
+    uint8_t Ppu::DueLines() const {
+        if (!(this->registers[LCDC] & 0x80))
+            return this->next_line;
+        const uint8_t mode = this->Mode();
+        if (mode == 1)
+            return height;
+        return mode == 0 ? this->registers[LY] + 1 : this->registers[LY];
+    }
+
+    void Ppu::Log(const uint8_t offset, const uint8_t value) {
+        this->registers[offset] = value;
+        // nothing pending and outside of mode 3: the write applies to every line not drawn yet
+        if (this->log_length == 0 && this->next_line == this->DueLines() && this->Mode() != 3) {
+            this->replayed[offset - LCDC] = value;
+            return;
+        }
+
+        if (this->log_length == log_capacity) {
+            this->Flush();
+            // writes all within the current line: keep the last values
+            if (this->log_length == log_capacity)
+                this->Settle();
+        }
+        const uint16_t time = this->registers[LY] * line_length + this->state->line_cycles;
+        this->log[this->log_length++] = { time, offset, value };
+    }
+
+    void Ppu::Settle() {
+        for (uint32_t i = 0; i < this->log_length; i++)
+            this->replayed[this->log[i].offset - LCDC] = this->log[i].value;
+        this->log_length = 0;
+    }
+
+    void Ppu::Flush() {
+        if (this->watching) {
+            this->bus->Unwatch();
+            this->watching = false;
+        }
+        const uint8_t due = this->DueLines();
+        if (this->next_line >= due)
+            return;
+
+        // VRAM can't change until the last of them is drawn
+        this->UpdateTiles();
+        uint32_t applied = 0;
+        for (; this->next_line < due; this->next_line++)
+            applied = this->DrawLine(this->next_line, applied);
+        std::copy(this->log.begin() + applied, this->log.begin() + this->log_length, this->log.begin());
+        this->log_length -= applied;
+    }
+
+    void Ppu::Restore() {
+        std::memcpy(this->replayed, this->registers + LCDC, sizeof(this->replayed));
+        this->log_length = 0;
+        this->next_line = this->DueLines();
+        this->watching = false;
+    }
+
+    size_t Ppu::BufferBytes() const {
+        return sizeof(uint8_t[height][width]) / this->framebuffer.use_count()
+            + sizeof(uint8_t[tile_count][8][8]) / this->decoded_tiles.use_count();
+    }
+
+    void Ppu::Tick(uint32_t m_cycles) {
+        if (!(this->registers[LCDC] & 0x80))
+            return;
+
+        this->ticking = true;
+        while (m_cycles != 0) {
+            const uint8_t mode = this->Mode();
+            uint32_t next = mode == 2 ? mode_3_start : mode == 3 ? mode_0_start : line_length;
+            // mode 3 of the FIFO lasts at least as long as the fixed one
+            if (mode == 3 && this->renderer == Renderer::Fifo && this->state->line_cycles + m_cycles >= mode_0_start)
+                next = this->FinishLine(this->state->line_cycles + m_cycles);
+            const uint32_t step = std::min(m_cycles, next - this->state->line_cycles);
+            this->state->line_cycles += step;
+            m_cycles -= step;
+            if (this->state->line_cycles < next)
+                break;
+
+            if (mode == 2) {
+                this->SetMode(3);
+            } else if (mode == 3) {
+                this->SetMode(0);
+                // the line is due: draw it before VRAM or OAM change
+                if (!this->watching && this->next_line < this->DueLines()) {
+                    this->bus->Watch(vram_first_page, vram_pages, this);
+                    this->bus->Watch(oam_page, 1, this);
+                    this->watching = true;
+                }
+                if (this->dma != nullptr)
+                    this->dma->HBlank();
+            } else {
+                this->state->line_cycles = 0;
+                this->registers[LY] = (this->registers[LY] + 1) % lines;
+                this->StartLine();
+            }
+        }
+        this->ticking = false;
+    }
+
+    void Ppu::DecodeTiles(const uint32_t pages) {
+        for (uint8_t i = 0; i < tile_pages; i++) {
+            if (!(pages >> i & 1))
+                continue;
+            const uint8_t* const page = this->bus->Peek(vram_first_page + i);
+            uint8_t* const decoded = this->decoded_tiles[i * tiles_per_page][0];
+            if (page != nullptr)
+                this->tiles->Decode(page, Memory::page_size / 2, false, decoded);
+            else
+                std::memset(decoded, 0, tiles_per_page * 64);
+        }
+    }
+
+    void Ppu::UpdateTiles() {
+        // pages written since the last update: still dirty, or folded into a later epoch by another reader
+        constexpr uint8_t word = vram_first_page >> 6;
+        constexpr uint8_t shift = vram_first_page & 63;
+        uint32_t written = this->bus->dirty[word] >> shift & ((uint32_t(1) << tile_pages) - 1);
+        for (uint8_t i = 0; i < tile_pages; i++)
+            if (this->bus->page_epochs[vram_first_page + i] > this->tiles_epoch)
+                written |= uint32_t(1) << i;
+        if (written == 0)
+            return;
+
+        this->tiles_epoch = this->bus->Checkpoint();
+        Unshare(this->decoded_tiles, tile_count);
+        this->DecodeTiles(written);
+    }
+
+    template <typename T>
+    void Ppu::Unshare(std::shared_ptr<T[]>& storage, const size_t count) {
+        // only this instance can share it with more: the count can't grow behind its back
+        if (storage.use_count() == 1)
+            return;
+        std::shared_ptr<T[]> copy(new T[count]);
+        std::memcpy(copy.get(), storage.get(), count * sizeof(T));
+        storage = std::move(copy);
+    }
+
+    uint32_t Ppu::FinishLine(const uint32_t now) {
+        this->Flush();
+        this->UpdateTiles();
+        const uint8_t line = this->registers[LY];
+        uint8_t replayed[sizeof(this->replayed)];
+        std::memcpy(replayed, this->replayed, sizeof(replayed));
+        const uint8_t window_line = this->state->window_line;
+
+        uint32_t dots;
+        const uint32_t applied = this->DrawLine(line, 0, &dots);
+        const uint32_t end = mode_3_start + (dots + 3) / 4;
+        if (end > now) {
+            // writes still to come may change the rest of the line: drawn again from the same start
+            std::memcpy(this->replayed, replayed, sizeof(replayed));
+            this->state->window_line = window_line;
+            return now + 1;
+        }
+
+        this->next_line = line + 1;
+        std::copy(this->log.begin() + applied, this->log.begin() + this->log_length, this->log.begin());
+        this->log_length -= applied;
+        return end;
+    }
+
+    uint32_t Ppu::DrawLine(const uint8_t line, uint32_t applied, uint32_t* const dots) {
+        if (line == 0)
+            this->state->window_line = 0;
+        Unshare(this->framebuffer, height);
+        const uint32_t start = line * line_length;
+        while (applied < this->log_length && this->log[applied].time < start + mode_3_start) {
+            this->replayed[this->log[applied].offset - LCDC] = this->log[applied].value;
+            applied++;
+        }
+
+        if (this->renderer == Renderer::Fifo) {
+            bool window = false;
+            const uint32_t fifo_dots = this->RenderFifo(line, &applied, this->framebuffer[line], &window);
+            if (dots != nullptr)
+                *dots = fifo_dots;
+            if (window)
+                this->state->window_line++;
+            return applied;
+        }
+
+        // pixels before each write of mode 3 show the previous values, assuming one pixel drawn every 43 / 160 M-cycles
+        uint8_t* const pixels = this->framebuffer[line];
+        uint8_t segment[width];
+        bool window = false;
+        uint32_t x = 0;
+        while (x < width) {
+            uint32_t end = width;
+            if (applied < this->log_length && this->log[applied].time < start + mode_0_start)
+                end = (this->log[applied].time - start - mode_3_start) * width / (mode_0_start - mode_3_start);
+            if (x == 0 && end == width) {
+                window = this->RenderLine(line, pixels);
+            } else if (end > x) {
+                window |= this->RenderLine(line, segment);
+                std::memcpy(pixels + x, segment + x, end - x);
+            }
+            x = std::max(x, end);
+            if (end < width) {
+                this->replayed[this->log[applied].offset - LCDC] = this->log[applied].value;
+                applied++;
+            }
+        }
+        if (window)
+            this->state->window_line++;
+        if (dots != nullptr)
+            *dots = (mode_0_start - mode_3_start) * 4;
+        return applied;
+    }
+
+    bool Ppu::RenderLine(const uint8_t line, uint8_t* const pixels) {
+        static const uint8_t unmapped[Memory::page_size] = {};
+        const uint8_t* const replayed = this->replayed;
+        const uint8_t lcdc = replayed[0];
+        // tile maps, at 9800 and 9C00
+        auto tile = [&](const uint16_t offset) -> uint8_t {
+            const uint8_t* const page = this->bus->Peek(vram_first_page + (offset >> Memory::page_bits));
+            return page != nullptr ? page[offset & (Memory::page_size - 1)] : 0;
+        };
+        // decoded row of a background or window tile
+        auto tile_row = [&](const uint8_t index, const uint8_t y) {
+            const uint16_t decoded = lcdc & 0x10 ? index : 256 + int8_t(index);
+            return this->decoded_tiles[decoded][y & 7];
+        };
+
+        // color numbers of the background and window, 0 where they are off
+        uint8_t colors[line_tiles * 8];
+        bool window = false;
+        if (lcdc & 0x01) {
+            const uint8_t y = replayed[SCY - LCDC] + line;
+            const uint16_t map = (lcdc & 0x08 ? 0x1C00 : 0x1800) + (y >> 3) * 32;
+            const uint8_t scx = replayed[SCX - LCDC];
+            // whole tiles, the first shifted left by the fine scroll
+            for (uint8_t i = 0; i < line_tiles; i++) {
+                const uint8_t column = ((scx >> 3) + i) & 31;
+                std::memcpy(colors + i * 8, tile_row(tile(map + column), y), 8);
+            }
+            std::memmove(colors, colors + (scx & 7), width);
+
+            const uint8_t wy = replayed[WY - LCDC];
+            const uint8_t wx = replayed[WX - LCDC];
+            if ((lcdc & 0x20) && line >= wy && wx < width + 7) {
+                const uint16_t window_map = (lcdc & 0x40 ? 0x1C00 : 0x1800) + (this->state->window_line >> 3) * 32;
+                // WX below 7 hides the window's leftmost pixels
+                const uint32_t x = wx < 7 ? 0 : wx - 7;
+                const uint32_t skipped = wx < 7 ? 7 - wx : 0;
+                const uint8_t count = (width - x + skipped + 7) / 8;
+                uint8_t window_colors[line_tiles * 8];
+                for (uint8_t i = 0; i < count; i++)
+                    std::memcpy(window_colors + i * 8, tile_row(tile(window_map + i), this->state->window_line), 8);
+                std::memcpy(colors + x, window_colors + skipped, width - x);
+                window = true;
+            }
+        } else {
+            std::memset(colors, 0, width);
+        }
+
+        // sprite pixels, color 0 where there is none
+        uint8_t sprite_colors[width] = {};
+        uint8_t sprite_flags[width];
+        uint8_t sprites = 0;
+        if (lcdc & 0x02) {
+            const uint8_t* oam = this->bus->Peek(oam_page);
+            if (oam == nullptr)
+                oam = unmapped;
+            const uint8_t sprite_height = lcdc & 0x04 ? 16 : 8;
+
+            // the first 10 sprites of OAM on the line, then by priority: leftmost first, OAM order among equals
+            uint8_t found[max_line_sprites];
+            uint8_t count = 0;
+            for (uint8_t i = 0; i < 40 && count < max_line_sprites; i++) {
+                const int32_t y = oam[i * 4] - 16;
+                if (line >= y && line < y + sprite_height)
+                    found[count++] = i;
+            }
+            sprites = count;
+            std::stable_sort(found, found + count, [&](const uint8_t a, const uint8_t b) { return oam[a * 4 + 1] < oam[b * 4 + 1]; });
+
+            for (uint8_t i = 0; i < count; i++) {
+                const uint8_t* const sprite = oam + found[i] * 4;
+                const uint8_t flags = sprite[3];
+                uint8_t y = line - (sprite[0] - 16);
+                if (flags & 0x40)
+                    y = sprite_height - 1 - y;
+                const uint8_t index = sprite_height == 16 ? sprite[2] & 0xFE : sprite[2];
+                // 8x16 sprites continue into the next tile
+                const uint8_t* const decoded = this->decoded_tiles[index + (y >> 3)][y & 7];
+
+                // a pixel shows the sprite of highest priority that is not transparent there
+                const int32_t left = sprite[1] - 8;
+                for (int32_t pixel = 0; pixel < 8; pixel++) {
+                    const int32_t x = left + pixel;
+                    const uint8_t color = decoded[flags & 0x20 ? 7 - pixel : pixel];
+                    if (x < 0 || x >= (int32_t) width || sprite_colors[x] != 0 || color == 0)
+                        continue;
+                    sprite_colors[x] = color;
+                    sprite_flags[x] = flags;
+                }
+            }
+        }
+
+        uint8_t background_shades[4];
+        uint8_t sprite_shades[2][4];
+        for (uint8_t color = 0; color < 4; color++) {
+            background_shades[color] = shades[replayed[BGP - LCDC] >> (color * 2) & 3];
+            sprite_shades[0][color] = shades[replayed[OBP0 - LCDC] >> (color * 2) & 3];
+            sprite_shades[1][color] = shades[replayed[OBP1 - LCDC] >> (color * 2) & 3];
+        }
+
+        this->tiles->Map(colors, width, background_shades, pixels);
+        if (sprites == 0)
+            return window;
+        for (uint32_t x = 0; x < width; x++) {
+            // sprites behind the background only show through its color 0
+            if (sprite_colors[x] != 0 && !((sprite_flags[x] & 0x80) && colors[x] != 0))
+                pixels[x] = sprite_shades[sprite_flags[x] >> 4 & 1][sprite_colors[x]];
+        }
+        return window;
+    }
+
+    uint32_t Ppu::RenderFifo(const uint8_t line, uint32_t* const applied, uint8_t* const pixels, bool* const window) {
+        static const uint8_t unmapped[Memory::page_size] = {};
+        // dots of the fetch done twice at the start of the line, of a tile fetch, and of a sprite fetch
+        constexpr uint32_t first_fetch_dots = 6;
+        constexpr uint32_t fetch_dots = 6;
+        constexpr uint32_t sprite_fetch_dots = 6;
+
+        uint8_t* const replayed = this->replayed;
+        const uint32_t start = line * line_length + mode_3_start;
+        auto tile = [&](const uint16_t offset) -> uint8_t {
+            const uint8_t* const page = this->bus->Peek(vram_first_page + (offset >> Memory::page_bits));
+            return page != nullptr ? page[offset & (Memory::page_size - 1)] : 0;
+        };
+
+        // OAM scan, with the registers as of mode 3: up to 10 sprites, fetched leftmost first
+        const uint8_t* oam = this->bus->Peek(oam_page);
+        if (oam == nullptr)
+            oam = unmapped;
+        const uint8_t sprite_height = replayed[0] & 0x04 ? 16 : 8;
+        uint8_t found[max_line_sprites];
+        uint8_t sprite_count = 0;
+        for (uint8_t i = 0; i < 40 && sprite_count < max_line_sprites; i++) {
+            const int32_t y = oam[i * 4] - 16;
+            if (line >= y && line < y + sprite_height)
+                found[sprite_count++] = i;
+        }
+        std::stable_sort(found, found + sprite_count, [&](const uint8_t a, const uint8_t b) { return oam[a * 4 + 1] < oam[b * 4 + 1]; });
+
+        // the background FIFO only takes a tile once empty, so it never holds more than 8 pixels
+        uint8_t background[8];
+        uint8_t background_count = 0;
+        // sprite pixels, aligned with the next 8 background pixels shifted out: color 0 where there is none
+        uint8_t sprite_colors[8] = {};
+        uint8_t sprite_flags[8] = {};
+        uint8_t sprite_head = 0;
+        uint8_t next_sprite = 0;
+
+        // the fetcher: a tile number, then its row, ready to be pushed after fetch_dots
+        uint32_t fetch_step = 0;
+        uint8_t fetch_column = 0;
+        uint8_t fetched_index = 0;
+        const uint8_t* fetched_row = nullptr;
+        bool in_window = false;
+        uint32_t sprite_step = 0;
+        bool fetching_sprite = false;
+
+        uint32_t discarded = replayed[SCX - LCDC] & 7;
+        uint32_t x = 0;
+        uint32_t dot = 0;
+        for (; x < width; dot++) {
+            // writes land on the first dot of their M-cycle
+            while (*applied < this->log_length && (this->log[*applied].time - start) * 4 <= dot) {
+                replayed[this->log[*applied].offset - LCDC] = this->log[*applied].value;
+                (*applied)++;
+            }
+            const uint8_t lcdc = replayed[0];
+            if (dot < first_fetch_dots)
+                continue;
+
+            // WX is compared with the pixel about to be shifted out; below 7, the window starts offscreen
+            const uint8_t wx = replayed[WX - LCDC];
+            if (!in_window && (lcdc & 0x20) && (lcdc & 0x01) && line >= replayed[WY - LCDC] && wx < width + 7
+                && (wx < 7 ? x == 0 : x + 7 == wx)) {
+                in_window = true;
+                *window = true;
+                background_count = 0;
+                fetch_step = 0;
+                fetch_column = 0;
+                discarded = wx < 7 ? 7 - wx : 0;
+            }
+
+            // the fetcher pushes a tile once the FIFO is empty, then goes on with the next one
+            if (fetch_step == fetch_dots && background_count == 0) {
+                std::memcpy(background, fetched_row, 8);
+                background_count = 8;
+                fetch_step = 0;
+                fetch_column++;
+            }
+
+            // a sprite starting at the pixel about to be shifted out stops the FIFOs while it is fetched,
+            // once the fetcher is done with the tile it is on
+            if (!fetching_sprite && (lcdc & 0x02) && next_sprite < sprite_count && discarded == 0 && background_count != 0
+                && int32_t(oam[found[next_sprite] * 4 + 1]) - 8 <= int32_t(x)) {
+                fetching_sprite = true;
+                sprite_step = 0;
+            }
+            if (fetching_sprite && fetch_step >= fetch_dots - 1) {
+                if (++sprite_step < sprite_fetch_dots)
+                    continue;
+                const uint8_t* const sprite = oam + found[next_sprite++] * 4;
+                const uint8_t flags = sprite[3];
+                uint8_t y = line - (sprite[0] - 16);
+                if (flags & 0x40)
+                    y = sprite_height - 1 - y;
+                const uint8_t index = sprite_height == 16 ? sprite[2] & 0xFE : sprite[2];
+                const uint8_t* const decoded = this->decoded_tiles[index + (y >> 3)][y & 7];
+                // pixels left of x were shifted out already, earlier sprites keep theirs
+                const int32_t left = sprite[1] - 8;
+                for (int32_t pixel = 0; pixel < 8; pixel++) {
+                    const int32_t slot = left + pixel - int32_t(x);
+                    const uint8_t color = decoded[flags & 0x20 ? 7 - pixel : pixel];
+                    if (slot < 0 || color == 0)
+                        continue;
+                    const uint8_t position = (sprite_head + slot) & 7;
+                    if (sprite_colors[position] != 0)
+                        continue;
+                    sprite_colors[position] = color;
+                    sprite_flags[position] = flags;
+                }
+                fetching_sprite = false;
+                continue;
+            }
+
+            if (fetch_step < fetch_dots) {
+                // the tile number, then the row of its bitplanes, from the registers at the time
+                if (fetch_step == 0) {
+                    uint16_t offset;
+                    if (in_window) {
+                        offset = (lcdc & 0x40 ? 0x1C00 : 0x1800) + (this->state->window_line >> 3) * 32 + (fetch_column & 31);
+                    } else {
+                        const uint8_t y = replayed[SCY - LCDC] + line;
+                        offset = (lcdc & 0x08 ? 0x1C00 : 0x1800) + (y >> 3) * 32 + (((replayed[SCX - LCDC] >> 3) + fetch_column) & 31);
+                    }
+                    fetched_index = tile(offset);
+                } else if (fetch_step == fetch_dots - 2) {
+                    const uint8_t y = in_window ? this->state->window_line : replayed[SCY - LCDC] + line;
+                    fetched_row = this->decoded_tiles[lcdc & 0x10 ? fetched_index : 256 + int8_t(fetched_index)][y & 7];
+                }
+                fetch_step++;
+            }
+            if (background_count == 0 || fetching_sprite)
+                continue;
+
+            // one pixel shifted out per dot, the first ones of the line discarded for the fine scroll
+            const uint8_t color = background[8 - background_count--];
+            if (discarded != 0) {
+                discarded--;
+                continue;
+            }
+            const uint8_t sprite_color = sprite_colors[sprite_head];
+            const uint8_t flags = sprite_flags[sprite_head];
+            sprite_colors[sprite_head] = 0;
+            sprite_head = (sprite_head + 1) & 7;
+
+            // with LCDC bit 0 reset, the background and window are color 0
+            const uint8_t background_color = lcdc & 0x01 ? color : 0;
+            if (sprite_color != 0 && !((flags & 0x80) && background_color != 0))
+                pixels[x] = shades[replayed[(flags & 0x10 ? OBP1 : OBP0) - LCDC] >> (sprite_color * 2) & 3];
+            else
+                pixels[x] = shades[replayed[BGP - LCDC] >> (background_color * 2) & 3];
+            x++;
+        }
+        return dot;
+    }
+}
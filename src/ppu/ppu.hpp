@@ -0,0 +1,185 @@
+#pragma once
+#include <array>
+#include <cstdint>
+#include <memory>
+#include "../cpu/clock.hpp"
+#include "../memory/bus.hpp"
+#include "tiles.hpp"
+
+namespace Cpu {
+    class Cpu;
+}
+
+namespace Memory {
+    class Dma;
+}
+
+namespace Ppu {
+    constexpr uint32_t width = 160;
+    constexpr uint32_t height = 144;
+
+    /// Timing of the PPU, trivially copyable so that it lives in the arena of an instance. Its registers are in the FF page.
+    struct State {
+        /// Frames completed since power on: incremented on entering VBlank.
+        uint64_t frames;
+        /// M-cycles into the current line.
+        uint32_t line_cycles;
+        /// Line of the window drawn next, counted separately from LY: it only advances on lines the window is drawn on. Follows the drawn lines.
+        uint8_t window_line;
+        /// The STAT interrupt line, which requests an interrupt when it goes from low to high.
+        bool stat_signal;
+    };
+
+    /// How lines are drawn, see Ppu::renderer.
+    enum class Renderer : uint8_t {
+        Scanline,  // whole lines at a time, mode 3 of fixed length
+        Fifo       // dot by dot through the background fetcher and pixel FIFOs, mode 3 of variable length
+    };
+
+    /// A write to a rendering register, at M-cycle time of the frame: LY * 114 plus the M-cycles into line LY.
+    struct LoggedWrite {
+        uint16_t time;
+        uint8_t offset;
+        uint8_t value;
+    };
+
+    /**
+     * The DMG picture processing unit, rendering the background, the window and sprites.
+     * Modes follow each other at fixed M-cycles of each 114 M-cycle line, mode 3 taking its
+     * shortest length whatever sprites and scrolling are on the line. Interrupts are requested
+     * in IF, for the CPU to dispatch. VRAM and OAM are read as the bus shows them to the hardware,
+     * copies on write and OAM DMA included.
+     *
+     * Lines are drawn lazily: a line is due once it enters HBlank, but due lines are only drawn
+     * in bulk by Flush, on entering VBlank or when something is about to change under them.
+     * Writes to LCDC, the scroll and window positions and the palettes are logged with their time
+     * instead, and replayed while drawing: a write during mode 3 of a line splits it at the pixel
+     * being drawn then, the rest of the line showing the new value. VRAM and OAM are watched on
+     * the bus while lines are due, their first write flushing those lines before it lands.
+     *
+     * Either renderer draws the lines. The scanline one draws a whole line, or the segments
+     * between writes of mode 3, at once. The FIFO one runs the fetcher and pixel FIFOs dot by dot:
+     * registers are sampled when the hardware reads them, e.g. SCX only moving the fetch by whole
+     * tiles mid-line, and mode 3 lasts as long as the FIFO takes to shift out 160 pixels. Tick
+     * then draws each line as mode 3 ends, to know when it does.
+     */
+    class Ppu : public Memory::Handler, public Cpu::Peripheral {
+    private:
+        // M-cycles at which mode 3 and mode 0 start on a visible line, and the line ends
+        static constexpr uint32_t mode_3_start = 20;
+        static constexpr uint32_t mode_0_start = mode_3_start + 43;
+        static constexpr uint32_t line_length = 114;
+        static constexpr uint32_t lines = 154;
+        // tile data, 8000-97FF
+        static constexpr uint8_t tile_pages = 0x18;
+        static constexpr uint32_t tiles_per_page = Memory::page_size / 16;
+        static constexpr uint32_t tile_count = tile_pages * tiles_per_page;
+        static constexpr uint32_t log_capacity = 256;
+
+        Cpu::Cpu* const cpu;
+        Memory::Bus* const bus;
+        State* const state;
+        /// Copies a block of HBlank DMA on each HBlank, nullptr without DMA.
+        Memory::Dma* const dma;
+        /// Stored LCDC, STAT, LY, LYC and palettes, in the FF page.
+        uint8_t* const registers;
+        /// Decode tile rows and map them through palettes, see Tiles::Select.
+        const Tiles::Kernels* const tiles;
+        /**
+         * Color numbers of the 384 tiles of VRAM, row by row, leftmost pixel first: tile n at 8000 + n * 16.
+         * Pages written since tiles_epoch, as told by the dirty pages and epochs of the bus, are
+         * decoded again before a line is drawn, so that static screens never decode bitplanes.
+         * Derived from VRAM, like code caches: not part of State. Shared with clones until either
+         * decodes tiles again, so that cloning copies none of them.
+         */
+        std::shared_ptr<uint8_t[][8][8]> decoded_tiles;
+        /// Epoch of the bus, returned by Checkpoint, as of which decoded_tiles follows VRAM.
+        uint32_t tiles_epoch;
+        /**
+         * LCDC to WX, indexed from LCDC, as of the end of the last drawn line: the registers
+         * replay the log into. Like the log, state of pending work rather than of the hardware,
+         * emptied by Flush before the arena is saved.
+         */
+        uint8_t replayed[12];
+        /// Writes not replayed yet, oldest first.
+        std::array<LoggedWrite, log_capacity> log;
+        uint32_t log_length;
+        /// The first line not drawn yet this frame.
+        uint8_t next_line;
+        /// Whether VRAM and OAM are watched on the bus.
+        bool watching;
+        /// Set while Tick runs, which writes to VRAM through HBlank DMA.
+        bool ticking;
+
+        /// Enters mode, requesting the interrupts it triggers.
+        void SetMode(const uint8_t mode);
+        /// Starts line LY, after the previous one ended.
+        void StartLine();
+        /// Recomputes the LY=LYC flag and the STAT interrupt line, requesting an interrupt on a rising edge.
+        void UpdateStat();
+        /// Decodes the tiles of the tile data pages set in pages, bit 0 for 8000-80FF.
+        void DecodeTiles(const uint32_t pages);
+        /// Decodes the tiles of pages written since tiles_epoch.
+        void UpdateTiles();
+        /// Gives this PPU its own copy of the count elements of storage, if clones still share it.
+        template <typename T>
+        static void Unshare(std::shared_ptr<T[]>& storage, const size_t count);
+        /// Lines before this one are due: entered HBlank this frame.
+        uint8_t DueLines() const;
+        /// Stores the write of value to a rendering register, logging it if lines it does not apply to are pending.
+        void Log(const uint8_t offset, const uint8_t value);
+        /// Replays the whole log, dropping its timing.
+        void Settle();
+        /**
+         * Draws line into framebuffer with renderer, replaying the writes of log from applied on.
+         * Returns the first one left. The dots mode 3 took are stored at dots if not nullptr.
+         */
+        uint32_t DrawLine(const uint8_t line, uint32_t applied, uint32_t* const dots = nullptr);
+        /// Draws line with the replayed registers into pixels. Returns whether the window shows on it.
+        bool RenderLine(const uint8_t line, uint8_t* const pixels);
+        /**
+         * Runs mode 3 of line through the pixel FIFOs into pixels, replaying the writes of log from
+         * *applied on at the dot they happened, and advancing *applied past them. Sets *window
+         * if the window shows on the line. Returns the dots mode 3 took.
+         */
+        uint32_t RenderFifo(const uint8_t line, uint32_t* const applied, uint8_t* const pixels, bool* const window);
+        /**
+         * With the FIFO renderer, draws line LY if mode 3 ended by M-cycle now of the line, every write
+         * before then being logged. Returns the M-cycle it ended at, or now + 1 if it goes on.
+         */
+        uint32_t FinishLine(const uint32_t now);
+    public:
+        /// Grey levels of the four DMG shades, from lightest to darkest.
+        static constexpr uint8_t shades[4] = { 0xFF, 0xAA, 0x55, 0x00 };
+
+        /**
+         * The screen, one byte per pixel holding its grey level, lines from top to bottom. The whole
+         * frame is complete once frames is incremented, due lines of the next one after Flush.
+         * Lines are not cleared while the LCD is off: they keep the last frame. Shared with clones
+         * until either draws a line.
+         */
+        std::shared_ptr<uint8_t[][width]> framebuffer;
+        /**
+         * The renderer drawing lines, Scanline by default. May be changed at any time: due lines
+         * are drawn by the one in use when they are flushed. Not part of State, and kept by clones.
+         */
+        Renderer renderer;
+
+        /// Resets state, with the LCD in the state LCDC leaves it in.
+        Ppu(Cpu::Cpu* const cpu, Memory::Bus* const bus, State* const state, Memory::Dma* const dma);
+        /// The clone of parent, for the clones of its CPU, bus and DMA, state already holding a copy of parent's.
+        Ppu(const Ppu& parent, Cpu::Cpu* const cpu, Memory::Bus* const bus, State* const state, Memory::Dma* const dma);
+        /// The LCD registers, and writes to watched VRAM and OAM.
+        virtual uint8_t Read(const uint16_t address);
+        virtual void Write(const uint16_t address, const uint8_t value);
+        virtual void Tick(const uint32_t m_cycles);
+        /// Current mode: 0 HBlank, 1 VBlank, 2 OAM scan, 3 drawing.
+        uint8_t Mode() const;
+        /// Draws the due lines and empties the log of the writes before them, e.g. before the framebuffer is shown or the state saved.
+        void Flush();
+        /// Drops pending work after state was restored, lines due then being left as they are.
+        void Restore();
+        /// Bytes of the framebuffer and decoded tiles, divided among the clones sharing them.
+        size_t BufferBytes() const;
+    };
+}
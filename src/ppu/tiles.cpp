@@ -0,0 +1,152 @@
+#include <cstdlib>
+#include <cstring>
+
+#include "tiles.hpp"
+
+#if GBEMU_TILE_SIMD
+#include <immintrin.h>
+#endif
+
+namespace Ppu {
+    namespace Tiles {
+        void DecodeScalar(const uint8_t* const planes, const uint32_t count, const bool flip, uint8_t* const colors) {
+            for (uint32_t row = 0; row < count; row++) {
+                const uint8_t low = planes[row * 2];
+                const uint8_t high = planes[row * 2 + 1];
+                uint8_t* const pixels = colors + row * 8;
+                for (uint8_t i = 0; i < 8; i++) {
+                    const uint8_t bit = flip ? i : 7 - i;
+                    pixels[i] = (low >> bit & 1) | (high >> bit & 1) << 1;
+                }
+            }
+        }
+
+        void MapScalar(const uint8_t* const colors, const uint32_t count, const uint8_t* const palette, uint8_t* const shades) {
+            for (uint32_t i = 0; i < count; i++)
+                shades[i] = palette[colors[i]];
+        }
+
+        const Kernels scalar = { "scalar", DecodeScalar, MapScalar };
+
+#if GBEMU_TILE_SIMD
+        /// Color numbers of the pixels whose bit is set in bits, from bitplane bytes each repeated over the pixels of their row.
+        __attribute__((target("sse2")))
+        inline __m128i ColorsSse2(const __m128i low, const __m128i high, const __m128i bits) {
+            const __m128i low_set = _mm_cmpeq_epi8(_mm_and_si128(low, bits), bits);
+            const __m128i high_set = _mm_cmpeq_epi8(_mm_and_si128(high, bits), bits);
+            return _mm_or_si128(_mm_and_si128(low_set, _mm_set1_epi8(1)), _mm_and_si128(high_set, _mm_set1_epi8(2)));
+        }
+
+        __attribute__((target("sse2")))
+        void DecodeSse2(const uint8_t* const planes, const uint32_t count, const bool flip, uint8_t* const colors) {
+            // the bit of each pixel of two rows, in the order they are written
+            const __m128i bits = flip
+                ? _mm_setr_epi8(1, 2, 4, 8, 16, 32, 64, -128, 1, 2, 4, 8, 16, 32, 64, -128)
+                : _mm_setr_epi8(-128, 64, 32, 16, 8, 4, 2, 1, -128, 64, 32, 16, 8, 4, 2, 1);
+            uint32_t row = 0;
+            for (; row + 8 <= count; row += 8) {
+                const __m128i rows = _mm_loadu_si128((const __m128i*) (planes + row * 2));
+                // low planes of the 8 rows in bytes 0-7, high planes in 8-15
+                const __m128i split = _mm_packus_epi16(_mm_and_si128(rows, _mm_set1_epi16(0xFF)), _mm_srli_epi16(rows, 8));
+                // repeated twice, then 4 times, then 8 times: one pair of rows per vector
+                const __m128i low_2 = _mm_unpacklo_epi8(split, split);
+                const __m128i high_2 = _mm_unpackhi_epi8(split, split);
+                const __m128i low_4[2] = { _mm_unpacklo_epi16(low_2, low_2), _mm_unpackhi_epi16(low_2, low_2) };
+                const __m128i high_4[2] = { _mm_unpacklo_epi16(high_2, high_2), _mm_unpackhi_epi16(high_2, high_2) };
+                __m128i* const out = (__m128i*) (colors + row * 8);
+                for (uint8_t half = 0; half < 2; half++) {
+                    _mm_storeu_si128(out + half * 2, ColorsSse2(_mm_unpacklo_epi32(low_4[half], low_4[half]), _mm_unpacklo_epi32(high_4[half], high_4[half]), bits));
+                    _mm_storeu_si128(out + half * 2 + 1, ColorsSse2(_mm_unpackhi_epi32(low_4[half], low_4[half]), _mm_unpackhi_epi32(high_4[half], high_4[half]), bits));
+                }
+            }
+            DecodeScalar(planes + row * 2, count - row, flip, colors + row * 8);
+        }
+
+        __attribute__((target("sse2")))
+        void MapSse2(const uint8_t* const colors, const uint32_t count, const uint8_t* const palette, uint8_t* const shades) {
+            uint32_t i = 0;
+            for (; i + 16 <= count; i += 16) {
+                const __m128i numbers = _mm_loadu_si128((const __m128i*) (colors + i));
+                __m128i mapped = _mm_setzero_si128();
+                for (uint8_t color = 0; color < 4; color++) {
+                    const __m128i is_color = _mm_cmpeq_epi8(numbers, _mm_set1_epi8(color));
+                    mapped = _mm_or_si128(mapped, _mm_and_si128(is_color, _mm_set1_epi8(palette[color])));
+                }
+                _mm_storeu_si128((__m128i*) (shades + i), mapped);
+            }
+            MapScalar(colors + i, count - i, palette, shades + i);
+        }
+
+        __attribute__((target("avx2")))
+        void DecodeAvx2(const uint8_t* const planes, const uint32_t count, const bool flip, uint8_t* const colors) {
+            const __m256i bits = flip
+                ? _mm256_setr_epi8(1, 2, 4, 8, 16, 32, 64, -128, 1, 2, 4, 8, 16, 32, 64, -128,
+                                   1, 2, 4, 8, 16, 32, 64, -128, 1, 2, 4, 8, 16, 32, 64, -128)
+                : _mm256_setr_epi8(-128, 64, 32, 16, 8, 4, 2, 1, -128, 64, 32, 16, 8, 4, 2, 1,
+                                   -128, 64, 32, 16, 8, 4, 2, 1, -128, 64, 32, 16, 8, 4, 2, 1);
+            // 4 rows in each lane, each of their bytes repeated over the pixels of its row
+            const __m256i low_index = _mm256_setr_epi8(0, 0, 0, 0, 0, 0, 0, 0, 2, 2, 2, 2, 2, 2, 2, 2,
+                                                       4, 4, 4, 4, 4, 4, 4, 4, 6, 6, 6, 6, 6, 6, 6, 6);
+            const __m256i high_index = _mm256_add_epi8(low_index, _mm256_set1_epi8(1));
+            uint32_t row = 0;
+            for (; row + 4 <= count; row += 4) {
+                int64_t bytes;
+                std::memcpy(&bytes, planes + row * 2, sizeof(bytes));
+                const __m256i rows = _mm256_set1_epi64x(bytes);
+                const __m256i low_set = _mm256_cmpeq_epi8(_mm256_and_si256(_mm256_shuffle_epi8(rows, low_index), bits), bits);
+                const __m256i high_set = _mm256_cmpeq_epi8(_mm256_and_si256(_mm256_shuffle_epi8(rows, high_index), bits), bits);
+                const __m256i numbers = _mm256_or_si256(_mm256_and_si256(low_set, _mm256_set1_epi8(1)), _mm256_and_si256(high_set, _mm256_set1_epi8(2)));
+                _mm256_storeu_si256((__m256i*) (colors + row * 8), numbers);
+            }
+            // the tail runs legacy SSE code, slowed down by dirty upper halves
+            _mm256_zeroupper();
+            DecodeScalar(planes + row * 2, count - row, flip, colors + row * 8);
+        }
+
+        __attribute__((target("avx2")))
+        void MapAvx2(const uint8_t* const colors, const uint32_t count, const uint8_t* const palette, uint8_t* const shades) {
+            // the palette in the first 4 bytes of each lane, looked up by color number
+            int32_t entries;
+            std::memcpy(&entries, palette, sizeof(entries));
+            const __m256i table = _mm256_set1_epi32(entries);
+            uint32_t i = 0;
+            for (; i + 32 <= count; i += 32) {
+                const __m256i numbers = _mm256_loadu_si256((const __m256i*) (colors + i));
+                _mm256_storeu_si256((__m256i*) (shades + i), _mm256_shuffle_epi8(table, numbers));
+            }
+            _mm256_zeroupper();
+            MapSse2(colors + i, count - i, palette, shades + i);
+        }
+
+        const Kernels sse2 = { "sse2", DecodeSse2, MapSse2 };
+        const Kernels avx2 = { "avx2", DecodeAvx2, MapAvx2 };
+#endif
+
+        std::vector<const Kernels*> Supported() {
+            std::vector<const Kernels*> kernels = { &scalar };
+#if GBEMU_TILE_SIMD
+            __builtin_cpu_init();
+            if (__builtin_cpu_supports("sse2"))
+                kernels.push_back(&sse2);
+            if (__builtin_cpu_supports("avx2"))
+                kernels.push_back(&avx2);
+#endif
+            return kernels;
+        }
+
+        const Kernels& Select() {
+            static const Kernels* const selected = [] {
+                const std::vector<const Kernels*> kernels = Supported();
+                const char* const name = std::getenv("GBEMU_SIMD");
+                if (name != nullptr && name[0] == '0')
+                    return kernels.front();
+                if (name != nullptr)
+                    for (const Kernels* const named : kernels)
+                        if (std::strcmp(named->name, name) == 0)
+                            return named;
+                return kernels.back();
+            }();
+            return *selected;
+        }
+    }
+}
@@ -0,0 +1,48 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+
+// SSE2 and AVX2 kernels on x86-64, built with target attributes and picked by CPUID at runtime
+#ifndef GBEMU_TILE_SIMD
+#if defined(__x86_64__) && defined(__GNUC__)
+#define GBEMU_TILE_SIMD 1
+#else
+#define GBEMU_TILE_SIMD 0
+#endif
+#endif
+
+namespace Ppu {
+    namespace Tiles {
+        /**
+         * Decodes count 2bpp tile rows, each the two bytes of its bitplanes at planes, low plane first,
+         * into 8 color numbers per row at colors: leftmost pixel first, or rightmost first if flip is set.
+         */
+        typedef void (*Decoder)(const uint8_t* const planes, const uint32_t count, const bool flip, uint8_t* const colors);
+        /// Writes palette[color] to shades for each of the count color numbers, 0 to 3, at colors.
+        typedef void (*Mapper)(const uint8_t* const colors, const uint32_t count, const uint8_t* const palette, uint8_t* const shades);
+
+        /// A set of kernels, all giving the same output as the scalar ones for the same input.
+        struct Kernels {
+            const char* name;
+            Decoder Decode;
+            Mapper Map;
+        };
+
+        /// The reference, in plain C++.
+        extern const Kernels scalar;
+#if GBEMU_TILE_SIMD
+        /// 8 rows and 16 pixels at a time.
+        extern const Kernels sse2;
+        /// 4 rows and 32 pixels at a time.
+        extern const Kernels avx2;
+#endif
+
+        /// Kernels this CPU runs, scalar first, fastest last.
+        std::vector<const Kernels*> Supported();
+        /**
+         * The fastest supported kernels, looked up once. GBEMU_SIMD=0 keeps the scalar ones,
+         * GBEMU_SIMD=sse2 or another name picks those kernels if supported.
+         */
+        const Kernels& Select();
+    }
+}